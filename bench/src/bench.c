@@ -0,0 +1,599 @@
+/* bench.c ; benchmark suite for MCFG/2
+ *
+ * Runs micro benchmarks of the lexer, parser, path lookups, embed formatting
+ * and serializer on a small config, and macro benchmarks of the same phases
+ * on large synthetic corpora. Results are written to a machine-readable
+ * report, one result per line, see scripts/run-bench.bash.
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensend under the BSD 3-Clause License.
+ */
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mcfg.h"
+#include "mcfg_format.h"
+#include "mcfg_util.h"
+#include "parse.h"
+
+#include "corpus.c"
+
+#define DEFAULT_MIN_TIME_NS	 200000000ULL
+#define DEFAULT_OUTPUT		 "bench_output.txt"
+#define LOOKUP_PATH_MAX		 256
+#define MAX_RESULTS			 128
+
+/* allocation counting, only possible where the allocator of the libc can be
+ * wrapped. The sanitizers bring their own allocator, so leave it alone there.
+ */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && \
+	!defined(__SANITIZE_THREAD__)
+#define COUNT_ALLOCATIONS
+#endif
+
+static atomic_size_t allocation_count = 0;
+static atomic_size_t allocated_bytes = 0;
+
+#ifdef COUNT_ALLOCATIONS
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+#define COUNT_ALLOCATION(size)                                            \
+	do {                                                                  \
+		atomic_fetch_add_explicit(&allocation_count, 1,                   \
+								  memory_order_relaxed);                  \
+		atomic_fetch_add_explicit(&allocated_bytes, size,                 \
+								  memory_order_relaxed);                  \
+	} while(0)
+
+void *
+malloc(size_t size)
+{
+	COUNT_ALLOCATION(size);
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t count, size_t size)
+{
+	COUNT_ALLOCATION(count * size);
+	return __libc_calloc(count, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	COUNT_ALLOCATION(size);
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+typedef struct bench_result {
+	char name[64];
+	size_t iterations;
+	double ns_per_op;
+
+	/** @brief Bytes processed by one op, 0 if bytes/s is meaningless */
+	double bytes_per_op;
+
+	double allocations_per_op;
+	double allocated_bytes_per_op;
+} bench_result_t;
+
+static bench_result_t results[MAX_RESULTS];
+static size_t result_count = 0;
+
+static uint64_t min_time_ns = DEFAULT_MIN_TIME_NS;
+
+/**
+ * @brief The input of all benchmarks on one corpus. Everything a benchmark
+ * does not measure is prepared up front.
+ */
+typedef struct bench_input {
+	const corpus_shape_t *shape;
+	corpus_t corpus;
+
+	/** @brief The corpus lexed once, input of parse_tree */
+	syntax_tree_t *tree;
+
+	/** @brief The corpus parsed once */
+	mcfg_file_t file;
+
+	/** @brief Absolute paths of all fields */
+	mcfg_path_t *paths;
+	size_t path_count;
+
+	/** @brief All string fields and the section they are in */
+	mcfg_field_t **strings;
+	mcfg_path_t *string_sections;
+	size_t string_count;
+
+	size_t cursor;
+
+	/** @brief Bytes processed by all ops since the start of the run */
+	size_t bytes;
+
+	/* results of the last op, freed outside of the measurement */
+	syntax_tree_t *out_tree;
+	mcfg_file_t out_file;
+	mcfg_string_t *out_string;
+} bench_input_t;
+
+typedef bool (*bench_op_t)(bench_input_t *input);
+typedef void (*bench_cleanup_t)(bench_input_t *input);
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+fail(const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "bench: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	exit(1);
+}
+
+/**
+ * @brief Runs op until at least min_time_ns were spent in it. If the op has a
+ * cleanup, every op is timed on its own so that the cleanup is not measured,
+ * else ops are timed in growing batches.
+ */
+static void
+run_bench(const char *name,
+		  bench_input_t *input,
+		  bench_op_t op,
+		  bench_cleanup_t cleanup)
+{
+	if(result_count == MAX_RESULTS) {
+		fail("too many results");
+	}
+
+	size_t iterations = 0;
+	uint64_t elapsed = 0;
+	size_t allocations = 0;
+	size_t allocated = 0;
+
+	/* warm up */
+	input->cursor = 0;
+	if(!op(input)) {
+		fail("%s failed", name);
+	}
+	if(cleanup != NULL) {
+		cleanup(input);
+	}
+
+	input->cursor = 0;
+	input->bytes = 0;
+
+	size_t batch = 1;
+	while(elapsed < min_time_ns) {
+		const size_t count_before = atomic_load(&allocation_count);
+		const size_t bytes_before = atomic_load(&allocated_bytes);
+		const uint64_t start = now_ns();
+
+		for(size_t ix = 0; ix < batch; ix++) {
+			if(!op(input)) {
+				fail("%s failed", name);
+			}
+		}
+
+		elapsed += now_ns() - start;
+		allocations += atomic_load(&allocation_count) - count_before;
+		allocated += atomic_load(&allocated_bytes) - bytes_before;
+		iterations += batch;
+
+		if(cleanup != NULL) {
+			cleanup(input);
+		} else if(batch < 1 << 20) {
+			batch *= 2;
+		}
+	}
+
+	bench_result_t *result = &results[result_count++];
+	snprintf(result->name, sizeof(result->name), "%s", name);
+	result->iterations = iterations;
+	result->ns_per_op = (double)elapsed / iterations;
+	result->bytes_per_op = (double)input->bytes / iterations;
+	result->allocations_per_op = (double)allocations / iterations;
+	result->allocated_bytes_per_op = (double)allocated / iterations;
+
+	fprintf(stderr, "  %-36s %14.1f ns/op", name, result->ns_per_op);
+	if(result->bytes_per_op > 0) {
+		fprintf(stderr, " %10.1f MiB/s",
+				result->bytes_per_op / result->ns_per_op * 1e9 /
+					(1024 * 1024));
+	}
+#ifdef COUNT_ALLOCATIONS
+	fprintf(stderr, " %12.1f allocs/op", result->allocations_per_op);
+#endif
+	fprintf(stderr, "\n");
+}
+
+/* benchmark ops */
+
+static bool
+op_lex(bench_input_t *input)
+{
+	input->out_tree = malloc(sizeof(syntax_tree_t));
+	if(input->out_tree == NULL) {
+		return false;
+	}
+
+	input->bytes += input->corpus.length;
+	return lex_input(input->corpus.data, input->out_tree) == MCFG_OK;
+}
+
+static void
+cleanup_lex(bench_input_t *input)
+{
+	free_tree(input->out_tree);
+	input->out_tree = NULL;
+}
+
+static bool
+op_parse_tree(bench_input_t *input)
+{
+	input->out_file = (mcfg_file_t){0};
+	input->bytes += input->corpus.length;
+	return parse_tree(*input->tree, &input->out_file, NULL).err == MCFG_OK;
+}
+
+static bool
+op_parse(bench_input_t *input)
+{
+	mcfg_parse_result_t result = mcfg_parse(input->corpus.data);
+	input->out_file = result.value;
+	input->bytes += input->corpus.length;
+	return result.err == MCFG_OK;
+}
+
+static void
+cleanup_file(bench_input_t *input)
+{
+	mcfg_free_file(input->out_file);
+	input->out_file = (mcfg_file_t){0};
+}
+
+static bool
+op_lookup(bench_input_t *input)
+{
+	mcfg_path_t path = input->paths[input->cursor++ % input->path_count];
+	return mcfg_get_field_by_path(&input->file, path) != NULL;
+}
+
+static bool
+op_lookup_all(bench_input_t *input)
+{
+	for(size_t ix = 0; ix < input->path_count; ix++) {
+		if(mcfg_get_field_by_path(&input->file, input->paths[ix]) == NULL) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool
+op_format(bench_input_t *input)
+{
+	const size_t ix = input->cursor++ % input->string_count;
+	mcfg_fmt_res_t res = mcfg_format_field_embeds(
+		*input->strings[ix], input->file, input->string_sections[ix]);
+
+	input->bytes += res.formatted_size;
+	free(res.formatted);
+	return res.err == MCFG_FMT_OK;
+}
+
+static bool
+op_format_all(bench_input_t *input)
+{
+	for(size_t ix = 0; ix < input->string_count; ix++) {
+		mcfg_fmt_res_t res = mcfg_format_field_embeds(
+			*input->strings[ix], input->file, input->string_sections[ix]);
+
+		input->bytes += res.formatted_size;
+		free(res.formatted);
+		if(res.err != MCFG_FMT_OK) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool
+op_serialize(bench_input_t *input)
+{
+	mcfg_serialize_result_t result =
+		mcfg_serialize(input->file, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+	if(result.err != MCFG_OK) {
+		return false;
+	}
+
+	input->out_string = result.value;
+	input->bytes += result.value->length;
+	return true;
+}
+
+static void
+cleanup_string(bench_input_t *input)
+{
+	free(input->out_string);
+	input->out_string = NULL;
+}
+
+/* inputs */
+
+static char *
+join_path(const char *sector, const char *section, const char *field)
+{
+	char buf[LOOKUP_PATH_MAX];
+	snprintf(buf, sizeof(buf), "/%s/%s%s%s", sector, section,
+			 field != NULL ? "/" : "", field != NULL ? field : "");
+	return buf[0] != '\0' ? strdup(buf) : NULL;
+}
+
+static bench_input_t
+prepare_input(const corpus_shape_t *shape)
+{
+	bench_input_t input = {.shape = shape};
+	input.corpus = corpus_generate(shape);
+
+	input.tree = malloc(sizeof(syntax_tree_t));
+	if(input.tree == NULL ||
+	   lex_input(input.corpus.data, input.tree) != MCFG_OK) {
+		fail("failed to lex corpus \"%s\"", shape->name);
+	}
+
+	mcfg_parse_result_t parsed = mcfg_parse(input.corpus.data);
+	if(parsed.err != MCFG_OK) {
+		fail("failed to parse corpus \"%s\": %s", shape->name,
+			 mcfg_err_string(parsed.err));
+	}
+	input.file = parsed.value;
+
+	size_t field_count = 0;
+	for(size_t s = 0; s < input.file.sector_count; s++) {
+		mcfg_sector_t *sector = &input.file.sectors[s];
+		for(size_t t = 0; t < sector->section_count; t++) {
+			field_count += sector->sections[t].field_count;
+		}
+	}
+
+	input.paths = calloc(field_count, sizeof(mcfg_path_t));
+	input.strings = calloc(field_count, sizeof(mcfg_field_t *));
+	input.string_sections = calloc(field_count, sizeof(mcfg_path_t));
+	if(input.paths == NULL || input.strings == NULL ||
+	   input.string_sections == NULL) {
+		fail("out of memory");
+	}
+
+	for(size_t s = 0; s < input.file.sector_count; s++) {
+		mcfg_sector_t *sector = &input.file.sectors[s];
+		for(size_t t = 0; t < sector->section_count; t++) {
+			mcfg_section_t *section = &sector->sections[t];
+			for(size_t f = 0; f < section->field_count; f++) {
+				mcfg_field_t *field = &section->fields[f];
+
+				char *path = join_path(sector->name, section->name,
+									   field->name);
+				input.paths[input.path_count++] = mcfg_parse_path(path);
+				free(path);
+
+				if(field->type != TYPE_STRING) {
+					continue;
+				}
+
+				path = join_path(sector->name, section->name, NULL);
+				input.string_sections[input.string_count] =
+					mcfg_parse_path(path);
+				input.strings[input.string_count++] = field;
+				free(path);
+			}
+		}
+	}
+
+	return input;
+}
+
+static void
+free_input(bench_input_t *input)
+{
+	for(size_t ix = 0; ix < input->path_count; ix++) {
+		mcfg_free_path(input->paths[ix]);
+	}
+
+	for(size_t ix = 0; ix < input->string_count; ix++) {
+		mcfg_free_path(input->string_sections[ix]);
+	}
+
+	free(input->paths);
+	free(input->strings);
+	free(input->string_sections);
+	free_tree(input->tree);
+	mcfg_free_file(input->file);
+	free(input->corpus.data);
+}
+
+static void
+bench_micro(void)
+{
+	bench_input_t input = prepare_input(corpus_find_shape("small"));
+	fprintf(stderr, "micro (%zu bytes, %zu fields):\n", input.corpus.length,
+			input.path_count);
+
+	run_bench("micro/lex_input", &input, op_lex, cleanup_lex);
+	run_bench("micro/parse_tree", &input, op_parse_tree, cleanup_file);
+	run_bench("micro/get_field_by_path", &input, op_lookup, NULL);
+	run_bench("micro/format_field_embeds", &input, op_format, NULL);
+	run_bench("micro/serialize", &input, op_serialize, cleanup_string);
+
+	if(mcfg_enable_path_cache(&input.file, MCFG_PATH_CACHE_DEFAULT_SLOTS) !=
+	   MCFG_OK) {
+		fail("failed to enable path cache");
+	}
+
+	run_bench("micro/get_field_by_path_cached", &input, op_lookup, NULL);
+	run_bench("micro/format_field_embeds_cached", &input, op_format, NULL);
+
+	free_input(&input);
+}
+
+static void
+bench_macro(const corpus_shape_t *shape)
+{
+	bench_input_t input = prepare_input(shape);
+	fprintf(stderr, "macro/%s (%zu bytes, %zu fields):\n", shape->name,
+			input.corpus.length, input.path_count);
+
+	char name[64];
+
+#define MACRO_BENCH(op_name, op, cleanup)                               \
+	do {                                                                \
+		snprintf(name, sizeof(name), "%s/" op_name, shape->name);       \
+		run_bench(name, &input, op, cleanup);                           \
+	} while(0)
+
+	MACRO_BENCH("lex_input", op_lex, cleanup_lex);
+	MACRO_BENCH("parse_tree", op_parse_tree, cleanup_file);
+	MACRO_BENCH("parse", op_parse, cleanup_file);
+	MACRO_BENCH("get_field_by_path_all", op_lookup_all, NULL);
+	MACRO_BENCH("format_field_embeds_all", op_format_all, NULL);
+	MACRO_BENCH("serialize", op_serialize, cleanup_string);
+
+#undef MACRO_BENCH
+
+	free_input(&input);
+}
+
+static void
+write_report(FILE *out)
+{
+	fprintf(out, "{\n\t\"version\": \"%s\",\n\t\"min_time_ns\": %llu,\n",
+			MCFG_2_VERSION, (unsigned long long)min_time_ns);
+	fprintf(out, "\t\"results\": [\n");
+
+	for(size_t ix = 0; ix < result_count; ix++) {
+		bench_result_t *result = &results[ix];
+
+		fprintf(out,
+				"\t\t{\"name\": \"%s\", \"iterations\": %zu, "
+				"\"ns_per_op\": %.2f, ",
+				result->name, result->iterations, result->ns_per_op);
+
+		if(result->bytes_per_op > 0) {
+			fprintf(out, "\"bytes_per_second\": %.0f, ",
+					result->bytes_per_op / result->ns_per_op * 1e9);
+		} else {
+			fprintf(out, "\"bytes_per_second\": null, ");
+		}
+
+#ifdef COUNT_ALLOCATIONS
+		fprintf(out,
+				"\"allocations_per_op\": %.2f, "
+				"\"allocated_bytes_per_op\": %.2f}",
+				result->allocations_per_op, result->allocated_bytes_per_op);
+#else
+		fprintf(out, "\"allocations_per_op\": null, "
+					 "\"allocated_bytes_per_op\": null}");
+#endif
+
+		fprintf(out, "%s\n", ix + 1 < result_count ? "," : "");
+	}
+
+	fprintf(out, "\t]\n}\n");
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr,
+			"usage: %s [-t SECONDS] [-o REPORT] [SHAPE...]\n"
+			"       %s --generate SHAPE\n"
+			"shapes:",
+			argv0, argv0);
+
+	for(size_t ix = 0; ix < CORPUS_SHAPE_COUNT; ix++) {
+		fprintf(stderr, " %s", corpus_shapes[ix].name);
+	}
+	fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *output = DEFAULT_OUTPUT;
+	const corpus_shape_t *selected[CORPUS_SHAPE_COUNT];
+	size_t selected_count = 0;
+
+	for(int ix = 1; ix < argc; ix++) {
+		if(strcmp(argv[ix], "--generate") == 0 && ix + 1 < argc) {
+			const corpus_shape_t *shape = corpus_find_shape(argv[ix + 1]);
+			if(shape == NULL) {
+				usage(argv[0]);
+				return 1;
+			}
+
+			corpus_t corpus = corpus_generate(shape);
+			fwrite(corpus.data, 1, corpus.length, stdout);
+			free(corpus.data);
+			return 0;
+		} else if(strcmp(argv[ix], "-t") == 0 && ix + 1 < argc) {
+			min_time_ns = strtod(argv[++ix], NULL) * 1e9;
+		} else if(strcmp(argv[ix], "-o") == 0 && ix + 1 < argc) {
+			output = argv[++ix];
+		} else {
+			const corpus_shape_t *shape = corpus_find_shape(argv[ix]);
+			if(shape == NULL || selected_count == CORPUS_SHAPE_COUNT) {
+				usage(argv[0]);
+				return 1;
+			}
+
+			selected[selected_count++] = shape;
+		}
+	}
+
+	fprintf(stderr, ">> MCFG/2 version " MCFG_2_VERSION " benchmarks\n");
+
+	if(selected_count == 0) {
+		bench_micro();
+		for(size_t ix = 0; ix < CORPUS_SHAPE_COUNT; ix++) {
+			if(strcmp(corpus_shapes[ix].name, "small") != 0) {
+				bench_macro(&corpus_shapes[ix]);
+			}
+		}
+	} else {
+		for(size_t ix = 0; ix < selected_count; ix++) {
+			bench_macro(selected[ix]);
+		}
+	}
+
+	FILE *out = fopen(output, "w");
+	if(out == NULL) {
+		fail("failed to open %s", output);
+	}
+
+	write_report(out);
+	fclose(out);
+
+	fprintf(stderr, ">> report written to %s\n", output);
+	return 0;
+}
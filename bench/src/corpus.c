@@ -0,0 +1,168 @@
+/* Synthetic corpus generator for the benchmarks. Every corpus is generated
+ * from a shape, so the same shape always produces the same bytes.
+ */
+
+typedef struct corpus_shape {
+	const char *name;
+
+	size_t sector_count;
+	size_t section_count;
+
+	/** @brief Fields per section, the types of which rotate */
+	size_t field_count;
+
+	/** @brief Elements of every list field, 0 for no list fields */
+	size_t list_length;
+
+	/** @brief Length of the plain string fields */
+	size_t string_length;
+
+	/** @brief Break plain strings into lines of 64 characters */
+	bool multiline;
+
+	/** @brief Embeds in every template field, 0 for no template fields */
+	size_t embed_count;
+} corpus_shape_t;
+
+static const corpus_shape_t corpus_shapes[] = {
+	{"small", 1, 2, 8, 4, 32, false, 2},
+	{"many_sectors", 2000, 2, 4, 0, 16, false, 0},
+	{"wide_sections", 4, 2, 2000, 0, 16, false, 0},
+	{"long_lists", 8, 4, 4, 5000, 16, false, 0},
+	{"large_strings", 8, 4, 4, 0, 64 * 1024, true, 0},
+	{"embed_heavy", 40, 8, 16, 0, 16, false, 16},
+};
+
+#define CORPUS_SHAPE_COUNT (sizeof(corpus_shapes) / sizeof(*corpus_shapes))
+
+typedef struct corpus {
+	char *data;
+	size_t length;
+	size_t capacity;
+} corpus_t;
+
+static void
+corpus_put(corpus_t *corpus, const char *fmt, ...)
+{
+	va_list args;
+
+	for(;;) {
+		va_start(args, fmt);
+		const int written =
+			vsnprintf(corpus->data + corpus->length,
+					  corpus->capacity - corpus->length, fmt, args);
+		va_end(args);
+
+		if(corpus->length + written < corpus->capacity) {
+			corpus->length += written;
+			return;
+		}
+
+		corpus->capacity = (corpus->capacity + written) * 2;
+		corpus->data = realloc(corpus->data, corpus->capacity);
+		if(corpus->data == NULL) {
+			fprintf(stderr, "corpus: out of memory\n");
+			exit(1);
+		}
+	}
+}
+
+/* field k of a section is, by k % 4: a plain string, a number, a list (or a
+ * bool) and a template (or a bool)
+ */
+static void
+corpus_put_field(corpus_t *corpus, const corpus_shape_t *shape, size_t k)
+{
+	switch(k % 4) {
+		case 0:
+			corpus_put(corpus, "    str s%zu '", k);
+			for(size_t ix = 0; ix < shape->string_length; ix++) {
+				if(shape->multiline && ix > 0 && ix % 64 == 0) {
+					corpus_put(corpus, "\n");
+				}
+
+				corpus_put(corpus, "%c", ix % 97 == 96 ? ' ' : 'a' + ix % 26);
+			}
+			corpus_put(corpus, "'\n");
+			break;
+		case 1:
+			corpus_put(corpus, "    u32 n%zu %zu\n", k, k * 7919 % 100000);
+			break;
+		case 2:
+			if(shape->list_length == 0) {
+				corpus_put(corpus, "    bool b%zu %s\n", k,
+						   k % 8 == 2 ? "true" : "false");
+				break;
+			}
+
+			corpus_put(corpus, "    list u16 l%zu", k);
+			for(size_t ix = 0; ix < shape->list_length; ix++) {
+				corpus_put(corpus, "%s%zu", ix == 0 ? " " : ",", ix % 65536);
+				if(ix % 16 == 15 && ix + 1 < shape->list_length) {
+					corpus_put(corpus, "\n     ");
+				}
+			}
+			corpus_put(corpus, "\n");
+			break;
+		case 3:
+			if(shape->embed_count == 0) {
+				corpus_put(corpus, "    bool t%zu true\n", k);
+				break;
+			}
+
+			/* alternate between relative embeds of the fields before this
+			 * one and absolute embeds into the first section of the file
+			 */
+			corpus_put(corpus, "    str t%zu 'template", k);
+			for(size_t ix = 0; ix < shape->embed_count; ix++) {
+				if(ix % 2 == 0) {
+					corpus_put(corpus, " $(s%zu)", k - 3);
+				} else {
+					corpus_put(corpus, " $(/x0/c0/n1)");
+				}
+			}
+			corpus_put(corpus, "'\n");
+			break;
+	}
+}
+
+/**
+ * @brief Generates the corpus of a shape, the result has to be freed.
+ */
+static corpus_t
+corpus_generate(const corpus_shape_t *shape)
+{
+	corpus_t corpus = {.data = NULL, .length = 0, .capacity = 0};
+
+	corpus_put(&corpus, "; generated corpus \"%s\"\n", shape->name);
+	for(size_t sector = 0; sector < shape->sector_count; sector++) {
+		corpus_put(&corpus, "sector x%zu\n", sector);
+
+		for(size_t section = 0; section < shape->section_count; section++) {
+			corpus_put(&corpus, "%s  section c%zu\n", section > 0 ? "\n" : "",
+					   section);
+
+			for(size_t field = 0; field < shape->field_count; field++) {
+				corpus_put_field(&corpus, shape, field);
+			}
+
+			corpus_put(&corpus, "  end\n");
+		}
+
+		corpus_put(&corpus, "end\n\n");
+	}
+
+	return corpus;
+}
+
+static const corpus_shape_t *
+corpus_find_shape(const char *name)
+{
+	for(size_t ix = 0; ix < CORPUS_SHAPE_COUNT; ix++) {
+		if(strcmp(corpus_shapes[ix].name, name) == 0) {
+			return &corpus_shapes[ix];
+		}
+	}
+
+	return NULL;
+}
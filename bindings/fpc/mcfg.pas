@@ -7,6 +7,9 @@ interface
 
 {$packrecords c}
 
+const
+	MCFG_NAME_FILTER_WORDS = 4;
+
 type
 	TMcfgFieldType = (TYPE_INVALID = -1,
 					  TYPE_STRING,
@@ -32,14 +35,24 @@ type
 		_type: TMcfgFieldType;
 		field_count: SizeUInt;
 		fields: PMcfgField;
+
+		dirty: Boolean;
 	end;
 
 	PMcfgList = ^TMcfgList;
 
+	TMcfgNameFilter = record
+		bits: array[0..MCFG_NAME_FILTER_WORDS - 1] of UInt64;
+	end;
+
 	TMcfgSection = record
 		name: PChar;
 		field_count: SizeUInt;
 		fields: PMcfgField;
+
+		field_filter: TMcfgNameFilter;
+
+		dirty: Boolean;
 	end;
 
 	PMcfgSection = ^TMcfgSection;
@@ -48,6 +61,12 @@ type
 		name: PChar;
 		section_count: SizeUInt;
 		sections: PMcfgSection;
+
+		section_filter: TMcfgNameFilter;
+
+		dirty: Boolean;
+
+		id: UInt64;
 	end;
 
 	PMcfgSector = ^TMcfgSector;
@@ -56,8 +75,14 @@ type
 		sector_count:SizeUInt;
 		sectors:PMcfgSector;
 
+		sector_filter: TMcfgNameFilter;
+
 		dynfield_count:SizeUInt;
 		dynfields:PMcfgField;
+
+		path_cache:Pointer;
+
+		serialize_cache:Pointer;
 	end;
 
 	PMcfgFile = ^TMcfgFile;
@@ -113,6 +138,8 @@ type
 		tab_indentation: Boolean;
 
 		space_count: Integer;
+
+		worker_count: Integer;
 	end;
 
 {$packrecords default}
@@ -171,7 +198,7 @@ function mcfg_serialize(_file: TMcfgFile; options: TMcfgSerializeOptions): TMcfg
 
 const
 	MCFG_2_VERSION = '0.5.0 (develop)';
-	MCFG_DEFAULT_SERIALIZE_OPTIONS: TMcfgSerializeOptions = (tab_indentation: true; space_count: 0);
+	MCFG_DEFAULT_SERIALIZE_OPTIONS: TMcfgSerializeOptions = (tab_indentation: true; space_count: 0; worker_count: 1);
 
 implementation
 
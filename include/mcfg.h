@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include <sys/types.h>
 
@@ -101,26 +102,108 @@ typedef struct mcfg_list {
 	mcfg_field_type_t type;
 	size_t field_count;
 	mcfg_field_t *fields;
+
+	/**
+	 * @brief Set by mcfg_add_list_field, the serialize cache serializes the
+	 * sector containing a dirty list again.
+	 * @see mcfg_section_t.dirty
+	 */
+	bool dirty;
 } mcfg_list_t;
 
+#define MCFG_NAME_FILTER_WORDS 4
+
+/**
+ * @brief A small bloom filter over the names of the elements within a
+ * container (the sectors of a file, the sections of a sector or the fields of
+ * a section). It is filled by the mcfg_add_* functions and allows lookups of
+ * names which do not exist to be rejected without scanning the container.
+ * A filter without any bits set is treated as not being built, so containers
+ * which were filled without the mcfg_add_* functions are always scanned.
+ * @note The filter has a fixed size of MCFG_NAME_FILTER_WORDS * 64 bits with
+ * two bits per name, independent of the number of elements. It rejects most
+ * missing names in containers of up to a few dozen elements; with a few
+ * hundred elements nearly every bit is set and lookups fall back to scanning,
+ * so the duplicate checks when building such containers stay quadratic.
+ */
+typedef struct mcfg_name_filter {
+	uint64_t bits[MCFG_NAME_FILTER_WORDS];
+} mcfg_name_filter_t;
+
 typedef struct mcfg_section {
 	char *name;
 	size_t field_count;
 	mcfg_field_t *fields;
+
+	/** @brief Filter over the names of all fields */
+	mcfg_name_filter_t field_filter;
+
+	/**
+	 * @brief Set by mcfg_add_field. Has to be set manually after changing the
+	 * data of a field in place, else
+	 * the serialize cache will keep outputting the old text.
+	 * @see mcfg_enable_serialize_cache
+	 */
+	bool dirty;
 } mcfg_section_t;
 
 typedef struct mcfg_sector {
 	char *name;
 	size_t section_count;
 	mcfg_section_t *sections;
+
+	/** @brief Filter over the names of all sections */
+	mcfg_name_filter_t section_filter;
+
+	/**
+	 * @brief Set by mcfg_add_sector and mcfg_add_section.
+	 * @see mcfg_section_t.dirty
+	 */
+	bool dirty;
+
+	/**
+	 * @brief Unique identifier assigned by mcfg_add_sector, which lets the
+	 * serialize cache notice when a sector was replaced. Sectors with an id
+	 * of 0 are never served from the serialize cache.
+	 */
+	uint64_t id;
 } mcfg_sector_t;
 
+/**
+ * @brief Opaque cache used to speed up repeated path lookups.
+ * @see mcfg_enable_path_cache
+ */
+typedef struct mcfg_path_cache mcfg_path_cache_t;
+
+/**
+ * @brief Opaque cache holding the serialized text of every sector.
+ * @see mcfg_enable_serialize_cache
+ */
+typedef struct mcfg_serialize_cache mcfg_serialize_cache_t;
+
 typedef struct mcfg_file {
 	size_t sector_count;
 	mcfg_sector_t *sectors;
 
+	/** @brief Filter over the names of all sectors */
+	mcfg_name_filter_t sector_filter;
+
 	size_t dynfield_count;
 	mcfg_field_t *dynfields;
+
+	/**
+	 * @brief Optional cache for path lookups, NULL if disabled. Freed by
+	 * mcfg_free_file.
+	 * @see mcfg_enable_path_cache
+	 */
+	mcfg_path_cache_t *path_cache;
+
+	/**
+	 * @brief Optional cache for serialization, NULL if disabled. Freed by
+	 * mcfg_free_file.
+	 * @see mcfg_enable_serialize_cache
+	 */
+	mcfg_serialize_cache_t *serialize_cache;
 } mcfg_file_t;
 
 /**
@@ -199,6 +282,20 @@ mcfg_err_t mcfg_add_list_field(mcfg_list_t *list, size_t size, void *data);
  */
 mcfg_sector_t *mcfg_get_sector(mcfg_file_t *file, char *name);
 
+/**
+ * @brief Get the sector with name from file, where name does not have to be
+ * NULL-terminated.
+ * @param file The file from which the sector is to be grabbed
+ * @param name The name of the sector
+ * @param length The length of name in bytes
+ * @return Pointer to the sector, NULL if no sector with given name could be
+ * found.
+ * @see mcfg_get_sector
+ */
+mcfg_sector_t *mcfg_get_sector_n(mcfg_file_t *file,
+								 const char *name,
+								 size_t length);
+
 /**
  * @brief Get the section with name from sector
  * @param sector The sector from which the section is to be grabbed
@@ -208,6 +305,20 @@ mcfg_sector_t *mcfg_get_sector(mcfg_file_t *file, char *name);
  */
 mcfg_section_t *mcfg_get_section(mcfg_sector_t *sector, char *name);
 
+/**
+ * @brief Get the section with name from sector, where name does not have to be
+ * NULL-terminated.
+ * @param sector The sector from which the section is to be grabbed
+ * @param name The name of the section
+ * @param length The length of name in bytes
+ * @return Pointer to the section, NULL if no section with given name could be
+ * found.
+ * @see mcfg_get_section
+ */
+mcfg_section_t *mcfg_get_section_n(mcfg_sector_t *sector,
+								   const char *name,
+								   size_t length);
+
 /**
  * @brief Get the dynamically generated fiekd with name from file
  * @param file The file from which the field is to be grabbed
@@ -217,6 +328,20 @@ mcfg_section_t *mcfg_get_section(mcfg_sector_t *sector, char *name);
  */
 mcfg_field_t *mcfg_get_dynfield(mcfg_file_t *file, char *name);
 
+/**
+ * @brief Get the dynamically generated field with name from file, where name
+ * does not have to be NULL-terminated.
+ * @param file The file from which the field is to be grabbed
+ * @param name The name of the dynfield.
+ * @param length The length of name in bytes
+ * @return Pointer to the field, NULL if no field with given name could be
+ * found.
+ * @see mcfg_get_dynfield
+ */
+mcfg_field_t *mcfg_get_dynfield_n(mcfg_file_t *file,
+								  const char *name,
+								  size_t length);
+
 /**
  * @brief Get the field with name from section
  * @param section The section from which the field is to be grabbed
@@ -226,6 +351,114 @@ mcfg_field_t *mcfg_get_dynfield(mcfg_file_t *file, char *name);
  */
 mcfg_field_t *mcfg_get_field(mcfg_section_t *section, char *name);
 
+/**
+ * @brief Get the field with name from section, where name does not have to be
+ * NULL-terminated.
+ * @param section The section from which the field is to be grabbed
+ * @param name The name of the field
+ * @param length The length of name in bytes
+ * @return Pointer to the field, NULL if no field with given name could be
+ * found.
+ * @see mcfg_get_field
+ */
+mcfg_field_t *mcfg_get_field_n(mcfg_section_t *section,
+							   const char *name,
+							   size_t length);
+
+/**
+ * @brief Counters about the name lookups done by mcfg_get_sector,
+ * mcfg_get_section, mcfg_get_field and their variants. The counters are only
+ * maintained if the library was compiled with MCFG_LOOKUP_STATS defined,
+ * otherwise they always stay at 0.
+ * @see mcfg_get_lookup_stats
+ */
+typedef struct mcfg_lookup_stats {
+	/** @brief The total number of lookups */
+	uint64_t lookups;
+
+	/** @brief Lookups which were rejected by a name filter without scanning */
+	uint64_t filter_rejects;
+
+	/**
+	 * @brief Lookups which passed a name filter but were not found while
+	 * scanning
+	 */
+	uint64_t false_positives;
+
+	/**
+	 * @brief The share of lookups for non-existent names which were not
+	 * rejected by a name filter: false_positives / (false_positives +
+	 * filter_rejects)
+	 */
+	double false_positive_rate;
+} mcfg_lookup_stats_t;
+
+/**
+ * @brief Get the lookup counters accumulated since the start of the program or
+ * the last call to mcfg_reset_lookup_stats.
+ * @see mcfg_lookup_stats_t
+ */
+mcfg_lookup_stats_t mcfg_get_lookup_stats(void);
+
+/**
+ * @brief Reset all lookup counters to 0.
+ */
+void mcfg_reset_lookup_stats(void);
+
+/**
+ * @brief Phase timings and counters of the parser, the serializer and the
+ * embed formatter, filled by mcfg_parse, mcfg_parse_from_file, the
+ * mcfg_serialize functions and the mcfg_format functions. The counters are only
+ * maintained if the library was compiled with MCFG_STATS defined, otherwise
+ * they always stay at 0 and cost nothing. All values are summed up over all
+ * threads. Timings are in nanoseconds of the monotonic clock, calls between
+ * the public functions only count towards the outermost call.
+ * @see mcfg_get_stats
+ */
+typedef struct mcfg_stats {
+	/** @brief Time spent reading files in mcfg_parse_from_file */
+	uint64_t read_ns;
+
+	/** @brief Time spent lexing the input */
+	uint64_t lex_ns;
+
+	/** @brief Time spent parsing the lexed tokens into a mcfg_file_t */
+	uint64_t parse_ns;
+
+	/** @brief Time spent freeing the lexed tokens */
+	uint64_t free_tree_ns;
+
+	/** @brief Time spent formatting embeds and rendering templates */
+	uint64_t format_ns;
+
+	/** @brief Time spent serializing */
+	uint64_t serialize_ns;
+
+	/** @brief The number of tokens produced by the lexer */
+	uint64_t tokens;
+
+	/** @brief Allocations done by the library, including reallocations */
+	uint64_t allocations;
+
+	/** @brief The bytes requested by all allocations */
+	uint64_t allocated_bytes;
+
+	/** @brief The field count of the largest section parsed */
+	uint64_t largest_section;
+} mcfg_stats_t;
+
+/**
+ * @brief Get the phase timings and counters accumulated since the start of
+ * the program or the last call to mcfg_reset_stats.
+ * @see mcfg_stats_t
+ */
+mcfg_stats_t mcfg_get_stats(void);
+
+/**
+ * @brief Reset all phase timings and counters to 0.
+ */
+void mcfg_reset_stats(void);
+
 /**
  * @brief Free the contents of given list
  * @param list The list of which the contents should be freed
@@ -302,6 +535,30 @@ mcfg_parse_result_t mcfg_parse(char *input);
  */
 mcfg_parse_result_t mcfg_parse_from_file(const char *path);
 
+/**
+ * @brief Opaque concrete syntax tree of a parsed input. It keeps a copy of the
+ * input and the span of every field value within it, so that values can be
+ * changed without touching any other part of the input, including comments,
+ * indentation, line breaks within lists and the quoting of strings.
+ * @see mcfg_parse_cst
+ */
+typedef struct mcfg_cst mcfg_cst_t;
+
+/**
+ * @brief Parses the provided input like mcfg_parse and builds its CST.
+ * @param input The complete input data to be parsed.
+ * @param cst Pointer to write the CST to, it is set to NULL if parsing
+ * failed. If cst is NULL, this is the same as mcfg_parse.
+ * @return mcfg_parse_result_t, mcfg_parse_result_t.err == MCFG_OK on success.
+ * @see mcfg_cst_set_field
+ */
+mcfg_parse_result_t mcfg_parse_cst(char *input, mcfg_cst_t **cst);
+
+/**
+ * @brief Free the given CST.
+ */
+void mcfg_free_cst(mcfg_cst_t *cst);
+
 /* serializer api */
 
 /**
@@ -346,12 +603,24 @@ typedef struct mcfg_serialize_options {
 	 * (Only applies if tab_indentation is false)
 	 */
 	int space_count;
+
+	/**
+	 * @brief How many threads should serialize the file? 0 or 1 serializes
+	 * on the calling thread, at most MCFG_SERIALIZE_MAX_WORKERS are used.
+	 * Sections are measured concurrently, the output is then split into one
+	 * contiguous part per thread which is written directly to its place.
+	 * Only applies to mcfg_serialize and to mcfg_serialize_to_fd with a
+	 * seekable file descriptor.
+	 */
+	int worker_count;
 } mcfg_serialize_options_t;
 
-#define MCFG_DEFAULT_SERIALIZE_OPTIONS             \
-	(mcfg_serialize_options_t)                     \
-	{                                              \
-		.tab_indentation = true, .space_count = 0, \
+#define MCFG_SERIALIZE_MAX_WORKERS 64
+
+#define MCFG_DEFAULT_SERIALIZE_OPTIONS                                 \
+	(mcfg_serialize_options_t)                                         \
+	{                                                                  \
+		.tab_indentation = true, .space_count = 0, .worker_count = 1, \
 	}
 
 /**
@@ -363,4 +632,125 @@ typedef struct mcfg_serialize_options {
 mcfg_serialize_result_t mcfg_serialize(mcfg_file_t file,
 									   mcfg_serialize_options_t options);
 
+/**
+ * @brief Enable the serialize cache of the given file. With the cache
+ * enabled, mcfg_serialize keeps the text of every sector and only serializes
+ * sectors again which are dirty, contain a dirty section or list, or were
+ * replaced by another sector. The text of all other sectors is copied from
+ * the cache. Serializing clears the dirty flags of all sectors, sections and
+ * lists.
+ * @note The cache is only used by mcfg_serialize, which serializes on the
+ * calling thread while it is enabled.
+ * @param file The file for which the cache should be enabled, if the file
+ * already has a cache, it will be replaced.
+ * @return MCFG_OK on success, MCFG_MALLOC_FAIL if the cache could not be
+ * allocated.
+ */
+mcfg_err_t mcfg_enable_serialize_cache(mcfg_file_t *file);
+
+/**
+ * @brief Disable and free the serialize cache of the given file.
+ * @param file The file for which the cache should be disabled
+ */
+void mcfg_disable_serialize_cache(mcfg_file_t *file);
+
+/**
+ * @brief Receives serialized text piece by piece.
+ * @param ctx The context pointer given alongside the writer
+ * @param data The next piece of text, not NULL-terminated
+ * @param length The length of data
+ * @return MCFG_OK to continue, any other value aborts the serialization and
+ * is returned by it.
+ */
+typedef mcfg_err_t (*mcfg_serialize_writer_t)(void *ctx,
+											  const char *data,
+											  size_t length);
+
+/**
+ * @brief Serialize the given file, passing the text to a writer instead of
+ * building it in memory. Text is collected in a fixed-size buffer, so the
+ * memory used does not depend on the size of the output. If an error occurs,
+ * the text written up to that point is not taken back.
+ * @param writer The writer to pass the text to
+ * @param ctx Context pointer passed to writer
+ * @param file The file to serialize.
+ * @param options The serialization options.
+ * @return MCFG_OK on success, otherwise the error of the serializer or the
+ * writer.
+ */
+mcfg_err_t mcfg_serialize_to(mcfg_serialize_writer_t writer,
+							 void *ctx,
+							 mcfg_file_t file,
+							 mcfg_serialize_options_t options);
+
+/**
+ * @brief Serialize the given file to a file descriptor. Text is written in
+ * batches using writev, large strings are written without copying them.
+ * @see mcfg_serialize_to
+ */
+mcfg_err_t mcfg_serialize_to_fd(int fd,
+								mcfg_file_t file,
+								mcfg_serialize_options_t options);
+
+/**
+ * @brief Serialize the given file to a stdio stream.
+ * @see mcfg_serialize_to
+ */
+mcfg_err_t mcfg_serialize_to_stream(FILE *stream,
+									mcfg_file_t file,
+									mcfg_serialize_options_t options);
+
+/**
+ * @brief Replace the data of a field and the text of its value in the CST.
+ * The old data is freed and the section of the field is marked dirty.
+ * @param cst The CST the file was parsed with
+ * @param file The file parsed alongside cst
+ * @param field The field to change, has to be a field of file which was
+ * parsed from the input. The type of the field (and of its list elements)
+ * stays the same.
+ * @param data The new data, ownership is transferred to the field on success
+ * @param size The size of data in bytes
+ * @return MCFG_OK on success, MCFG_STRUCTURE_ERROR if the field was not
+ * parsed from the input of cst, MCFG_INVALID_TYPE if the element type of a
+ * list would change.
+ */
+mcfg_err_t mcfg_cst_set_field(mcfg_cst_t *cst,
+							  mcfg_file_t *file,
+							  mcfg_field_t *field,
+							  void *data,
+							  size_t size);
+
+/**
+ * @brief Output the input of a CST with all changes made through
+ * mcfg_cst_set_field. All bytes outside of the changed values are the same
+ * as in the input. Fields, sections and sectors which were added to the file
+ * after parsing are not part of the output, use mcfg_serialize for those.
+ * @return mcfg_serialize_result_t
+ */
+mcfg_serialize_result_t mcfg_cst_serialize(const mcfg_cst_t *cst);
+
+/**
+ * @brief Flag for mcfg_serialize_to_file: compare the output to the existing
+ * file first and leave the file untouched if they are the same, which keeps
+ * its modification time.
+ */
+#define MCFG_SERIALIZE_SKIP_UNCHANGED (1 << 0)
+
+/**
+ * @brief Serialize the given file to the file at path. The text is written
+ * to a temporary file next to it, which is synced to disk and then renamed
+ * to path, so path always holds either the old or the complete new text.
+ * An existing file keeps its permissions.
+ * @param path The path of the file to write
+ * @param file The file to serialize.
+ * @param options The serialization options.
+ * @param flags 0 or MCFG_SERIALIZE_SKIP_UNCHANGED
+ * @return MCFG_OK on success, otherwise the error of the serializer or an
+ * OS error.
+ */
+mcfg_err_t mcfg_serialize_to_file(const char *path,
+								  mcfg_file_t file,
+								  mcfg_serialize_options_t options,
+								  int flags);
+
 #endif	// ifndef MCFG_H
@@ -24,6 +24,9 @@ typedef enum mcfg_fmt_err {
 							 (re|m)alloc_or_die functions */
 	MCFG_FMT_INVALID_TYPE = MCFG_INVALID_TYPE,
 	MCFG_FMT_NOT_FOUND,
+
+	/** @brief a field embeds itself, either directly or through other fields */
+	MCFG_FMT_EMBED_CYCLE,
 } mcfg_fmt_err_t;
 
 /**
@@ -61,4 +64,518 @@ mcfg_fmt_res_t mcfg_format_field_embeds_str(char *input,
 											mcfg_file_t file,
 											mcfg_path_t relativity);
 
+/**
+ * @brief Format the embeds in a string into a caller-provided buffer. If the
+ * buffer is too small, the output is truncated. As long as cap is greater
+ * than 0, the buffer will always be NULL-terminated.
+ * If every embed resolves to a scalar or to a string without embeds or
+ * escapes, the heap is not touched.
+ * @param buf The buffer to write to, can be NULL if cap is 0
+ * @param cap The size of buf in bytes
+ * @param length Is set to the length of the full output, not including the
+ * NULL terminator. A buffer of length + 1 bytes fits the whole output.
+ * @param input The string in which the embeds should be formatted
+ * @param file The file from which to take the data for formatting
+ * @param relativity A path which should be used to complete relative paths.
+ * @return MCFG_FMT_OK on success.
+ */
+mcfg_fmt_err_t mcfg_format_field_embeds_into(char *buf,
+											 size_t cap,
+											 size_t *length,
+											 char *input,
+											 mcfg_file_t file,
+											 mcfg_path_t relativity);
+
+/**
+ * @brief Dynfield bindings local to a formatting call. Dynfield embeds are
+ * looked up in the scope before the dynfields of the file, which allows
+ * formatting against a shared file with different bindings, also from
+ * multiple threads at once.
+ * Zero-initialize a scope before binding to it. Names and data of bindings
+ * are borrowed, not copied.
+ */
+typedef struct mcfg_dyn_scope {
+	size_t count;
+	size_t capacity;
+	mcfg_field_t *bindings;
+} mcfg_dyn_scope_t;
+
+/**
+ * @brief Bind a dynfield in a scope, replacing an existing binding of the
+ * same name.
+ * @param scope The scope to bind in
+ * @param type The datatype of the binding
+ * @param name The name of the binding, has to outlive the binding
+ * @param data The data of the binding, has to outlive the binding
+ * @param size The size of data
+ * @return MCFG_FMT_OK on success, MCFG_FMT_MALLOC_FAIL if the scope could not
+ * grow.
+ */
+mcfg_fmt_err_t mcfg_dyn_scope_bind(mcfg_dyn_scope_t *scope,
+								   mcfg_field_type_t type,
+								   char *name,
+								   void *data,
+								   size_t size);
+
+/**
+ * @brief Get a binding of a scope by name.
+ * @param length The length of name, which does not need to be
+ * NULL-terminated.
+ * @return Pointer to the binding, NULL if there is none or scope is NULL.
+ */
+mcfg_field_t *mcfg_dyn_scope_get(const mcfg_dyn_scope_t *scope,
+								 const char *name,
+								 size_t length);
+
+/**
+ * @brief Free the bindings array of a scope, leaving it empty.
+ */
+void mcfg_dyn_scope_free(mcfg_dyn_scope_t *scope);
+
+/**
+ * @brief Format the embeds in a string with a dynfield scope. The file is
+ * only read, its path cache is not used, so multiple threads can format
+ * against the same file as long as it is not modified.
+ * @param scope The bindings to consult before the dynfields of the file,
+ * may be NULL
+ * @see mcfg_format_field_embeds_str
+ */
+mcfg_fmt_res_t mcfg_format_field_embeds_scoped(char *input,
+											   mcfg_file_t file,
+											   mcfg_path_t relativity,
+											   const mcfg_dyn_scope_t *scope);
+
+/**
+ * @brief Receives formatted output piece by piece.
+ * @param ctx The context pointer given alongside the sink
+ * @param data The next piece of output, not NULL-terminated
+ * @param length The length of data
+ * @return MCFG_FMT_OK to continue, any other value aborts formatting and is
+ * returned by the formatting function.
+ */
+typedef mcfg_fmt_err_t (*mcfg_fmt_sink_t)(void *ctx,
+										  const char *data,
+										  size_t length);
+
+/**
+ * @brief Sink writing to a stdio stream.
+ * @param ctx The FILE * to write to
+ */
+mcfg_fmt_err_t mcfg_fmt_sink_file(void *ctx, const char *data, size_t length);
+
+/**
+ * @brief Sink writing to a file descriptor.
+ * @param ctx Pointer to the int file descriptor to write to
+ */
+mcfg_fmt_err_t mcfg_fmt_sink_fd(void *ctx, const char *data, size_t length);
+
+/**
+ * @brief Sink appending to a mcfg_string_t.
+ * @param ctx Pointer to the mcfg_string_t * to append to, which can get
+ * reallocated.
+ */
+mcfg_fmt_err_t mcfg_fmt_sink_string(void *ctx,
+									const char *data,
+									size_t length);
+
+/**
+ * @brief Format the embeds in a string, passing the output to a sink instead
+ * of building it in memory. Literal text is passed straight from the input
+ * and fields straight from the file, without intermediate copies.
+ * @param sink The sink which receives the output
+ * @param sink_ctx Context pointer passed to sink
+ * @param input The string in which the embeds should be formatted
+ * @param file The file from which to take the data for formatting
+ * @param relativity A path which should be used to complete relative paths.
+ * @return MCFG_FMT_OK on success, otherwise the error of the formatter or
+ * the sink.
+ */
+mcfg_fmt_err_t mcfg_format_field_embeds_to(mcfg_fmt_sink_t sink,
+										   void *sink_ctx,
+										   char *input,
+										   mcfg_file_t file,
+										   mcfg_path_t relativity);
+
+typedef enum mcfg_template_segment_type {
+	/** @brief Text which is copied into the output as-is */
+	MCFG_TEMPLATE_SEGMENT_LITERAL,
+
+	/**
+	 * @brief A number or boolean field, converted to text when rendering. If
+	 * the field could not be found, it is NULL and rendered as "(nullptr)".
+	 */
+	MCFG_TEMPLATE_SEGMENT_FIELD,
+
+	/** @brief A dynfield, which is looked up by its name when rendering */
+	MCFG_TEMPLATE_SEGMENT_DYNFIELD,
+
+	/** @brief A string or list field, which was compiled into a template */
+	MCFG_TEMPLATE_SEGMENT_TEMPLATE,
+} mcfg_template_segment_type_t;
+
+typedef struct mcfg_template_segment {
+	mcfg_template_segment_type_t type;
+
+	/** @brief Position in the templates source at which the segment starts */
+	size_t source_pos;
+
+	union {
+		struct {
+			const char *data;
+			size_t length;
+		} literal;
+
+		mcfg_field_t *field;
+
+		struct {
+			char *name;
+			size_t length;
+		} dynfield;
+
+		struct mcfg_template *nested;
+	};
+} mcfg_template_segment_t;
+
+/**
+ * @brief A string with all of its embeds already extracted and resolved.
+ * Templates are meant for strings which are formatted over and over again,
+ * rendering them only has to concatenate the segments.
+ * Fields are resolved when the template is compiled, so a template has to be
+ * recompiled after fields have been added to or removed from the file it was
+ * compiled against. Dynfields are looked up every time the template is
+ * rendered, so their values can change between renders.
+ * @see mcfg_template_compile
+ * @see mcfg_template_render
+ */
+typedef struct mcfg_template {
+	/** @brief The file the template was compiled against */
+	mcfg_file_t *file;
+
+	/** @brief The relativity path used to complete relative paths */
+	mcfg_path_t relativity;
+
+	/**
+	 * @brief true if relativity is owned by this template. Templates which
+	 * are part of another template share the relativity of their root.
+	 */
+	bool owns_relativity;
+
+	/** @brief The string the template was compiled from */
+	char *source;
+
+	/** @brief true if source is a copy owned by this template */
+	bool owns_source;
+
+	size_t segment_count;
+	mcfg_template_segment_t *segments;
+
+	/**
+	 * @brief The nested templates of a root template. A string field which is
+	 * embedded in multiple places is only compiled once, so nested templates
+	 * can be shared between segments and are owned by the root instead.
+	 */
+	size_t owned_count;
+	struct mcfg_template **owned;
+} mcfg_template_t;
+
+typedef struct mcfg_template_res {
+	mcfg_fmt_err_t err;
+
+	mcfg_template_t *value;
+} mcfg_template_res_t;
+
+/**
+ * @brief Compile the embeds in a string into a template, which can then be
+ * rendered any number of times.
+ * @param input The string in which the embeds should be formatted
+ * @param file The file from which to take the data for formatting, has to
+ * outlive the template.
+ * @param relativity A path which should be used to complete relative paths.
+ * The template keeps its own copy of it.
+ * @return The heap allocated template, which has to be freed using
+ * mcfg_template_free.
+ */
+mcfg_template_res_t mcfg_template_compile(const char *input,
+										  mcfg_file_t *file,
+										  mcfg_path_t relativity);
+
+/**
+ * @brief Render a template into a new heap allocated string. The output is
+ * measured before it is written, so only a single allocation is made.
+ * @param tmpl The template to render
+ * @return A new heap allocated string containing the formatted input string.
+ */
+mcfg_fmt_res_t mcfg_template_render(const mcfg_template_t *tmpl);
+
+/**
+ * @brief Render a template with a dynfield scope. Like
+ * mcfg_format_field_embeds_scoped, this does not modify the file or the
+ * template, so one template can be rendered by multiple threads at once.
+ * @param scope The bindings to consult before the dynfields of the file,
+ * may be NULL
+ * @see mcfg_template_render
+ */
+mcfg_fmt_res_t mcfg_template_render_scoped(const mcfg_template_t *tmpl,
+										   const mcfg_dyn_scope_t *scope);
+
+/**
+ * @brief Render a template into a caller-provided buffer without allocating.
+ * If the buffer is too small, the output is truncated. As long as cap is
+ * greater than 0, the buffer will always be NULL-terminated.
+ * @param tmpl The template to render
+ * @param buf The buffer to write to, can be NULL if cap is 0
+ * @param cap The size of buf in bytes
+ * @param length Is set to the length of the full output, not including the
+ * NULL terminator.
+ */
+mcfg_fmt_err_t mcfg_template_render_to_buffer(const mcfg_template_t *tmpl,
+											  char *buf,
+											  size_t cap,
+											  size_t *length);
+
+/**
+ * @brief Render a template, passing the output to a sink.
+ * @param tmpl The template to render
+ * @param sink The sink which receives the output
+ * @param sink_ctx Context pointer passed to sink
+ * @return MCFG_FMT_OK on success, otherwise the error of the renderer or the
+ * sink.
+ */
+mcfg_fmt_err_t mcfg_template_render_to(const mcfg_template_t *tmpl,
+									   mcfg_fmt_sink_t sink,
+									   void *sink_ctx);
+
+/**
+ * @brief Free a template and everything it owns.
+ */
+void mcfg_template_free(mcfg_template_t *tmpl);
+
+typedef struct mcfg_formatted_field {
+	/** @brief The field which was formatted */
+	mcfg_field_t *field;
+
+	/** @brief The error which occured while formatting the field */
+	mcfg_fmt_err_t err;
+
+	/** @brief Heap allocated formatted data, NULL if formatting failed */
+	char *formatted;
+} mcfg_formatted_field_t;
+
+typedef struct mcfg_file_fmt_res {
+	/**
+	 * @brief The error of the first field (in file order) which could not be
+	 * formatted, MCFG_FMT_OK if all fields were formatted.
+	 */
+	mcfg_fmt_err_t err;
+
+	size_t field_count;
+	mcfg_formatted_field_t *fields;
+} mcfg_file_fmt_res_t;
+
+/**
+ * @brief Format the embeds of every string field in a file. Each field is
+ * formatted relative to the section it is in. The file is not modified.
+ * Sections are formatted concurrently; within a section, a field embedded
+ * in multiple places is only compiled once.
+ * @param file The file to format. Dynfields may not be added or changed
+ * while this function runs.
+ * @param nthreads The amount of threads to use, 0 to use one thread per
+ * online processor.
+ * @return The formatted data of every string field, in the order in which
+ * the fields appear in the file. Has to be freed using
+ * mcfg_free_file_fmt_res, even if an error occured.
+ */
+mcfg_file_fmt_res_t mcfg_format_file(mcfg_file_t *file, size_t nthreads);
+
+/**
+ * @brief Free the result of mcfg_format_file.
+ */
+void mcfg_free_file_fmt_res(mcfg_file_fmt_res_t res);
+
+typedef struct mcfg_fmt_foreach_res {
+	mcfg_fmt_err_t err;
+
+	/** @brief The amount of outputs, one per list element */
+	size_t count;
+
+	/**
+	 * @brief Heap allocated arena holding all outputs back to back, each
+	 * one NULL-terminated.
+	 */
+	char *arena;
+
+	/**
+	 * @brief Heap allocated table of count + 1 offsets into arena. Output ix
+	 * starts at offsets[ix] and is offsets[ix + 1] - offsets[ix] - 1 bytes
+	 * long.
+	 */
+	size_t *offsets;
+} mcfg_fmt_foreach_res_t;
+
+/**
+ * @brief Get output ix of a mcfg_fmt_foreach_res_t as NULL-terminated string.
+ */
+#define MCFG_FOREACH_STRING(res, ix) ((res).arena + (res).offsets[(ix)])
+
+/**
+ * @brief Format a string once for every element of a list, with the element
+ * bound to the dynfield binding_name. The string is compiled only once, so
+ * embeds are extracted and constant paths are resolved only once for all
+ * elements.
+ * @param input The string to format
+ * @param file The file from which to take the data for formatting
+ * @param relativity A path which should be used to complete relative paths.
+ * @param list The list to format the string for
+ * @param binding_name The name of the dynfield the elements are bound to,
+ * for example "element" for $(%element%).
+ * @return The outputs in list order. Has to be freed using
+ * mcfg_free_fmt_foreach_res, even if an error occured.
+ */
+mcfg_fmt_foreach_res_t mcfg_format_foreach(char *input,
+										   mcfg_file_t file,
+										   mcfg_path_t relativity,
+										   const mcfg_list_t *list,
+										   char *binding_name);
+
+/**
+ * @brief Free the result of mcfg_format_foreach.
+ */
+void mcfg_free_fmt_foreach_res(mcfg_fmt_foreach_res_t res);
+
+/**
+ * @brief A field in the dependency index of a file.
+ */
+typedef struct mcfg_fmt_dep_node {
+	mcfg_field_t *field;
+
+	/**
+	 * @brief The path relative to which the fields embeds are resolved. The
+	 * elements are borrowed from the file, sector and section are NULL for
+	 * dynfields.
+	 */
+	mcfg_path_t relativity;
+
+	/**
+	 * @brief Indices of the nodes this field embeds, directly or through
+	 * other fields
+	 */
+	size_t embed_count;
+	size_t *embeds;
+
+	/** @brief Indices of the nodes which embed this field */
+	size_t dependent_count;
+	size_t dependent_capacity;
+	size_t *dependents;
+} mcfg_fmt_dep_node_t;
+
+/**
+ * @brief Index of which fields embed which other fields. Contains a node for
+ * every field and dynfield of a file, sorted by the address of the field.
+ * Embeds of string fields and of the elements of string lists are indexed,
+ * both absolute and section-relative ones. Every field has an edge to every
+ * field its formatted value reads, including the fields reached through
+ * nested embeds, which are resolved relative to the section of the outermost
+ * field like the formatter does.
+ * Dynfields can be embedded, but have no edges of their own since they are
+ * resolved relative to whatever embeds them.
+ */
+typedef struct mcfg_fmt_deps {
+	mcfg_file_t *file;
+
+	size_t node_count;
+	mcfg_fmt_dep_node_t *nodes;
+} mcfg_fmt_deps_t;
+
+/**
+ * @brief Build the dependency index of a file. The index holds pointers into
+ * the file and has to be rebuilt after sectors, sections, fields or
+ * dynfields were added or removed.
+ * @param deps The index to initialize
+ * @param file The file to index
+ * @return MCFG_FMT_OK on success. On failure deps is left empty.
+ */
+mcfg_fmt_err_t mcfg_fmt_deps_build(mcfg_fmt_deps_t *deps, mcfg_file_t *file);
+
+/**
+ * @brief Re-index the embeds of a field after its data was changed. The
+ * fields depending on it are re-indexed as well.
+ * @return MCFG_FMT_NOT_FOUND if the field is not part of the index.
+ */
+mcfg_fmt_err_t mcfg_fmt_deps_update(mcfg_fmt_deps_t *deps,
+									const mcfg_field_t *field);
+
+/**
+ * @brief Free a dependency index.
+ */
+void mcfg_fmt_deps_free(mcfg_fmt_deps_t *deps);
+
+typedef struct mcfg_fmt_dependents {
+	mcfg_fmt_err_t err;
+
+	/** @brief Heap allocated array of the dependents, free using free() */
+	size_t count;
+	mcfg_field_t **fields;
+} mcfg_fmt_dependents_t;
+
+/**
+ * @brief Get every field whose formatted value depends on the given field,
+ * directly or through other fields.
+ * @param deps The dependency index of the file the field is in
+ * @param field The field to get the dependents of
+ * @return The dependents, not including field itself.
+ * err is MCFG_FMT_NOT_FOUND if field is not part of the index.
+ */
+mcfg_fmt_dependents_t mcfg_format_dependents(const mcfg_fmt_deps_t *deps,
+											 const mcfg_field_t *field);
+
+typedef struct mcfg_fmt_cache_entry {
+	bool valid;
+	mcfg_fmt_err_t err;
+	char *formatted;
+} mcfg_fmt_cache_entry_t;
+
+/**
+ * @brief Caches the formatted value of fields. When a field changes, only
+ * the entries of the field and its transitive dependents are dropped.
+ * A cache is not thread-safe.
+ */
+typedef struct mcfg_fmt_cache {
+	mcfg_fmt_deps_t deps;
+
+	/** @brief One entry per node of deps */
+	mcfg_fmt_cache_entry_t *entries;
+} mcfg_fmt_cache_t;
+
+/**
+ * @brief Initialize an empty formatting cache for a file. Like the
+ * dependency index, it has to be rebuilt after the structure of the file
+ * changed.
+ */
+mcfg_fmt_err_t mcfg_fmt_cache_init(mcfg_fmt_cache_t *cache, mcfg_file_t *file);
+
+/**
+ * @brief Get the formatted value of a string field, formatting it if it is
+ * not cached. Each field is formatted relative to the section it is in.
+ * @param formatted Set to the formatted value, which is owned by the cache
+ * and valid until the field or one of its dependencies is invalidated.
+ * @return MCFG_FMT_OK on success, otherwise the (cached) formatting error.
+ */
+mcfg_fmt_err_t mcfg_fmt_cache_get(mcfg_fmt_cache_t *cache,
+								  const mcfg_field_t *field,
+								  const char **formatted);
+
+/**
+ * @brief Notify the cache that the data of a field changed. Re-indexes the
+ * embeds of the field and drops the cached values of the field and all its
+ * transitive dependents.
+ * @return MCFG_FMT_NOT_FOUND if the field is not part of the cache.
+ */
+mcfg_fmt_err_t mcfg_fmt_cache_invalidate(mcfg_fmt_cache_t *cache,
+										 const mcfg_field_t *field);
+
+/**
+ * @brief Free a formatting cache.
+ */
+void mcfg_fmt_cache_free(mcfg_fmt_cache_t *cache);
+
 #endif	// ifndef MCFG_FORMAT_H
@@ -8,6 +8,8 @@
 #ifndef MCFG_UTIL_H
 #define MCFG_UTIL_H
 
+#include <sys/types.h>
+
 #include "mcfg.h"
 
 #define MCFG_EMBED_FORMAT_RESIZE_AMOUNT 16
@@ -27,6 +29,42 @@ typedef struct mcfg_path {
 	char *field;
 } mcfg_path_t;
 
+/**
+ * @brief Describes the location of a single path element within a path string.
+ */
+typedef struct mcfg_path_slice {
+	/** @brief Offset of the first character of the element */
+	size_t offset;
+
+	/** @brief Length of the element, 0 if the element is not set */
+	size_t length;
+} mcfg_path_slice_t;
+
+/**
+ * @brief Non-owning alternative to mcfg_path_t. Instead of copying each path
+ * element onto the heap, a path view only records where the elements reside
+ * in the string it was parsed from. The string has to outlive the view.
+ * @see mcfg_parse_path_view
+ */
+typedef struct mcfg_path_view {
+	/** @brief The string which the slices point into */
+	const char *source;
+
+	bool absolute;
+	bool dynfield_path;
+
+	mcfg_path_slice_t sector;
+	mcfg_path_slice_t section;
+	mcfg_path_slice_t field;
+} mcfg_path_view_t;
+
+/**
+ * @brief Get a pointer to the first character of an element of a path view.
+ * @param v The path view
+ * @param e The element (sector, section or field)
+ */
+#define MCFG_PATH_VIEW_ELEM(v, e) ((v).source + (v).e.offset)
+
 /**
  * @brief Convert a string path into a mcfg_path struct
  * @param path The path which should be converted
@@ -36,6 +74,26 @@ typedef struct mcfg_path {
  */
 mcfg_path_t mcfg_parse_path(char *path);
 
+/**
+ * @brief Parse a string path into a mcfg_path_view struct without allocating
+ * any memory.
+ * @param path The path which should be parsed
+ * @return The path view, all elements will have a length of 0 if the path is
+ * empty or NULL.
+ * @see mcfg_parse_path
+ */
+mcfg_path_view_t mcfg_parse_path_view(const char *path);
+
+/**
+ * @brief Parse the first length characters of a string path into a
+ * mcfg_path_view struct without allocating any memory.
+ * @param path The path which should be parsed, does not need to be
+ * NULL-terminated
+ * @param length The length of the path in bytes
+ * @see mcfg_parse_path_view
+ */
+mcfg_path_view_t mcfg_parse_path_view_n(const char *path, size_t length);
+
 /**
  * @brief Frees the heap allocated data inside of a path structure
  * @param path The path to free
@@ -60,8 +118,86 @@ char *mcfg_path_to_str(mcfg_path_t path);
  */
 mcfg_field_t *mcfg_get_field_by_path(mcfg_file_t *file, mcfg_path_t path);
 
+/**
+ * @brief Gets multiple fields by their paths at once. The paths are grouped by
+ * their sector and section, so that every sector and section is only looked
+ * up once, no matter how many of the requested fields lie in it.
+ * @param file The file in which the fields lie
+ * @param paths The paths to the fields which should be grabbed. These paths
+ * have to be absolute!
+ * @param count The number of paths
+ * @param out Array of at least count elements. out[i] will be set to the field
+ * pointed to by paths[i], or NULL if the field was not found.
+ * @param missing Optional array of at least count elements. missing[i] will
+ * be set to true if the field pointed to by paths[i] was not found. Can be
+ * NULL.
+ * @return The number of paths for which no field was found.
+ * @see mcfg_get_field_by_path
+ */
+size_t mcfg_get_fields_by_paths(mcfg_file_t *file,
+								mcfg_path_t *paths,
+								size_t count,
+								mcfg_field_t **out,
+								bool *missing);
+
+/**
+ * @brief Gets a field by a path view
+ * @param file The file in which the field lies
+ * @param path The view of the path to the field which should be grabbed. This
+ * path has to be absolute!
+ * @return Pointer to the field pointed to by path. If the field was not found
+ * NULL will be returned.
+ * @see mcfg_get_field_by_path
+ */
+mcfg_field_t *mcfg_get_field_by_path_view(mcfg_file_t *file,
+										  mcfg_path_view_t path);
+
+/**
+ * @brief Gets a field by its string path, without allocating any memory.
+ * @param file The file in which the field lies
+ * @param path The path to the field which should be grabbed. This path has to
+ * be absolute!
+ * @return Pointer to the field pointed to by path. If the field was not found
+ * NULL will be returned.
+ * @see mcfg_get_field_by_path
+ */
+mcfg_field_t *mcfg_get_field_by_path_str(mcfg_file_t *file, const char *path);
+
+#define MCFG_PATH_CACHE_DEFAULT_SLOTS 256
+
+/**
+ * @brief Enable the path lookup cache for the given file. Once enabled,
+ * mcfg_get_field_by_path, mcfg_get_field_by_path_view,
+ * mcfg_get_field_by_path_str and the embed formatting functions remember which
+ * field an absolute path resolved to. The cache stores the positions of the
+ * elements rather than pointers to them, so it stays valid when sectors,
+ * sections or fields are added. Elements must not be removed or reordered by
+ * hand while the cache is enabled.
+ * @note Lookups on a file with the path cache enabled are not thread-safe.
+ * @param file The file for which the cache should be enabled, if the file
+ * already has a cache, it will be replaced.
+ * @param slot_count The number of paths the cache can hold, rounded up to the
+ * next power of two. MCFG_PATH_CACHE_DEFAULT_SLOTS is a sensible default.
+ * @return MCFG_OK on success, MCFG_MALLOC_FAIL if the cache could not be
+ * allocated.
+ */
+mcfg_err_t mcfg_enable_path_cache(mcfg_file_t *file, size_t slot_count);
+
+/**
+ * @brief Disable and free the path lookup cache of the given file.
+ * @param file The file for which the cache should be disabled
+ */
+void mcfg_disable_path_cache(mcfg_file_t *file);
+
 /* coversion utilities */
 
+/**
+ * @brief Size of a buffer which can hold the string representation of any
+ * number or boolean field, including the NULL terminator.
+ * @see mcfg_data_to_buffer
+ */
+#define MCFG_NUMBER_BUFFER_SIZE 21
+
 /**
  * @brief Converts the data of the given field to a string representation
  * @param field The field of which the data should be converted
@@ -69,6 +205,21 @@ mcfg_field_t *mcfg_get_field_by_path(mcfg_file_t *file, mcfg_path_t path);
  */
 char *mcfg_data_to_string(mcfg_field_t field);
 
+/**
+ * @brief Writes the string representation of the given fields data into a
+ * caller-provided buffer, without allocating any memory. If the buffer is too
+ * small, the representation is truncated. As long as cap is greater than 0,
+ * the buffer will always be NULL-terminated.
+ * @param field The field of which the data should be converted
+ * @param buf The buffer to write to, can be NULL if cap is 0
+ * @param cap The size of buf in bytes
+ * @return The length of the full string representation, not including the
+ * NULL terminator. If this is greater than or equal to cap, the written
+ * representation was truncated.
+ * @see MCFG_NUMBER_BUFFER_SIZE
+ */
+size_t mcfg_data_to_buffer(mcfg_field_t field, char *buf, size_t cap);
+
 /**
  * @brief Formats a list field using the provided pre- and postfix
  * @param list The list struct of which the contents should be formatted
@@ -76,6 +227,23 @@ char *mcfg_data_to_string(mcfg_field_t field);
  */
 char *mcfg_format_list(mcfg_list_t list, char *prefix, char *postfix);
 
+/**
+ * @brief Formats a list field using the provided pre- and postfix into a
+ * caller-provided buffer. Truncation and the return value work the same way
+ * as with mcfg_data_to_buffer.
+ * @param list The list struct of which the contents should be formatted
+ * @param buf The buffer to write to, can be NULL if cap is 0
+ * @param cap The size of buf in bytes
+ * @return The length of the full formatted list, not including the NULL
+ * terminator.
+ * @see mcfg_format_list
+ */
+size_t mcfg_format_list_to_buffer(mcfg_list_t list,
+								  const char *prefix,
+								  const char *postfix,
+								  char *buf,
+								  size_t cap);
+
 /**
  * @brief Converts a list to its string representation
  * @param list The list of which the data should be converted
@@ -83,6 +251,19 @@ char *mcfg_format_list(mcfg_list_t list, char *prefix, char *postfix);
  */
 char *mcfg_list_as_string(mcfg_list_t list);
 
+/**
+ * @brief Converts a list to its string representation inside of a
+ * caller-provided buffer. Truncation and the return value work the same way
+ * as with mcfg_data_to_buffer.
+ * @param list The list of which the data should be converted
+ * @param buf The buffer to write to, can be NULL if cap is 0
+ * @param cap The size of buf in bytes
+ * @return The length of the full string representation, not including the
+ * NULL terminator.
+ * @see mcfg_list_as_string
+ */
+size_t mcfg_list_to_buffer(mcfg_list_t list, char *buf, size_t cap);
+
 /**
  * @brief Get the data of the field as a string.
  * @param field The field of which the data should be grabbed
@@ -165,6 +346,28 @@ uint32_t mcfg_data_as_u32(mcfg_field_t field);
  */
 int32_t mcfg_data_as_i32(mcfg_field_t field);
 
+/**
+ * @brief Copy the elements of a numeric list into a caller-provided array,
+ * sign- or zero-extending every element to 64 bits.
+ * @param list The list to copy from, has to be of an integer type
+ * @param out The array to copy to
+ * @param n The amount of elements out can hold
+ * @return The amount of elements copied (the smaller one of n and the lists
+ * field count), -1 if the list is not of an integer type.
+ */
+ssize_t mcfg_list_copy_as_i64(mcfg_list_t list, int64_t *out, size_t n);
+
+/**
+ * @brief Copy the elements of an unsigned list into a caller-provided array,
+ * zero-extending every element to 32 bits.
+ * @param list The list to copy from, has to be of type u8, u16 or u32
+ * @param out The array to copy to
+ * @param n The amount of elements out can hold
+ * @return The amount of elements copied (the smaller one of n and the lists
+ * field count), -1 if the list is not of an unsigned integer type.
+ */
+ssize_t mcfg_list_copy_as_u32(mcfg_list_t list, uint32_t *out, size_t n);
+
 /* mcfg_string_t utilities */
 
 #ifdef MCFG_DEFINE_MCFG_STRING
@@ -176,6 +379,9 @@ int32_t mcfg_data_as_i32(mcfg_field_t field);
 /**
  * @brief Create a new mcfg_string_t on the heap with a specific
  * preallocated length for the data.
+ * @param size The amount of characters the string can hold without being
+ * reallocated, not including the NULL terminator. The capacity of the string
+ * will be size + 1.
  */
 mcfg_string_t *mcfg_string_new_sized(size_t size);
 
@@ -187,8 +393,8 @@ mcfg_string_t *mcfg_string_new(const char *initial);
 
 /**
  * @brief Append one mcfg_string_t (b) to another (a).
- * A will get resized if b does not find behind a. The new size will be
- * aligned to MCFG_STRING_RESIZE_ALIGNMENT.
+ * A will get resized if b does not fit behind a. The capacity is at least
+ * doubled and aligned to MCFG_STRING_RESIZE_ALIGNMENT.
  * @param a Pointer to the destination string. Could get reallocated.
  * @param b The source string.
  * @see mcfg_string_append_cstr
@@ -197,12 +403,50 @@ mcfg_err_t mcfg_string_append(mcfg_string_t **a, mcfg_string_t *b);
 
 /**
  * @brief Append a typical C-String (b) to a mcfg_string (a).
- * A will get resized if b does not find behind a. The new size will be
- * aligned to MCFG_STRING_RESIZE_ALIGNMENT.
+ * A will get resized if b does not fit behind a. The capacity is at least
+ * doubled and aligned to MCFG_STRING_RESIZE_ALIGNMENT.
  * @param a Pointer to the destination string. Could get reallocated.
  * @param b The C-String to be append to a.
  * @see mcfg_string_append
  */
 mcfg_err_t mcfg_string_append_cstr(mcfg_string_t **a, const char *b);
 
+/**
+ * @brief Append length bytes of b to a mcfg_string (a). b does not need to be
+ * NULL-terminated.
+ * A will get resized if b does not fit behind a. The capacity is at least
+ * doubled and aligned to MCFG_STRING_RESIZE_ALIGNMENT.
+ * @param a Pointer to the destination string. Could get reallocated.
+ * @param b The characters to append to a.
+ * @param length The amount of characters from b to append.
+ * @see mcfg_string_append_cstr
+ */
+mcfg_err_t mcfg_string_append_n(mcfg_string_t **a,
+								const char *b,
+								size_t length);
+
+/**
+ * @brief Append printf-style formatted text to a mcfg_string (a).
+ * A will get resized if the text does not fit behind a.
+ * @param a Pointer to the destination string. Could get reallocated.
+ * @param fmt The printf format string.
+ * @return MCFG_OK on success, MCFG_OS_ERROR_MASK combined with errno if the
+ * formatting failed.
+ */
+mcfg_err_t mcfg_string_append_fmt(mcfg_string_t **a, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Ensure that a can hold at least length characters (not including the
+ * NULL terminator) without further reallocations.
+ * @param a Pointer to the string. Could get reallocated.
+ * @param length The amount of characters a should be able to hold.
+ */
+mcfg_err_t mcfg_string_reserve(mcfg_string_t **a, size_t length);
+
+/**
+ * @brief Empties a, keeping its capacity so that it can be reused.
+ */
+void mcfg_string_clear(mcfg_string_t *a);
+
 #endif	// ifndef MCFG_UTIL_H
@@ -8,7 +8,7 @@ LIB_BASENAME="mcfg_2"
 LIBNAME="lib$LIB_BASENAME.a"
 
 CFLAGS="-std=gnu17 -gdwarf-4 -Wextra -Wall -Iinclude/ -Isrc/"
-LDFLAGS="-lm -L. -l$LIB_BASENAME"
+LDFLAGS="-lm -pthread -L. -l$LIB_BASENAME"
 
 TEST_BIN="mcfg_test"
 
@@ -29,7 +29,7 @@ function build_objs() {
 }
 
 function build_lib() {
-  OBJECTS=("mcfg mcfg_util parse serialize cptrlist shared mcfg_format")
+  OBJECTS=("mcfg mcfg_util parse serialize cptrlist shared mcfg_format path_cache cst stats")
 
   echo "==> Compiling sources for \"$LIBNAME\""
   build_objs "${OBJECTS[@]}"
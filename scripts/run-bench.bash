@@ -0,0 +1,67 @@
+#!/bin/bash
+
+# MCFG/2 benchmark script
+#
+# usage: scripts/run-bench.bash [BASELINE_REPORT] [-- BENCH_ARGS...]
+#
+# Builds the benchmarks with optimizations directly from the library sources,
+# runs them and writes the report to bench_output.txt. If a baseline report
+# from an earlier run is given, the ns/op of every benchmark is compared
+# against it.
+
+CC="${CC:-clang}"
+CFLAGS="-std=gnu17 -O2 -Wextra -Wall -Iinclude/ -Isrc/"
+LDFLAGS="-lm -pthread"
+
+BENCH_SRC="bench/src/bench.c"
+BENCH_EXEC="bench/bench_exec"
+REPORT="bench_output.txt"
+
+err() {
+    printf "\x1b[1m\x1b[31m==>\x1b[0m\x1b[1m $1\x1b[0m\n"
+    return 1;
+}
+
+info() {
+    printf "\x1b[1m\x1b[32m==>\x1b[0m\x1b[1m $1\x1b[0m\n"
+}
+
+subinfo() {
+    printf "\x1b[1m\x1b[34m  ->\x1b[0m\x1b[1m $1\x1b[0m\n"
+}
+
+BASELINE=""
+if [ -n "$1" ] && [ "$1" != "--" ]; then
+    BASELINE="$1"
+    shift
+fi
+
+if [ "$1" = "--" ]; then
+    shift
+fi
+
+LIB_SOURCES=$(ls src/*.c | grep -v "src/main.c")
+
+info "building benchmarks"
+$CC $CFLAGS "$BENCH_SRC" $LIB_SOURCES -o "$BENCH_EXEC" $LDFLAGS \
+    || err "failed to build" || exit 1
+
+info "running benchmarks"
+"$BENCH_EXEC" -o "$REPORT" "$@" || err "benchmarks failed" || exit 1
+
+if [ -z "$BASELINE" ]; then
+    exit 0
+fi
+
+info "comparing against $BASELINE"
+
+extract() {
+    sed -n 's/.*"name": "\([^"]*\)".*"ns_per_op": \([0-9.]*\).*/\1 \2/p' "$1"
+}
+
+awk 'NR == FNR { base[$1] = $2; next }
+     $1 in base {
+         change = ($2 - base[$1]) / base[$1] * 100
+         printf "  %-40s %14.1f -> %14.1f ns/op (%+.1f%%)\n",
+                $1, base[$1], $2, change
+     }' <(extract "$BASELINE") <(extract "$REPORT")
@@ -4,9 +4,15 @@
 
 CC="clang"
 CFLAGS="-std=gnu17 -gdwarf-4 -Wextra -Wall -Iinclude/ -Isrc/"
-LDFLAGS="-lm -L. -lmcfg_2"
+LDFLAGS="-lm -pthread -L. -lmcfg_2"
 
-TESTS="tests/src/parse.c tests/src/serialize.c"
+TESTS="tests/src/parse.c tests/src/serialize.c tests/src/format.c tests/src/cst.c tests/src/util.c"
+
+# These tests check the counters of the library, so they are built directly
+# from the library sources with the counters enabled.
+STATS_TESTS="tests/src/path.c tests/src/stats.c"
+STATS_CFLAGS="-DMCFG_STATS -DMCFG_LOOKUP_STATS"
+LIB_SOURCES=$(ls src/*.c | grep -v "src/main.c")
 
 err() {
     printf "\x1b[1m\x1b[31m==>\x1b[0m\x1b[1m $1\x1b[0m\n"
@@ -37,12 +43,12 @@ build_test() {
     fi
 
     subinfo "building..."
-    $CC $CFLAGS "$1" -o "$EXEC_NAME" $LDFLAGS || err "failed to build"
+    $CC $CFLAGS $2 "$1" -o "$EXEC_NAME" $LDFLAGS || err "failed to build"
 }
 
 run_test() {
     info "running test "'"'"$1"'"'
-    build_test "$1" || return 1;
+    build_test "$1" "$2" || return 1;
 
     subinfo "running $EXEC_NAME"
 
@@ -61,6 +67,14 @@ for test in $TESTS; do
     fi
 done
 
+for test in $STATS_TESTS; do
+    if run_test "$test" "$STATS_CFLAGS $LIB_SOURCES"; then
+        let "passed+=1"
+    else
+        let "failed+=1"
+    fi
+done
+
 info "$failed tests \x1b[1m\x1b[31mfailed\x1b[0m, $passed tests \x1b[1m\x1b[32mpassed\x1b[0m"
 
 exit $failed
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 
 #include "cptrlist.h"
+#include "stats.h"
 
 bool
 cptrlist_init(CPtrList *list, size_t capacity, size_t resize_align)
@@ -0,0 +1,251 @@
+/* cst.c ; marie config format internal concrete syntax tree
+ * implementation for MCFG/2
+ *
+ * Copyright (c) 2025, Marie Eckert
+ * Licensend under the BSD 3-Clause License.
+ */
+
+#define _XOPEN_SOURCE	700
+#define _POSIX_C_SOURCE 2
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cst.h"
+#include "mcfg_util.h"
+#include "shared.h"
+#include "stats.h"
+
+#define NAMESPACE  cst
+
+#define _span_cmp  NAMESPACED_DECL(_span_cmp)
+#define _find_span NAMESPACED_DECL(_find_span)
+
+/**
+ * @brief The bytes of the source which make up the value of a field.
+ */
+typedef struct _span {
+	size_t sector;
+	size_t section;
+	size_t field;
+
+	size_t start;
+	size_t end;
+
+	/** @brief The text replacing the span, NULL if it is unchanged */
+	mcfg_string_t *patch;
+} _span_t;
+
+struct mcfg_cst {
+	char *source;
+	size_t length;
+
+	/** @brief The spans of all field values, in the order of the source */
+	size_t span_count;
+	size_t span_capacity;
+	_span_t *spans;
+};
+
+/**
+ * @brief Orders spans by the position of their field in the file, which is
+ * the same as their order in the source.
+ */
+int
+_span_cmp(const _span_t *a, size_t sector, size_t section, size_t field)
+{
+	if(a->sector != sector) {
+		return a->sector < sector ? -1 : 1;
+	}
+
+	if(a->section != section) {
+		return a->section < section ? -1 : 1;
+	}
+
+	if(a->field != field) {
+		return a->field < field ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Find the span of a field by binary search.
+ * @return The span, NULL if there is none.
+ */
+_span_t *
+_find_span(const mcfg_cst_t *cst, size_t sector, size_t section, size_t field)
+{
+	size_t low = 0;
+	size_t high = cst->span_count;
+
+	while(low < high) {
+		const size_t mid = low + (high - low) / 2;
+		const int cmp = _span_cmp(&cst->spans[mid], sector, section, field);
+		if(cmp == 0) {
+			return &cst->spans[mid];
+		}
+
+		if(cmp < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return NULL;
+}
+
+mcfg_cst_t *
+cst_new(const char *source)
+{
+	mcfg_cst_t *cst = malloc(sizeof(*cst));
+	if(cst == NULL) {
+		return NULL;
+	}
+
+	cst->length = strlen(source);
+	cst->source = malloc(cst->length + 1);
+	if(cst->source == NULL) {
+		free(cst);
+		return NULL;
+	}
+
+	memcpy(cst->source, source, cst->length + 1);
+	cst->span_count = 0;
+	cst->span_capacity = 0;
+	cst->spans = NULL;
+	return cst;
+}
+
+void
+cst_destroy(mcfg_cst_t *cst)
+{
+	for(size_t ix = 0; ix < cst->span_count; ix++) {
+		free(cst->spans[ix].patch);
+	}
+
+	free(cst->spans);
+	free(cst->source);
+	free(cst);
+}
+
+mcfg_err_t
+cst_add_span(mcfg_cst_t *cst,
+			 size_t sector,
+			 size_t section,
+			 size_t field,
+			 size_t start,
+			 size_t end)
+{
+	if(cst->span_count == cst->span_capacity) {
+		const size_t capacity =
+			cst->span_capacity == 0 ? 16 : cst->span_capacity * 2;
+		_span_t *spans = realloc(cst->spans, sizeof(*spans) * capacity);
+		if(spans == NULL) {
+			return MCFG_MALLOC_FAIL;
+		}
+
+		cst->spans = spans;
+		cst->span_capacity = capacity;
+	}
+
+	cst->spans[cst->span_count] = (_span_t){
+		.sector = sector,
+		.section = section,
+		.field = field,
+		.start = start,
+		.end = end,
+		.patch = NULL,
+	};
+	cst->span_count++;
+
+	return MCFG_OK;
+}
+
+bool
+cst_find_field(const mcfg_file_t *file,
+			   const mcfg_field_t *field,
+			   size_t *sector,
+			   size_t *section,
+			   size_t *field_ix)
+{
+	for(size_t sector_ix = 0; sector_ix < file->sector_count; sector_ix++) {
+		const mcfg_sector_t *current = &file->sectors[sector_ix];
+
+		for(size_t section_ix = 0; section_ix < current->section_count;
+			section_ix++) {
+			const mcfg_section_t *candidate = &current->sections[section_ix];
+			if(candidate->field_count == 0 || field < candidate->fields ||
+			   field >= candidate->fields + candidate->field_count) {
+				continue;
+			}
+
+			*sector = sector_ix;
+			*section = section_ix;
+			*field_ix = field - candidate->fields;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+mcfg_err_t
+cst_set_patch(mcfg_cst_t *cst,
+			  size_t sector,
+			  size_t section,
+			  size_t field,
+			  mcfg_string_t *text)
+{
+	_span_t *span = _find_span(cst, sector, section, field);
+	if(span == NULL) {
+		return MCFG_STRUCTURE_ERROR;
+	}
+
+	free(span->patch);
+	span->patch = text;
+	return MCFG_OK;
+}
+
+mcfg_serialize_result_t
+cst_render(const mcfg_cst_t *cst)
+{
+	mcfg_serialize_result_t result = {.err = MCFG_OK, .value = NULL};
+
+	size_t length = cst->length;
+	for(size_t ix = 0; ix < cst->span_count; ix++) {
+		const _span_t *span = &cst->spans[ix];
+		if(span->patch != NULL) {
+			length += span->patch->length - (span->end - span->start);
+		}
+	}
+
+	result.value = mcfg_string_new_sized(length);
+	if(result.value == NULL) {
+		result.err = MCFG_MALLOC_FAIL;
+		return result;
+	}
+
+	/* copy the source between patched spans as it is */
+	char *out = result.value->data;
+	size_t copied = 0;
+	for(size_t ix = 0; ix < cst->span_count; ix++) {
+		const _span_t *span = &cst->spans[ix];
+		if(span->patch == NULL) {
+			continue;
+		}
+
+		memcpy(out, cst->source + copied, span->start - copied);
+		out += span->start - copied;
+		memcpy(out, span->patch->data, span->patch->length);
+		out += span->patch->length;
+		copied = span->end;
+	}
+
+	memcpy(out, cst->source + copied, cst->length - copied);
+
+	result.value->length = length;
+	result.value->data[length] = 0;
+
+	return result;
+}
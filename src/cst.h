@@ -0,0 +1,90 @@
+/* cst.h ; marie config format internal concrete syntax tree header
+ * for MCFG/2
+ *
+ * Copyright (c) 2025, Marie Eckert
+ * Licensend under the BSD 3-Clause License.
+ */
+
+#ifndef CST_H
+#define CST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mcfg.h"
+#include "shared.h"
+
+/* This header is included by translation units with their own NAMESPACE, so
+ * the declarations are namespaced explicitly.
+ */
+#define _CST_DECL(name) _NAMESPACED_DECL(INTERNAL_PREFIX(cst), name)
+
+#define cst_new _CST_DECL(cst_new)
+
+/**
+ * @brief Create a new CST without any spans for a copy of source.
+ * @return The new CST, NULL if an allocation failed.
+ */
+mcfg_cst_t *cst_new(const char *source);
+
+#define cst_destroy _CST_DECL(cst_destroy)
+
+/**
+ * @brief Free the given CST.
+ */
+void cst_destroy(mcfg_cst_t *cst);
+
+#define cst_add_span _CST_DECL(cst_add_span)
+
+/**
+ * @brief Record the span of the value of a field in the source. Spans have to
+ * be added in the order in which the fields appear in the source.
+ * @param sector The index of the sector of the field
+ * @param section The index of the section of the field in its sector
+ * @param field The index of the field in its section
+ * @param start Offset of the first byte of the value
+ * @param end Offset after the last byte of the value
+ * @return MCFG_OK on success, MCFG_MALLOC_FAIL if the span could not be stored.
+ */
+mcfg_err_t cst_add_span(mcfg_cst_t *cst,
+						size_t sector,
+						size_t section,
+						size_t field,
+						size_t start,
+						size_t end);
+
+#define cst_find_field _CST_DECL(cst_find_field)
+
+/**
+ * @brief Find the indices of a field in a file by its address.
+ * @return true if the field is a field of one of the sections in file.
+ */
+bool cst_find_field(const mcfg_file_t *file,
+					const mcfg_field_t *field,
+					size_t *sector,
+					size_t *section,
+					size_t *field_ix);
+
+#define cst_set_patch _CST_DECL(cst_set_patch)
+
+/**
+ * @brief Replace the text of a field value.
+ * @param text The new text of the value, ownership is transferred to the CST
+ * on success.
+ * @return MCFG_OK on success, MCFG_STRUCTURE_ERROR if there is no span for
+ * the field.
+ */
+mcfg_err_t cst_set_patch(mcfg_cst_t *cst,
+						 size_t sector,
+						 size_t section,
+						 size_t field,
+						 mcfg_string_t *text);
+
+#define cst_render _CST_DECL(cst_render)
+
+/**
+ * @brief Write the source with all patches applied.
+ */
+mcfg_serialize_result_t cst_render(const mcfg_cst_t *cst);
+
+#endif	// ifndef CST_H
@@ -20,8 +20,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "cst.h"
 #include "mcfg.h"
+#include "path_cache.h"
 #include "shared.h"
+#include "stats.h"
 
 #define XMALLOC(s)                   \
 	({                               \
@@ -41,6 +44,25 @@
 		ret;                         \
 	})
 
+/* Checks if the NULL-terminated string s is equal to the first l characters of
+ * n, which does not have to be NULL-terminated.
+ */
+#define NAME_MATCHES(s, n, l) (strncmp(s, n, l) == 0 && (s)[l] == '\0')
+
+#ifdef MCFG_LOOKUP_STATS
+static mcfg_lookup_stats_t lookup_stats = {0};
+
+#	define LOOKUP_STAT_INC(s) \
+		__atomic_fetch_add(&lookup_stats.s, 1, __ATOMIC_RELAXED)
+#else
+#	define LOOKUP_STAT_INC(s)
+#endif
+
+/* ids for new sectors, 0 is reserved for sectors which were not added with
+ * mcfg_add_sector
+ */
+static uint64_t next_sector_id = 1;
+
 char *
 mcfg_err_string(mcfg_err_t err)
 {
@@ -125,7 +147,13 @@ mcfg_add_sector(mcfg_file_t *file, char *name)
 
 	file->sectors[ix].name = name;
 	file->sectors[ix].section_count = 0;
+	file->sectors[ix].section_filter = (mcfg_name_filter_t){0};
+	file->sectors[ix].dirty = true;
+	file->sectors[ix].id =
+		__atomic_fetch_add(&next_sector_id, 1, __ATOMIC_RELAXED);
 	file->sector_count++;
+
+	name_filter_add(&file->sector_filter, name, strlen(name));
 	return MCFG_OK;
 }
 
@@ -152,7 +180,12 @@ mcfg_add_section(mcfg_sector_t *sector, char *name)
 
 	sector->sections[ix].name = name;
 	sector->sections[ix].field_count = 0;
+	sector->sections[ix].field_filter = (mcfg_name_filter_t){0};
+	sector->sections[ix].dirty = true;
 	sector->section_count++;
+	sector->dirty = true;
+
+	name_filter_add(&sector->section_filter, name, strlen(name));
 	return MCFG_OK;
 }
 
@@ -218,6 +251,9 @@ mcfg_add_field(mcfg_section_t *section,
 	section->fields[ix].data = data;
 	section->fields[ix].size = size;
 	section->field_count++;
+	section->dirty = true;
+
+	name_filter_add(&section->field_filter, name, strlen(name));
 	return MCFG_OK;
 }
 
@@ -245,46 +281,87 @@ mcfg_add_list_field(mcfg_list_t *list, size_t size, void *data)
 	list->fields[ix].data = data;
 	list->fields[ix].size = size;
 	list->field_count++;
+	list->dirty = true;
 	return MCFG_OK;
 }
 
 mcfg_sector_t *
 mcfg_get_sector(mcfg_file_t *file, char *name)
+{
+	return mcfg_get_sector_n(file, name, strlen(name));
+}
+
+mcfg_sector_t *
+mcfg_get_sector_n(mcfg_file_t *file, const char *name, size_t length)
 {
 	mcfg_sector_t *ret = NULL;
 
+	LOOKUP_STAT_INC(lookups);
+
+	if(!name_filter_may_contain(&file->sector_filter, name, length)) {
+		LOOKUP_STAT_INC(filter_rejects);
+		return NULL;
+	}
+
 	for(size_t ix = 0; ix < file->sector_count; ix++) {
-		if(strcmp(file->sectors[ix].name, name) == 0) {
+		if(NAME_MATCHES(file->sectors[ix].name, name, length)) {
 			ret = &file->sectors[ix];
 			break;
 		}
 	}
 
+	if(ret == NULL) {
+		LOOKUP_STAT_INC(false_positives);
+	}
+
 	return ret;
 }
 
 mcfg_section_t *
 mcfg_get_section(mcfg_sector_t *sector, char *name)
+{
+	return mcfg_get_section_n(sector, name, strlen(name));
+}
+
+mcfg_section_t *
+mcfg_get_section_n(mcfg_sector_t *sector, const char *name, size_t length)
 {
 	mcfg_section_t *ret = NULL;
 
+	LOOKUP_STAT_INC(lookups);
+
+	if(!name_filter_may_contain(&sector->section_filter, name, length)) {
+		LOOKUP_STAT_INC(filter_rejects);
+		return NULL;
+	}
+
 	for(size_t ix = 0; ix < sector->section_count; ix++) {
-		if(strcmp(sector->sections[ix].name, name) == 0) {
+		if(NAME_MATCHES(sector->sections[ix].name, name, length)) {
 			ret = &sector->sections[ix];
 			break;
 		}
 	}
 
+	if(ret == NULL) {
+		LOOKUP_STAT_INC(false_positives);
+	}
+
 	return ret;
 }
 
 mcfg_field_t *
 mcfg_get_dynfield(mcfg_file_t *file, char *name)
+{
+	return mcfg_get_dynfield_n(file, name, strlen(name));
+}
+
+mcfg_field_t *
+mcfg_get_dynfield_n(mcfg_file_t *file, const char *name, size_t length)
 {
 	mcfg_field_t *ret = NULL;
 
 	for(size_t ix = 0; ix < file->dynfield_count; ix++) {
-		if(strcmp(file->dynfields[ix].name, name) == 0) {
+		if(NAME_MATCHES(file->dynfields[ix].name, name, length)) {
 			ret = &file->dynfields[ix];
 			break;
 		}
@@ -295,19 +372,68 @@ mcfg_get_dynfield(mcfg_file_t *file, char *name)
 
 mcfg_field_t *
 mcfg_get_field(mcfg_section_t *section, char *name)
+{
+	return mcfg_get_field_n(section, name, strlen(name));
+}
+
+mcfg_field_t *
+mcfg_get_field_n(mcfg_section_t *section, const char *name, size_t length)
 {
 	mcfg_field_t *ret = NULL;
 
+	LOOKUP_STAT_INC(lookups);
+
+	if(!name_filter_may_contain(&section->field_filter, name, length)) {
+		LOOKUP_STAT_INC(filter_rejects);
+		return NULL;
+	}
+
 	for(size_t ix = 0; ix < section->field_count; ix++) {
-		if(strcmp(section->fields[ix].name, name) == 0) {
+		if(NAME_MATCHES(section->fields[ix].name, name, length)) {
 			ret = &section->fields[ix];
 			break;
 		}
 	}
 
+	if(ret == NULL) {
+		LOOKUP_STAT_INC(false_positives);
+	}
+
 	return ret;
 }
 
+mcfg_lookup_stats_t
+mcfg_get_lookup_stats(void)
+{
+	mcfg_lookup_stats_t stats = {0};
+
+#ifdef MCFG_LOOKUP_STATS
+	stats.lookups = __atomic_load_n(&lookup_stats.lookups, __ATOMIC_RELAXED);
+	stats.filter_rejects =
+		__atomic_load_n(&lookup_stats.filter_rejects, __ATOMIC_RELAXED);
+	stats.false_positives =
+		__atomic_load_n(&lookup_stats.false_positives, __ATOMIC_RELAXED);
+#endif
+
+	const uint64_t misses = stats.false_positives + stats.filter_rejects;
+	if(misses > 0) {
+		stats.false_positive_rate =
+			(double)stats.false_positives / (double)misses;
+	}
+
+	return stats;
+}
+
+void
+mcfg_reset_lookup_stats(void)
+{
+#ifdef MCFG_LOOKUP_STATS
+	__atomic_store_n(&lookup_stats.lookups, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&lookup_stats.filter_rejects, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&lookup_stats.false_positives, 0, __ATOMIC_RELAXED);
+#endif
+}
+
 void
 mcfg_free_list(mcfg_list_t list)
 {
@@ -392,6 +518,12 @@ mcfg_free_file(mcfg_file_t file)
 	if(file.sectors != NULL) {
 		free(file.sectors);
 	}
+
+	if(file.path_cache != NULL) {
+		path_cache_destroy(file.path_cache);
+	}
+
+	mcfg_disable_serialize_cache(&file);
 }
 
 /* parser api */
@@ -400,6 +532,12 @@ mcfg_free_file(mcfg_file_t file)
 
 mcfg_parse_result_t
 mcfg_parse(char *input)
+{
+	return mcfg_parse_cst(input, NULL);
+}
+
+mcfg_parse_result_t
+mcfg_parse_cst(char *input, mcfg_cst_t **cst)
 {
 	mcfg_parse_result_t result = {
 		.err = MCFG_OK,
@@ -413,25 +551,58 @@ mcfg_parse(char *input)
 		return result;
 	}
 
+	STATS_BEGIN(lex_start);
 	result.err = lex_input(input, tree);
+	STATS_END(STATS_LEX, lex_start);
+
 	if(result.err != MCFG_OK) {
 		free_tree(tree);
 		return result;
 	}
 
-	_parse_result_t parse_result = parse_tree(*tree, &result.value);
+	mcfg_cst_t *new_cst = NULL;
+	if(cst != NULL) {
+		*cst = NULL;
+		new_cst = cst_new(input);
+		if(new_cst == NULL) {
+			free_tree(tree);
+			result.err = MCFG_MALLOC_FAIL;
+			return result;
+		}
+	}
+
+	STATS_BEGIN(parse_start);
+	_parse_result_t parse_result = parse_tree(*tree, &result.value, new_cst);
+	STATS_END(STATS_PARSE, parse_start);
+
 	result.err = parse_result.err;
 	result.err_linespan = parse_result.err_linespan;
 
 	if(result.err != MCFG_OK) {
 		mcfg_free_file(result.value);
+		mcfg_free_cst(new_cst);
+	} else {
+		STATS_ADD_FILE(&result.value);
+		if(cst != NULL) {
+			*cst = new_cst;
+		}
 	}
 
+	STATS_BEGIN(free_start);
 	free_tree(tree);
+	STATS_END(STATS_FREE_TREE, free_start);
 
 	return result;
 }
 
+void
+mcfg_free_cst(mcfg_cst_t *cst)
+{
+	if(cst != NULL) {
+		cst_destroy(cst);
+	}
+}
+
 mcfg_parse_result_t
 mcfg_parse_from_file(const char *path)
 {
@@ -441,9 +612,12 @@ mcfg_parse_from_file(const char *path)
 		.value = {0},
 	};
 
+	STATS_BEGIN(read_start);
+
 	FILE *raw_file = fopen(path, "rb");
 	if(raw_file == NULL) {
 		result.err = errno | MCFG_OS_ERROR_MASK;
+		STATS_END(STATS_READ, read_start);
 		return result;
 	}
 
@@ -454,6 +628,7 @@ mcfg_parse_from_file(const char *path)
 	char *data = malloc(data_size + 1);
 	if(data == NULL) {
 		fclose(raw_file);
+		STATS_END(STATS_READ, read_start);
 
 		result.err = MCFG_MALLOC_FAIL;
 		return result;
@@ -463,10 +638,12 @@ mcfg_parse_from_file(const char *path)
 		fclose(raw_file);
 
 		result.err = errno | MCFG_OS_ERROR_MASK;
+		STATS_END(STATS_READ, read_start);
 		return result;
 	}
 
 	fclose(raw_file);
+	STATS_END(STATS_READ, read_start);
 
 	data[data_size] = 0;
 	result = mcfg_parse(data);
@@ -482,5 +659,170 @@ mcfg_parse_from_file(const char *path)
 mcfg_serialize_result_t
 mcfg_serialize(mcfg_file_t file, mcfg_serialize_options_t options)
 {
-	return serialize_file(file, options);
-}
\ No newline at end of file
+	STATS_BEGIN(serialize_start);
+
+	mcfg_serialize_result_t result;
+	if(file.serialize_cache != NULL) {
+		result = serialize_file_cached(file, options);
+	} else {
+		result = serialize_file(file, options);
+	}
+
+	STATS_END(STATS_SERIALIZE, serialize_start);
+	return result;
+}
+
+mcfg_err_t
+mcfg_enable_serialize_cache(mcfg_file_t *file)
+{
+	if(file == NULL) {
+		return MCFG_NULLPTR;
+	}
+
+	mcfg_serialize_cache_t *cache = serialize_cache_new();
+	if(cache == NULL) {
+		return MCFG_MALLOC_FAIL;
+	}
+
+	mcfg_disable_serialize_cache(file);
+	file->serialize_cache = cache;
+	return MCFG_OK;
+}
+
+void
+mcfg_disable_serialize_cache(mcfg_file_t *file)
+{
+	if(file == NULL || file->serialize_cache == NULL) {
+		return;
+	}
+
+	serialize_cache_destroy(file->serialize_cache);
+	file->serialize_cache = NULL;
+}
+
+mcfg_err_t
+mcfg_serialize_to(mcfg_serialize_writer_t writer,
+				  void *ctx,
+				  mcfg_file_t file,
+				  mcfg_serialize_options_t options)
+{
+	if(writer == NULL) {
+		return MCFG_NULLPTR;
+	}
+
+	STATS_BEGIN(serialize_start);
+	const mcfg_err_t err = serialize_to(writer, ctx, -1, file, options);
+	STATS_END(STATS_SERIALIZE, serialize_start);
+
+	return err;
+}
+
+mcfg_err_t
+mcfg_serialize_to_fd(int fd, mcfg_file_t file, mcfg_serialize_options_t options)
+{
+	STATS_BEGIN(serialize_start);
+	const mcfg_err_t err = serialize_to(NULL, NULL, fd, file, options);
+	STATS_END(STATS_SERIALIZE, serialize_start);
+
+	return err;
+}
+
+mcfg_err_t
+mcfg_serialize_to_stream(FILE *stream,
+						 mcfg_file_t file,
+						 mcfg_serialize_options_t options)
+{
+	if(stream == NULL) {
+		return MCFG_NULLPTR;
+	}
+
+	STATS_BEGIN(serialize_start);
+	const mcfg_err_t err =
+		serialize_to(serialize_stdio_writer, stream, -1, file, options);
+	STATS_END(STATS_SERIALIZE, serialize_start);
+
+	return err;
+}
+
+mcfg_err_t
+mcfg_cst_set_field(mcfg_cst_t *cst,
+				   mcfg_file_t *file,
+				   mcfg_field_t *field,
+				   void *data,
+				   size_t size)
+{
+	if(cst == NULL || file == NULL || field == NULL || data == NULL) {
+		return MCFG_NULLPTR;
+	}
+
+	size_t sector_ix;
+	size_t section_ix;
+	size_t field_ix;
+	if(!cst_find_field(file, field, &sector_ix, &section_ix, &field_ix)) {
+		return MCFG_STRUCTURE_ERROR;
+	}
+
+	/* the element type is written outside of the value */
+	if(field->type == TYPE_LIST &&
+	   ((mcfg_list_t *)data)->type != ((mcfg_list_t *)field->data)->type) {
+		return MCFG_INVALID_TYPE;
+	}
+
+	mcfg_field_t updated = *field;
+	updated.data = data;
+	updated.size = size;
+
+	mcfg_serialize_result_t text = serialize_value(updated);
+	if(text.err != MCFG_OK) {
+		return text.err;
+	}
+
+	const mcfg_err_t err =
+		cst_set_patch(cst, sector_ix, section_ix, field_ix, text.value);
+	if(err != MCFG_OK) {
+		free(text.value);
+		return err;
+	}
+
+	if(field->type == TYPE_LIST) {
+		mcfg_free_list(*(mcfg_list_t *)field->data);
+	}
+
+	free(field->data);
+	field->data = data;
+	field->size = size;
+	file->sectors[sector_ix].sections[section_ix].dirty = true;
+
+	return MCFG_OK;
+}
+
+mcfg_serialize_result_t
+mcfg_cst_serialize(const mcfg_cst_t *cst)
+{
+	if(cst == NULL) {
+		return (mcfg_serialize_result_t){.err = MCFG_NULLPTR, .value = NULL};
+	}
+
+	STATS_BEGIN(serialize_start);
+	mcfg_serialize_result_t result = cst_render(cst);
+	STATS_END(STATS_SERIALIZE, serialize_start);
+
+	return result;
+}
+
+mcfg_err_t
+mcfg_serialize_to_file(const char *path,
+					   mcfg_file_t file,
+					   mcfg_serialize_options_t options,
+					   int flags)
+{
+	if(path == NULL) {
+		return MCFG_NULLPTR;
+	}
+
+	STATS_BEGIN(serialize_start);
+	const mcfg_err_t err = serialize_to_path(path, file, options, flags);
+	STATS_END(STATS_SERIALIZE, serialize_start);
+
+	return err;
+}
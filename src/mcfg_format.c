@@ -8,20 +8,61 @@
 #define _XOPEN_SOURCE	700
 #define _POSIX_C_SOURCE 2
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "mcfg_format.h"
 #include "shared.h"
+#include "stats.h"
 
 #define NAMESPACE		   mcfg_format
 
-#define _insert_path_elems NAMESPACED_DECL(_insert_path_elems)
-#define _free__embeds	   NAMESPACED_DECL(_free__embeds)
-#define _append_embed	   NAMESPACED_DECL(_append_embed)
-#define _extract_embeds	   NAMESPACED_DECL(_extract_embeds)
-#define _format			   NAMESPACED_DECL(_format)
+#define _resolve_embed		 NAMESPACED_DECL(_resolve_embed)
+#define _free__embeds		 NAMESPACED_DECL(_free__embeds)
+#define _append_embed		 NAMESPACED_DECL(_append_embed)
+#define _find_next			 NAMESPACED_DECL(_find_next)
+#define _scan_start			 NAMESPACED_DECL(_scan_start)
+#define _next_embed			 NAMESPACED_DECL(_next_embed)
+#define _extract_embeds		 NAMESPACED_DECL(_extract_embeds)
+#define _is_visiting		 NAMESPACED_DECL(_is_visiting)
+#define _memo_slot			 NAMESPACED_DECL(_memo_slot)
+#define _memo_get			 NAMESPACED_DECL(_memo_get)
+#define _memo_put			 NAMESPACED_DECL(_memo_put)
+#define _adopt				 NAMESPACED_DECL(_adopt)
+#define _free_template		 NAMESPACED_DECL(_free_template)
+#define _append_literal		 NAMESPACED_DECL(_append_literal)
+#define _drop_segments_from	 NAMESPACED_DECL(_drop_segments_from)
+#define _compile_list_embed	 NAMESPACED_DECL(_compile_list_embed)
+#define _compile_embed		 NAMESPACED_DECL(_compile_embed)
+#define _compile_visiting	 NAMESPACED_DECL(_compile_visiting)
+#define _compile			 NAMESPACED_DECL(_compile)
+#define _compile_root		 NAMESPACED_DECL(_compile_root)
+#define _get_dynfield		 NAMESPACED_DECL(_get_dynfield)
+#define _dynfield_name		 NAMESPACED_DECL(_dynfield_name)
+#define _buffer_sink		 NAMESPACED_DECL(_buffer_sink)
+#define _emit_data			 NAMESPACED_DECL(_emit_data)
+#define _render_field		 NAMESPACED_DECL(_render_field)
+#define _render				 NAMESPACED_DECL(_render)
+#define _arena_reserve		 NAMESPACED_DECL(_arena_reserve)
+#define _arena_sink			 NAMESPACED_DECL(_arena_sink)
+#define _render_alloc		 NAMESPACED_DECL(_render_alloc)
+#define _format_str			 NAMESPACED_DECL(_format_str)
+#define _format_direct		 NAMESPACED_DECL(_format_direct)
+#define _format_section		 NAMESPACED_DECL(_format_section)
+#define _format_file_worker	 NAMESPACED_DECL(_format_file_worker)
+#define _dep_node_cmp		 NAMESPACED_DECL(_dep_node_cmp)
+#define _find_node			 NAMESPACED_DECL(_find_node)
+#define _add_dependency		 NAMESPACED_DECL(_add_dependency)
+#define _has_dependency		 NAMESPACED_DECL(_has_dependency)
+#define _index_text			 NAMESPACED_DECL(_index_text)
+#define _index_field		 NAMESPACED_DECL(_index_field)
+#define _index_node			 NAMESPACED_DECL(_index_node)
+#define _unindex_node		 NAMESPACED_DECL(_unindex_node)
+#define _collect_dependents	 NAMESPACED_DECL(_collect_dependents)
 
 char *
 mcfg_fmt_err_string(mcfg_fmt_err_t err)
@@ -29,6 +70,8 @@ mcfg_fmt_err_string(mcfg_fmt_err_t err)
 	switch(err) {
 		case MCFG_FMT_NOT_FOUND:
 			return "Format not found";
+		case MCFG_FMT_EMBED_CYCLE:
+			return "Embed references itself";
 		default:
 			return mcfg_err_string((mcfg_err_t)err);
 	}
@@ -60,31 +103,7 @@ mcfg_fmt_err_string(mcfg_fmt_err_t err)
 		ret;                                          \
 	})
 
-#define FMTREALLOC(o, s)                              \
-	({                                                \
-		void *ret;                                    \
-		ret = realloc(o, s);                          \
-		ERR_CHECK(ret != NULL, MCFG_FMT_MALLOC_FAIL); \
-		ret;                                          \
-	})
-
-/**
- * @brief This macro is inteded for use inside _format, to ensure that we never
- * write outside of the buffer.
- * @note Causes to return with error on (re)alloction failure!
- *
- * @param b The buffer
- * @param a The allocated buffer size
- * @param s The would-be size after writing to it
- */
-#define APPEND_CHECK(b, a, s)     \
-	if(s > a) {                   \
-		if(b == NULL) {           \
-			b = FMTMALLOC(s);     \
-		} else {                  \
-			b = FMTREALLOC(b, s); \
-		}                         \
-	}
+#define FIELD_PLACEHOLDER "(nullptr)"
 
 typedef struct _embed {
 	/** @brief the position at which the embed starts in the input */
@@ -99,55 +118,230 @@ typedef struct _embed {
 	/** @brief if true, this embed is simply ignored in the output */
 	bool ignore_me;
 
-	/** @brief The given path to the field */
-	char *field;
+	/** @brief Where the given path to the field lies in the input */
+	mcfg_path_slice_t name;
 } _embed_t;
 
 typedef struct _embeds {
 	mcfg_fmt_err_t err;
 
 	size_t count;
+	size_t capacity;
 	_embed_t *embeds;
 } _embeds_t;
 
-// Helper function for path relativity
-mcfg_path_t
-_insert_path_elems(mcfg_path_t src, mcfg_path_t rel)
+/**
+ * @brief State of a scan for embeds through an input string.
+ */
+typedef struct _scan {
+	const char *input;
+	const char *end;
+	const char *cursor;
+
+	/* the last results of the searches for each special character */
+	const char *next_dollar;
+	const char *next_backslash;
+	const char *next_close;
+} _scan_t;
+
+/**
+ * @brief A field which is currently being compiled or rendered. The chain of
+ * visits lives on the stack and is used to detect embeds which (indirectly)
+ * reference themselves.
+ */
+typedef struct _visit {
+	const mcfg_field_t *field;
+	const struct _visit *parent;
+} _visit_t;
+
+typedef struct _memo_entry {
+	const mcfg_field_t *field;
+	mcfg_template_t *tmpl;
+} _memo_entry_t;
+
+/**
+ * @brief Maps string fields to the template they were compiled to, so that
+ * a field embedded in multiple places is only compiled once.
+ */
+typedef struct _memo {
+	size_t count;
+	size_t capacity;
+	_memo_entry_t *entries;
+} _memo_t;
+
+typedef struct _compile_ctx {
+	mcfg_file_t *file;
+	mcfg_path_t rel;
+
+	/** @brief The template being compiled, owns all nested templates */
+	mcfg_template_t *root;
+
+	_memo_t memo;
+	const _visit_t *visiting;
+
+	/** @brief Bindings consulted before the dynfields of file, may be NULL */
+	const mcfg_dyn_scope_t *scope;
+
+	/**
+	 * @brief If true, templates point into the strings they are compiled from
+	 * instead of copying them. Only used for templates which are freed before
+	 * their input could change.
+	 */
+	bool borrow_sources;
+} _compile_ctx_t;
+
+typedef struct _render_ctx {
+	mcfg_fmt_sink_t sink;
+	void *sink_ctx;
+
+	/** @brief Bindings consulted before the dynfields of file, may be NULL */
+	const mcfg_dyn_scope_t *scope;
+
+	/**
+	 * @brief The file dynfields which contain embeds are compiled against.
+	 * Usually the file of the template, but scoped renders use a view of it
+	 * without the (not thread-safe) path cache.
+	 */
+	mcfg_file_t *file;
+} _render_ctx_t;
+
+typedef struct _buffer_sink {
+	char *buf;
+	size_t cap;
+	size_t length;
+} _buffer_sink_t;
+
+/**
+ * @brief A growing buffer which holds the output of many renders back to
+ * back.
+ */
+typedef struct _arena {
+	char *data;
+	size_t length;
+	size_t capacity;
+} _arena_t;
+
+/* compiling and rendering recurse into each other for nested templates */
+mcfg_template_res_t _compile(_compile_ctx_t *ctx, const char *input);
+
+mcfg_fmt_err_t _render(const mcfg_template_t *tmpl,
+					   const _render_ctx_t *rctx,
+					   const _visit_t *visiting);
+
+/**
+ * @brief Looks up a dynfield, preferring the bindings of scope over the
+ * dynfields of file.
+ */
+mcfg_field_t *
+_get_dynfield(mcfg_file_t *file,
+			  const mcfg_dyn_scope_t *scope,
+			  const char *name,
+			  size_t length)
 {
-	if(src.sector == NULL) {
-		src.sector = rel.sector != NULL ? strdup(rel.sector) : strdup("(null)");
-		src.absolute = true;
+	mcfg_field_t *field = mcfg_dyn_scope_get(scope, name, length);
+	if(field != NULL) {
+		return field;
 	}
 
-	if(src.section == NULL) {
-		src.section =
-			rel.section != NULL ? strdup(rel.section) : strdup("(null)");
-	}
+	return mcfg_get_dynfield_n(file, name, length);
+}
 
-	if(src.field == NULL) {
-		src.field = rel.field != NULL ? strdup(rel.field) : strdup("(null)");
+/**
+ * @brief Gets the name a dynfield path refers to. An empty path refers to
+ * the field of the relativity path.
+ */
+const char *
+_dynfield_name(mcfg_path_view_t path, mcfg_path_t rel, size_t *length)
+{
+	if(path.field.length == 0 && rel.field != NULL) {
+		*length = strlen(rel.field);
+		return rel.field;
 	}
 
-	return src;
+	*length = path.field.length;
+	return MCFG_PATH_VIEW_ELEM(path, field);
 }
 
-void
-_free__embeds(_embeds_t embeds)
+/**
+ * @brief Resolves the field an embed points to. Elements missing from the
+ * embeds path are taken from the relativity path.
+ * @param file The file in which the field lies
+ * @param path The path given in the embed, may not be a dynfield path
+ * @param rel The path used to complete the embeds path
+ * @return Pointer to the field, NULL if it could not be found.
+ */
+mcfg_field_t *
+_resolve_embed(mcfg_file_t *file, mcfg_path_view_t path, mcfg_path_t rel)
 {
-	if(embeds.count == 0 || embeds.embeds == NULL) {
-		return;
+	/* complete absolute paths do not need the relativity path and can make use
+	 * of the files path cache
+	 */
+	if(path.absolute && path.sector.length > 0 && path.section.length > 0 &&
+	   path.field.length > 0) {
+		return mcfg_get_field_by_path_view(file, path);
 	}
 
-	for(size_t ix = 0; ix < embeds.count; ix++) {
-		free(embeds.embeds[ix].field);
+	/* relative paths which specify their own sector can not be resolved */
+	if(!path.absolute && path.sector.length > 0) {
+		return NULL;
+	}
+
+	const char *field = MCFG_PATH_VIEW_ELEM(path, field);
+	size_t field_len = path.field.length;
+	if(field_len == 0) {
+		if(rel.field == NULL) {
+			return NULL;
+		}
+
+		field = rel.field;
+		field_len = strlen(rel.field);
+	}
+
+	const char *sector_name = MCFG_PATH_VIEW_ELEM(path, sector);
+	size_t sector_len = path.sector.length;
+	if(sector_len == 0) {
+		if(rel.sector == NULL) {
+			return NULL;
+		}
+
+		sector_name = rel.sector;
+		sector_len = strlen(rel.sector);
+	}
+
+	const char *section_name = MCFG_PATH_VIEW_ELEM(path, section);
+	size_t section_len = path.section.length;
+	if(section_len == 0) {
+		if(rel.section == NULL) {
+			return NULL;
+		}
+
+		section_name = rel.section;
+		section_len = strlen(rel.section);
+	}
+
+	mcfg_sector_t *sector = mcfg_get_sector_n(file, sector_name, sector_len);
+	if(sector == NULL) {
+		return NULL;
 	}
 
+	mcfg_section_t *section =
+		mcfg_get_section_n(sector, section_name, section_len);
+	if(section == NULL) {
+		return NULL;
+	}
+
+	return mcfg_get_field_n(section, field, field_len);
+}
+
+void
+_free__embeds(_embeds_t embeds)
+{
 	free(embeds.embeds);
 }
 
 mcfg_fmt_err_t
 _append_embed(_embeds_t *embeds,
-			  char *field,
+			  mcfg_path_slice_t name,
 			  size_t pos,
 			  size_t src_end_pos,
 			  bool ignore_me)
@@ -156,279 +350,2135 @@ _append_embed(_embeds_t *embeds,
 		return MCFG_FMT_NULLPTR;
 	}
 
-	const size_t wix = embeds->count;
-	embeds->count++;
+	if(embeds->count == embeds->capacity) {
+		const size_t capacity =
+			embeds->capacity == 0 ? 8 : embeds->capacity * 2;
 
-	if(wix == 0) {
-		embeds->embeds = malloc(sizeof(*embeds->embeds));
-	} else {
-		embeds->embeds =
-			realloc(embeds->embeds, sizeof(*embeds->embeds) * embeds->count);
-	}
+		_embed_t *grown =
+			realloc(embeds->embeds, sizeof(*embeds->embeds) * capacity);
+		if(grown == NULL) {
+			return MCFG_FMT_MALLOC_FAIL;
+		}
 
-	if(embeds->embeds == NULL) {
-		return MCFG_FMT_MALLOC_FAIL;
+		embeds->embeds = grown;
+		embeds->capacity = capacity;
 	}
 
-	embeds->embeds[wix].field = field;
-	embeds->embeds[wix].pos = pos;
-	embeds->embeds[wix].ignore_me = ignore_me;
-	embeds->embeds[wix].src_end_pos = src_end_pos;
+	embeds->embeds[embeds->count] = (_embed_t){
+		.pos = pos,
+		.src_end_pos = src_end_pos,
+		.ignore_me = ignore_me,
+		.name = name,
+	};
+	embeds->count++;
 
 	return MCFG_FMT_OK;
 }
 
 /**
- * @brief Extracts field embeds from the given input
+ * @brief Finds the next occurence of c at or after cursor. The previous
+ * result for c is reused as long as it is not behind cursor, so that every
+ * byte of the input is searched at most once per character.
+ * @return Pointer to the occurence, end if there is none.
  */
-_embeds_t
-_extract_embeds(char *input)
+const char *
+_find_next(const char *cursor, const char *end, char c, const char *previous)
 {
-	_embeds_t res = {.count = 0, .embeds = NULL};
+	if(previous != NULL && previous >= cursor) {
+		return previous;
+	}
 
-	const size_t input_len = strlen(input);
+	const char *found = memchr(cursor, c, end - cursor);
+	return found != NULL ? found : end;
+}
 
-	size_t field_pos = 0;		  /* see _embed_t.pos */
-	size_t field_src_end_pos = 0; /* see _embed_t.src_end_pos */
-	size_t field_name_wix = 0;
-	char *field_name = malloc(input_len + 1); /* this is a bit much, but it
-											   * allows us avoid reallocs */
-	if(field_name == NULL) {
-		return res;
-	}
+_scan_t
+_scan_start(const char *input)
+{
+	return (_scan_t){
+		.input = input,
+		.end = input + strlen(input),
+		.cursor = input,
+		.next_dollar = NULL,
+		.next_backslash = NULL,
+		.next_close = NULL,
+	};
+}
+
+/**
+ * @brief Finds the next embed or escape in the input of a scan, without
+ * allocating. Literal text is skipped using memchr, which the C library
+ * implements with vector instructions, so only the characters around embeds
+ * and escapes are looked at one by one. The names of embeds are recorded as
+ * spans of the input.
+ * A name containing a backslash or another embed is not an embed itself, its
+ * text is kept as literal text.
+ * @return false once the end of the input is reached.
+ */
+bool
+_next_embed(_scan_t *scan, _embed_t *embed)
+{
+	const char *input = scan->input;
+	const char *end = scan->end;
+
+	while(scan->cursor < end) {
+		scan->next_dollar =
+			_find_next(scan->cursor, end, '$', scan->next_dollar);
+		scan->next_backslash =
+			_find_next(scan->cursor, end, '\\', scan->next_backslash);
+
+		if(scan->next_backslash < scan->next_dollar) {
+			/* an "ignore_me" embed stops the backslash from being copied,
+			 * the escaped character is skipped
+			 */
+			const size_t pos = scan->next_backslash - input;
+			*embed = (_embed_t){
+				.pos = pos,
+				.src_end_pos = pos + 1,
+				.ignore_me = true,
+				.name = {0, 0},
+			};
+			scan->cursor = scan->next_backslash + 2;
+			return true;
+		}
 
-	bool escaping = false;
-	bool building_embed = false;
-	bool building_field_name = false;
+		if(scan->next_dollar == end) {
+			break;
+		}
 
-	for(size_t ix = 0; ix < input_len; ix++) {
-		if(escaping) {
-			escaping = false;
+		const char *dollar = scan->next_dollar;
+		scan->cursor = dollar + 1;
+		if(*scan->cursor != '(') {
 			continue;
 		}
 
-		if(input[ix] != '(') {
-			building_embed = false;
+		const char *name = scan->cursor + 1;
+		scan->next_close = _find_next(name, end, ')', scan->next_close);
+		const char *close = scan->next_close;
+
+		/* an embed starting within the name takes precedence */
+		scan->next_dollar = _find_next(name, end, '$', NULL);
+		const char *inner = scan->next_dollar;
+		while(inner < close && inner[1] != '(') {
+			inner = _find_next(inner + 1, end, '$', NULL);
 		}
 
-		switch(input[ix]) {
-			case '\\':
-				escaping = true;
+		if(close == end || scan->next_backslash < close || inner < close) {
+			continue;
+		}
 
-				/* append an "ingore_me" embed to stop _format from copying the
-				 * the backslash while also avoding it trying to lookup a field
-				 */
-				res.err = _append_embed(&res, strdup("\\"), ix, ix + 1, true);
-				break;
-			case '$':
-				building_embed = true;
-				break;
-			case '(':
-				if(!building_embed) {
-					break;
-				}
-
-				building_embed = false;
-				building_field_name = true;
-				field_pos = ix - 1;
-				break;
-			case ')':
-				if(!building_field_name) {
-					break;
-				}
-
-				building_field_name = false;
-				field_name[field_name_wix] = 0;
-				field_src_end_pos = ix + 1;
-				field_name_wix = 0;
-
-				res.err = _append_embed(&res, strdup(field_name), field_pos,
-										field_src_end_pos, false);
-				if(res.err != MCFG_FMT_OK) {
-					goto exit;
-				}
-				break;
-			default:
-				building_embed = false;
+		*embed = (_embed_t){
+			.pos = dollar - input,
+			.src_end_pos = close - input + 1,
+			.ignore_me = false,
+			.name = {.offset = name - input, .length = close - name},
+		};
+		scan->cursor = close + 1;
+		return true;
+	}
 
-				if(!building_field_name) {
-					break;
-				}
+	return false;
+}
 
-				field_name[field_name_wix] = input[ix];
-				field_name_wix++;
-				break;
-		}
+/**
+ * @brief Extracts all field embeds from the given input.
+ * @see _next_embed
+ */
+_embeds_t
+_extract_embeds(const char *input)
+{
+	_embeds_t res = {
+		.err = MCFG_FMT_OK, .count = 0, .capacity = 0, .embeds = NULL};
+
+	_scan_t scan = _scan_start(input);
+	_embed_t embed;
+
+	while(res.err == MCFG_FMT_OK && _next_embed(&scan, &embed)) {
+		res.err = _append_embed(&res, embed.name, embed.pos,
+								embed.src_end_pos, embed.ignore_me);
 	}
 
-exit:
-	free(field_name);
 	return res;
 }
 
-mcfg_fmt_res_t
-_format(char *input, _embeds_t embeds, mcfg_file_t file, mcfg_path_t rel)
+bool
+_is_visiting(const _visit_t *visiting, const mcfg_field_t *field)
 {
-	mcfg_fmt_res_t res = {
-		.err = MCFG_FMT_OK,
-		.formatted_size = strlen(input) + 1,
-		.formatted = NULL,
-	};
-
-	res.formatted = FMTMALLOC(res.formatted_size);
-	if(embeds.count == 0) {
-		strcpy(res.formatted, input);
-		return res;
+	for(; visiting != NULL; visiting = visiting->parent) {
+		if(visiting->field == field) {
+			return true;
+		}
 	}
 
-	size_t cpy_offs = 0;
-	size_t write_offs = 0;
+	return false;
+}
 
-	const char _FIELD_NULLPTR[] = "(nullptr)";
+size_t
+_memo_slot(size_t capacity, const mcfg_field_t *field)
+{
+	const uint64_t hash = (uint64_t)(uintptr_t)field * 0x9e3779b97f4a7c15ull;
+	return (size_t)(hash >> 32) & (capacity - 1);
+}
 
-	for(size_t ix = 0; ix < embeds.count; ix++) {
-		_embed_t embed = embeds.embeds[ix];
-
-		/* copy characters from input up until embed */
-		const size_t input_cpy_size =
-			embed.pos - cpy_offs; /* size to be copied */
-		APPEND_CHECK(res.formatted, res.formatted_size,
-					 write_offs + input_cpy_size);
-		memcpy(res.formatted + write_offs, input + cpy_offs, input_cpy_size);
-		write_offs += input_cpy_size;
-		cpy_offs = embed.src_end_pos;
+mcfg_template_t *
+_memo_get(const _memo_t *memo, const mcfg_field_t *field)
+{
+	if(memo->count == 0) {
+		return NULL;
+	}
 
-		if(embed.ignore_me) {
-			continue;
+	for(size_t ix = _memo_slot(memo->capacity, field);
+		memo->entries[ix].field != NULL; ix = (ix + 1) & (memo->capacity - 1)) {
+		if(memo->entries[ix].field == field) {
+			return memo->entries[ix].tmpl;
 		}
+	}
 
-		/* get, format & insert field */
-		mcfg_path_t path =
-			_insert_path_elems(mcfg_parse_path(embed.field), rel);
-		mcfg_field_t *field = mcfg_get_field_by_path(&file, path);
-
-		free(path.sector);
-		free(path.section);
-		free(path.field);
+	return NULL;
+}
 
-		/* field does not exist, insert (nullptr) as placeholder */
-		if(field == NULL) {
-			memcpy(res.formatted + write_offs, _FIELD_NULLPTR,
-				   sizeof(_FIELD_NULLPTR));
-			write_offs += sizeof(_FIELD_NULLPTR) - 1;
-			continue;
+mcfg_fmt_err_t
+_memo_put(_memo_t *memo, const mcfg_field_t *field, mcfg_template_t *tmpl)
+{
+	/* keep the load factor at or below 1/2 */
+	if((memo->count + 1) * 2 > memo->capacity) {
+		const size_t capacity = memo->capacity == 0 ? 16 : memo->capacity * 2;
+		_memo_entry_t *entries = calloc(capacity, sizeof(*entries));
+		if(entries == NULL) {
+			return MCFG_FMT_MALLOC_FAIL;
 		}
 
-		/* field is a number type */
-		if(field->type != TYPE_STRING && field->type != TYPE_LIST) {
-			char *str = mcfg_data_to_string(*field);
-			const size_t str_len = strlen(str);
+		for(size_t ix = 0; ix < memo->capacity; ix++) {
+			if(memo->entries[ix].field == NULL) {
+				continue;
+			}
 
-			APPEND_CHECK(res.formatted, res.formatted_size,
-						 write_offs + str_len);
+			size_t slot = _memo_slot(capacity, memo->entries[ix].field);
+			while(entries[slot].field != NULL) {
+				slot = (slot + 1) & (capacity - 1);
+			}
 
-			memcpy(res.formatted + write_offs, str, str_len);
-			write_offs += str_len;
-			free(str);
-			continue;
+			entries[slot] = memo->entries[ix];
 		}
 
-		mcfg_fmt_res_t subformat_res;
+		free(memo->entries);
+		memo->entries = entries;
+		memo->capacity = capacity;
+	}
 
-		/* "sub-"format the field before appending */
-		if(field->type == TYPE_LIST) {
-			char *prefix = remove_newline(
-				bstrcpy_until(input + embed.pos - 1, input, ' '));
-			ERR_CHECK(prefix != NULL, MCFG_FMT_NULLPTR);
+	size_t slot = _memo_slot(memo->capacity, field);
+	while(memo->entries[slot].field != NULL) {
+		slot = (slot + 1) & (memo->capacity - 1);
+	}
 
-			char *postfix =
-				remove_newline(strcpy_until(input + embed.src_end_pos, ' '));
-			ERR_CHECK(postfix != NULL, MCFG_FMT_NULLPTR);
+	memo->entries[slot] = (_memo_entry_t){.field = field, .tmpl = tmpl};
+	memo->count++;
 
-			/* Move write_offs back to position of last space + 1
-			 * and set cpy_offs to position of next space
-			 */
-			cpy_offs = (size_t)(strchr(input + embed.src_end_pos, ' ') - input);
-			write_offs -= strlen(prefix);
+	return MCFG_FMT_OK;
+}
+
+/**
+ * @brief Hands ownership of a nested template to the root template.
+ */
+mcfg_fmt_err_t
+_adopt(mcfg_template_t *root, mcfg_template_t *nested)
+{
+	if((root->owned_count & (root->owned_count - 1)) == 0) {
+		const size_t capacity =
+			root->owned_count == 0 ? 1 : root->owned_count * 2;
+		mcfg_template_t **owned =
+			realloc(root->owned, sizeof(*root->owned) * capacity);
+		if(owned == NULL) {
+			return MCFG_FMT_MALLOC_FAIL;
+		}
 
-			char *list =
-				mcfg_format_list(*mcfg_data_as_list(*field), prefix, postfix);
+		root->owned = owned;
+	}
 
-			free(prefix);
-			free(postfix);
-			ERR_CHECK(list != NULL, MCFG_FMT_NULLPTR);
+	root->owned[root->owned_count] = nested;
+	root->owned_count++;
 
-			subformat_res = mcfg_format_field_embeds_str(list, file, rel);
+	return MCFG_FMT_OK;
+}
 
-			free(list);
-		} else if(field->type == TYPE_STRING) {
-			subformat_res = mcfg_format_field_embeds(*field, file, rel);
+/**
+ * @brief Frees a template without freeing the templates it owns.
+ */
+void
+_free_template(mcfg_template_t *tmpl)
+{
+	for(size_t ix = 0; ix < tmpl->segment_count; ix++) {
+		if(tmpl->segments[ix].type == MCFG_TEMPLATE_SEGMENT_DYNFIELD) {
+			free(tmpl->segments[ix].dynfield.name);
 		}
+	}
 
-		ERR_CHECK(subformat_res.err == MCFG_FMT_OK, subformat_res.err);
+	if(tmpl->owns_source) {
+		free(tmpl->source);
+	}
+
+	free(tmpl->segments);
+	free(tmpl->owned);
+	free(tmpl);
+}
+
+/**
+ * @brief Appends a literal segment for the source text in the range
+ * [start, end). Empty literals are skipped.
+ */
+void
+_append_literal(mcfg_template_t *tmpl, size_t start, size_t end)
+{
+	if(end <= start) {
+		return;
+	}
+
+	tmpl->segments[tmpl->segment_count] = (mcfg_template_segment_t){
+		.type = MCFG_TEMPLATE_SEGMENT_LITERAL,
+		.source_pos = start,
+		.literal = {.data = tmpl->source + start, .length = end - start},
+	};
+	tmpl->segment_count++;
+}
+
+/**
+ * @brief Removes the output of every segment which was created from source
+ * text at or after pos.
+ */
+void
+_drop_segments_from(mcfg_template_t *tmpl, size_t pos)
+{
+	while(tmpl->segment_count > 0 &&
+		  tmpl->segments[tmpl->segment_count - 1].source_pos >= pos) {
+		tmpl->segment_count--;
+
+		mcfg_template_segment_t dropped = tmpl->segments[tmpl->segment_count];
+		if(dropped.type == MCFG_TEMPLATE_SEGMENT_DYNFIELD) {
+			free(dropped.dynfield.name);
+		}
+	}
 
-		/* append "sub-"formatted field */
-		const size_t subformat_len = strlen(subformat_res.formatted);
-		APPEND_CHECK(res.formatted, res.formatted_size,
-					 write_offs + subformat_len);
-		memcpy(res.formatted + write_offs, subformat_res.formatted,
-			   subformat_len);
-		write_offs += subformat_len;
+	if(tmpl->segment_count == 0) {
+		return;
+	}
 
-		free(subformat_res.formatted);
+	mcfg_template_segment_t *last = &tmpl->segments[tmpl->segment_count - 1];
+	if(last->type == MCFG_TEMPLATE_SEGMENT_LITERAL &&
+	   last->source_pos + last->literal.length > pos) {
+		last->literal.length = pos - last->source_pos;
 	}
+}
 
-	/* copy remainder of input */
-	if(cpy_offs < strlen(input)) {
-		const size_t remaining = strlen(input) - cpy_offs;
-		APPEND_CHECK(res.formatted, res.formatted_size, write_offs + remaining);
-		memcpy(res.formatted + write_offs, input + cpy_offs, remaining);
-		write_offs += remaining;
+/**
+ * @brief Compiles the data of a string or list field while it is marked as
+ * being visited.
+ */
+mcfg_template_res_t
+_compile_visiting(_compile_ctx_t *ctx,
+				  const mcfg_field_t *field,
+				  const char *input)
+{
+	if(_is_visiting(ctx->visiting, field)) {
+		return (mcfg_template_res_t){.err = MCFG_FMT_EMBED_CYCLE};
 	}
 
-	APPEND_CHECK(res.formatted, res.formatted_size, write_offs + 1);
-	res.formatted[write_offs] = 0;
-	write_offs++;
+	_visit_t visit = {.field = field, .parent = ctx->visiting};
+	ctx->visiting = &visit;
 
-	/* trim buffer size */
-	res.formatted = FMTREALLOC(res.formatted, write_offs);
-	res.formatted_size = write_offs;
+	mcfg_template_res_t res = _compile(ctx, input);
 
+	ctx->visiting = visit.parent;
 	return res;
 }
 
-/* mcfg_format.h functions */
-
-mcfg_fmt_res_t
-mcfg_format_field_embeds(mcfg_field_t field,
-						 mcfg_file_t file,
-						 mcfg_path_t relativity)
+/**
+ * @brief Compiles a list embed. Every element of the list is surrounded by the
+ * text directly before and after the embed, up to the previous and next space.
+ * That text is removed from the surrounding output.
+ * @param cpy_offs Is set to the end of the text following the embed.
+ */
+mcfg_fmt_err_t
+_compile_list_embed(_compile_ctx_t *ctx,
+					mcfg_template_t *tmpl,
+					_embed_t embed,
+					mcfg_field_t *field,
+					size_t *cpy_offs)
 {
-	ERR_CHECK(field.data != NULL, MCFG_FMT_NULLPTR);
-	ERR_CHECK(field.type == TYPE_STRING, MCFG_FMT_INVALID_TYPE);
+	const mcfg_list_t *list = mcfg_data_as_list(*field);
+	if(list == NULL) {
+		return MCFG_FMT_NULLPTR;
+	}
 
-	char *input = mcfg_data_as_string(field);
-	return mcfg_format_field_embeds_str(input, file, relativity);
+	const char *source = tmpl->source;
+
+	size_t prefix_start = embed.pos;
+	while(prefix_start > 0 && source[prefix_start - 1] != ' ') {
+		prefix_start--;
+	}
+
+	size_t postfix_end = embed.src_end_pos;
+	while(source[postfix_end] != 0 && source[postfix_end] != ' ') {
+		postfix_end++;
+	}
+
+	const size_t prefix_len = embed.pos - prefix_start;
+	const size_t postfix_len = postfix_end - embed.src_end_pos;
+
+	char *prefix = remove_newline(strndup(source + prefix_start, prefix_len));
+	char *postfix =
+		remove_newline(strndup(source + embed.src_end_pos, postfix_len));
+
+	char *list_str = NULL;
+	if(prefix != NULL && postfix != NULL) {
+		list_str = mcfg_format_list(*list, prefix, postfix);
+	}
+
+	free(prefix);
+	free(postfix);
+
+	if(list_str == NULL) {
+		return MCFG_FMT_MALLOC_FAIL;
+	}
+
+	_drop_segments_from(tmpl, prefix_start);
+	*cpy_offs = postfix_end;
+
+	/* the expansion depends on the surrounding text, so it is not memoized */
+	mcfg_template_res_t nested = _compile_visiting(ctx, field, list_str);
+
+	/* a borrowing template keeps the expansion alive by taking it over */
+	if(nested.err == MCFG_FMT_OK && nested.value->source == list_str) {
+		nested.value->owns_source = true;
+	} else {
+		free(list_str);
+	}
+
+	if(nested.err != MCFG_FMT_OK) {
+		return nested.err;
+	}
+
+	tmpl->segments[tmpl->segment_count] = (mcfg_template_segment_t){
+		.type = MCFG_TEMPLATE_SEGMENT_TEMPLATE,
+		.source_pos = prefix_start,
+		.nested = nested.value,
+	};
+	tmpl->segment_count++;
+
+	return MCFG_FMT_OK;
 }
 
-mcfg_fmt_res_t
-mcfg_format_field_embeds_str(char *input,
-							 mcfg_file_t file,
-							 mcfg_path_t relativity)
+/**
+ * @brief Resolves a single embed and appends the segment for it.
+ * @param cpy_offs Position in the source after the embed, list embeds move
+ * it past the text following them.
+ */
+mcfg_fmt_err_t
+_compile_embed(_compile_ctx_t *ctx,
+			   mcfg_template_t *tmpl,
+			   _embed_t embed,
+			   size_t *cpy_offs)
 {
-	ERR_CHECK(input != NULL, MCFG_FMT_NULLPTR);
-	mcfg_fmt_res_t res;
+	const mcfg_path_view_t path = mcfg_parse_path_view_n(
+		tmpl->source + embed.name.offset, embed.name.length);
+	mcfg_field_t *field;
+
+	if(path.dynfield_path) {
+		size_t name_len;
+		const char *name = _dynfield_name(path, ctx->rel, &name_len);
+
+		field = _get_dynfield(ctx->file, ctx->scope, name, name_len);
+
+		/* lists depend on the text surrounding the embed, so they have to be
+		 * compiled right away. Everything else is looked up when rendering.
+		 */
+		if(field == NULL || field->type != TYPE_LIST) {
+			char *name_copy = strndup(name, name_len);
+			if(name_copy == NULL) {
+				return MCFG_FMT_MALLOC_FAIL;
+			}
+
+			tmpl->segments[tmpl->segment_count] = (mcfg_template_segment_t){
+				.type = MCFG_TEMPLATE_SEGMENT_DYNFIELD,
+				.source_pos = embed.pos,
+				.dynfield = {.name = name_copy, .length = name_len},
+			};
+			tmpl->segment_count++;
+			return MCFG_FMT_OK;
+		}
+	} else {
+		field = _resolve_embed(ctx->file, path, ctx->rel);
+	}
 
-	/* Extract all embeds */
-	_embeds_t embeds = _extract_embeds(input);
-	if(embeds.err != MCFG_FMT_OK) {
-		res.err = embeds.err;
-		goto exit;
+	if(field != NULL && field->type == TYPE_LIST) {
+		return _compile_list_embed(ctx, tmpl, embed, field, cpy_offs);
+	}
+
+	mcfg_template_segment_t segment = {
+		.type = MCFG_TEMPLATE_SEGMENT_FIELD,
+		.source_pos = embed.pos,
+		.field = field,
+	};
+
+	if(field != NULL && field->type == TYPE_STRING) {
+		mcfg_template_t *nested = _memo_get(&ctx->memo, field);
+
+		if(nested == NULL) {
+			mcfg_template_res_t compiled =
+				_compile_visiting(ctx, field, mcfg_data_as_string(*field));
+			if(compiled.err != MCFG_FMT_OK) {
+				return compiled.err;
+			}
+
+			nested = compiled.value;
+
+			const mcfg_fmt_err_t err = _memo_put(&ctx->memo, field, nested);
+			if(err != MCFG_FMT_OK) {
+				return err;
+			}
+		}
+
+		segment.type = MCFG_TEMPLATE_SEGMENT_TEMPLATE;
+		segment.nested = nested;
 	}
 
-	res = _format(input, embeds, file, relativity);
+	tmpl->segments[tmpl->segment_count] = segment;
+	tmpl->segment_count++;
 
-exit:
-	_free__embeds(embeds);
-	return res;
+	return MCFG_FMT_OK;
+}
+
+/**
+ * @brief Compiles input into a template. The first template compiled with a
+ * context becomes its root, all further templates are owned by the root.
+ */
+mcfg_template_res_t
+_compile(_compile_ctx_t *ctx, const char *input)
+{
+	mcfg_template_res_t res = {.err = MCFG_FMT_OK, .value = NULL};
+	_embeds_t embeds = {.count = 0, .embeds = NULL};
+
+	if(input == NULL) {
+		res.err = MCFG_FMT_NULLPTR;
+		return res;
+	}
+
+	mcfg_template_t *tmpl = calloc(1, sizeof(*tmpl));
+	if(tmpl == NULL) {
+		res.err = MCFG_FMT_MALLOC_FAIL;
+		return res;
+	}
+
+	tmpl->file = ctx->file;
+	tmpl->relativity = ctx->rel;
+
+	if(ctx->root == NULL) {
+		ctx->root = tmpl;
+	} else {
+		res.err = _adopt(ctx->root, tmpl);
+		if(res.err != MCFG_FMT_OK) {
+			_free_template(tmpl);
+			return res;
+		}
+	}
+
+	if(ctx->borrow_sources) {
+		tmpl->source = (char *)input;
+	} else {
+		tmpl->source = strdup(input);
+		if(tmpl->source == NULL) {
+			res.err = MCFG_FMT_MALLOC_FAIL;
+			goto exit;
+		}
+
+		tmpl->owns_source = true;
+	}
+
+	embeds = _extract_embeds(tmpl->source);
+	if(embeds.err != MCFG_FMT_OK) {
+		res.err = embeds.err;
+		goto exit;
+	}
+
+	/* every embed produces at most one literal and one segment of its own */
+	tmpl->segments = malloc(sizeof(*tmpl->segments) * (embeds.count * 2 + 1));
+	if(tmpl->segments == NULL) {
+		res.err = MCFG_FMT_MALLOC_FAIL;
+		goto exit;
+	}
+
+	size_t cpy_offs = 0;
+	for(size_t ix = 0; ix < embeds.count; ix++) {
+		const _embed_t embed = embeds.embeds[ix];
+
+		/* the text following a list embed is consumed by the list */
+		if(embed.pos < cpy_offs) {
+			continue;
+		}
+
+		_append_literal(tmpl, cpy_offs, embed.pos);
+		cpy_offs = embed.src_end_pos;
+
+		if(embed.ignore_me) {
+			continue;
+		}
+
+		res.err = _compile_embed(ctx, tmpl, embed, &cpy_offs);
+		if(res.err != MCFG_FMT_OK) {
+			goto exit;
+		}
+	}
+
+	_append_literal(tmpl, cpy_offs, strlen(tmpl->source));
+
+	res.value = tmpl;
+
+exit:
+	_free__embeds(embeds);
+	return res;
+}
+
+/**
+ * @brief Compiles input into a new root template. On failure, everything
+ * compiled up to that point is freed.
+ */
+mcfg_template_res_t
+_compile_root(const char *input,
+			  mcfg_file_t *file,
+			  mcfg_path_t rel,
+			  const _visit_t *visiting,
+			  const mcfg_dyn_scope_t *scope,
+			  bool borrow_sources)
+{
+	_compile_ctx_t ctx = {
+		.file = file,
+		.rel = rel,
+		.root = NULL,
+		.memo = {0},
+		.visiting = visiting,
+		.scope = scope,
+		.borrow_sources = borrow_sources,
+	};
+
+	mcfg_template_res_t res = _compile(&ctx, input);
+	free(ctx.memo.entries);
+
+	if(res.err != MCFG_FMT_OK) {
+		mcfg_template_free(ctx.root);
+		res.value = NULL;
+	}
+
+	return res;
+}
+
+mcfg_fmt_err_t
+_buffer_sink(void *ctx, const char *data, size_t length)
+{
+	_buffer_sink_t *sink = ctx;
+	buffer_put(sink->buf, sink->cap, &sink->length, data, length);
+	return MCFG_FMT_OK;
+}
+
+/**
+ * @brief Emits the text representation of a fields data, without building
+ * the representation of lists as a whole.
+ */
+mcfg_fmt_err_t
+_emit_data(const mcfg_field_t *field, mcfg_fmt_sink_t sink, void *sink_ctx)
+{
+	if(field->type == TYPE_STRING) {
+		const char *value = mcfg_data_as_string(*field);
+		return value == NULL ? MCFG_FMT_NULLPTR
+							 : sink(sink_ctx, value, strlen(value));
+	}
+
+	if(field->type == TYPE_LIST) {
+		const mcfg_list_t *list = mcfg_data_as_list(*field);
+		if(list == NULL) {
+			return MCFG_FMT_NULLPTR;
+		}
+
+		mcfg_fmt_err_t err = MCFG_FMT_OK;
+		for(size_t ix = 0; ix < list->field_count && err == MCFG_FMT_OK;
+			ix++) {
+			if(ix > 0) {
+				err = sink(sink_ctx, ", ", 2);
+			}
+
+			if(err == MCFG_FMT_OK) {
+				err = _emit_data(&list->fields[ix], sink, sink_ctx);
+			}
+		}
+
+		return err;
+	}
+
+	char number[MCFG_NUMBER_BUFFER_SIZE];
+	const size_t length = mcfg_data_to_buffer(*field, number, sizeof(number));
+	return sink(sink_ctx, number, length);
+}
+
+/**
+ * @brief Renders a field which was either resolved while compiling or is a
+ * dynfield which was looked up for this render.
+ */
+mcfg_fmt_err_t
+_render_field(const mcfg_template_t *tmpl,
+			  const mcfg_field_t *field,
+			  const _render_ctx_t *rctx,
+			  const _visit_t *visiting)
+{
+	if(field == NULL) {
+		return rctx->sink(rctx->sink_ctx, FIELD_PLACEHOLDER,
+						  sizeof(FIELD_PLACEHOLDER) - 1);
+	}
+
+	/* only dynfields can still be strings at this point, they can change
+	 * between renders and have to be compiled every time if they contain
+	 * embeds or escapes.
+	 */
+	if(field->type == TYPE_STRING) {
+		const char *value = mcfg_data_as_string(*field);
+		if(value == NULL) {
+			return MCFG_FMT_NULLPTR;
+		}
+
+		if(strpbrk(value, "$\\") == NULL) {
+			return rctx->sink(rctx->sink_ctx, value, strlen(value));
+		}
+
+		if(_is_visiting(visiting, field)) {
+			return MCFG_FMT_EMBED_CYCLE;
+		}
+
+		const _visit_t visit = {.field = field, .parent = visiting};
+
+		mcfg_template_res_t nested = _compile_root(
+			value, rctx->file, tmpl->relativity, &visit, rctx->scope, true);
+		if(nested.err != MCFG_FMT_OK) {
+			return nested.err;
+		}
+
+		const mcfg_fmt_err_t err = _render(nested.value, rctx, &visit);
+		mcfg_template_free(nested.value);
+		return err;
+	}
+
+	return _emit_data(field, rctx->sink, rctx->sink_ctx);
+}
+
+/**
+ * @brief Emits every segment of tmpl to sink.
+ */
+mcfg_fmt_err_t
+_render(const mcfg_template_t *tmpl,
+		const _render_ctx_t *rctx,
+		const _visit_t *visiting)
+{
+	mcfg_fmt_err_t err = MCFG_FMT_OK;
+
+	for(size_t ix = 0; ix < tmpl->segment_count && err == MCFG_FMT_OK; ix++) {
+		const mcfg_template_segment_t *segment = &tmpl->segments[ix];
+
+		switch(segment->type) {
+			case MCFG_TEMPLATE_SEGMENT_LITERAL:
+				err = rctx->sink(rctx->sink_ctx, segment->literal.data,
+								 segment->literal.length);
+				break;
+			case MCFG_TEMPLATE_SEGMENT_FIELD:
+				err = _render_field(tmpl, segment->field, rctx, visiting);
+				break;
+			case MCFG_TEMPLATE_SEGMENT_DYNFIELD: {
+				const mcfg_field_t *dynfield =
+					_get_dynfield(tmpl->file, rctx->scope,
+								  segment->dynfield.name,
+								  segment->dynfield.length);
+				err = _render_field(tmpl, dynfield, rctx, visiting);
+				break;
+			}
+			case MCFG_TEMPLATE_SEGMENT_TEMPLATE:
+				err = _render(segment->nested, rctx, visiting);
+				break;
+		}
+	}
+
+	return err;
+}
+
+mcfg_fmt_err_t
+_arena_reserve(_arena_t *arena, size_t capacity)
+{
+	if(capacity <= arena->capacity) {
+		return MCFG_FMT_OK;
+	}
+
+	char *data = realloc(arena->data, capacity);
+	if(data == NULL) {
+		return MCFG_FMT_MALLOC_FAIL;
+	}
+
+	arena->data = data;
+	arena->capacity = capacity;
+	return MCFG_FMT_OK;
+}
+
+mcfg_fmt_err_t
+_arena_sink(void *ctx, const char *data, size_t length)
+{
+	_arena_t *arena = ctx;
+
+	if(arena->length + length > arena->capacity) {
+		size_t capacity = arena->capacity == 0 ? 64 : arena->capacity * 2;
+		if(capacity < arena->length + length) {
+			capacity = arena->length + length;
+		}
+
+		const mcfg_fmt_err_t err = _arena_reserve(arena, capacity);
+		if(err != MCFG_FMT_OK) {
+			return err;
+		}
+	}
+
+	memcpy(arena->data + arena->length, data, length);
+	arena->length += length;
+	return MCFG_FMT_OK;
+}
+
+/**
+ * @brief Renders tmpl into a heap allocated string of the exact size, by
+ * rendering once to measure and once to write.
+ */
+mcfg_fmt_res_t
+_render_alloc(const mcfg_template_t *tmpl,
+			  const mcfg_dyn_scope_t *scope,
+			  mcfg_file_t *file)
+{
+	_buffer_sink_t buffer = {.buf = NULL, .cap = 0, .length = 0};
+	const _render_ctx_t rctx = {
+		.sink = _buffer_sink,
+		.sink_ctx = &buffer,
+		.scope = scope,
+		.file = file,
+	};
+
+	mcfg_fmt_err_t err = _render(tmpl, &rctx, NULL);
+	ERR_CHECK(err == MCFG_FMT_OK, err);
+
+	mcfg_fmt_res_t res = {
+		.err = MCFG_FMT_OK,
+		.formatted_size = buffer.length + 1,
+		.formatted = FMTMALLOC(buffer.length + 1),
+	};
+
+	res.formatted[0] = 0;
+	buffer = (_buffer_sink_t){
+		.buf = res.formatted, .cap = res.formatted_size, .length = 0};
+
+	err = _render(tmpl, &rctx, NULL);
+	if(err != MCFG_FMT_OK) {
+		free(res.formatted);
+		ERR_CHECK(false, err);
+	}
+
+	return res;
+}
+
+mcfg_fmt_res_t
+_format_str(char *input,
+			mcfg_file_t *file,
+			mcfg_path_t relativity,
+			const mcfg_dyn_scope_t *scope)
+{
+	ERR_CHECK(input != NULL, MCFG_FMT_NULLPTR);
+
+	/* the template only lives for this call, so it can borrow its input */
+	mcfg_template_res_t compiled =
+		_compile_root(input, file, relativity, NULL, scope, true);
+	ERR_CHECK(compiled.err == MCFG_FMT_OK, compiled.err);
+
+	mcfg_fmt_res_t res = _render_alloc(compiled.value, scope, file);
+	mcfg_template_free(compiled.value);
+	return res;
+}
+
+/**
+ * @brief Formats input straight into a buffer, without compiling a template
+ * and without allocating. This is only possible if every embed resolves to a
+ * scalar or to a string without embeds or escapes.
+ * @return false if input needs a template, the contents of the buffer are
+ * undefined in that case.
+ */
+bool
+_format_direct(const char *input,
+			   mcfg_file_t *file,
+			   mcfg_path_t rel,
+			   _buffer_sink_t *buffer)
+{
+	_scan_t scan = _scan_start(input);
+	_embed_t embed;
+	size_t cpy_offs = 0;
+
+	while(_next_embed(&scan, &embed)) {
+		buffer_put(buffer->buf, buffer->cap, &buffer->length,
+				   input + cpy_offs, embed.pos - cpy_offs);
+		cpy_offs = embed.src_end_pos;
+
+		if(embed.ignore_me) {
+			continue;
+		}
+
+		const mcfg_path_view_t path = mcfg_parse_path_view_n(
+			input + embed.name.offset, embed.name.length);
+
+		mcfg_field_t *field;
+		if(path.dynfield_path) {
+			size_t name_len;
+			const char *name = _dynfield_name(path, rel, &name_len);
+			field = mcfg_get_dynfield_n(file, name, name_len);
+		} else {
+			field = _resolve_embed(file, path, rel);
+		}
+
+		if(field == NULL) {
+			buffer_put(buffer->buf, buffer->cap, &buffer->length,
+					   FIELD_PLACEHOLDER, sizeof(FIELD_PLACEHOLDER) - 1);
+			continue;
+		}
+
+		/* lists depend on the surrounding text and strings can contain
+		 * further embeds, both need a template
+		 */
+		if(field->type == TYPE_LIST) {
+			return false;
+		}
+
+		if(field->type == TYPE_STRING) {
+			const char *value = mcfg_data_as_string(*field);
+			if(value == NULL || strpbrk(value, "$\\") != NULL) {
+				return false;
+			}
+		}
+
+		_emit_data(field, _buffer_sink, buffer);
+	}
+
+	buffer_put(buffer->buf, buffer->cap, &buffer->length, input + cpy_offs,
+			   (scan.end - input) - cpy_offs);
+	return true;
+}
+
+/**
+ * @brief A section formatted as one unit of work by mcfg_format_file.
+ */
+typedef struct _file_fmt_unit {
+	mcfg_sector_t *sector;
+	mcfg_section_t *section;
+
+	/** @brief Index of the sections first string field in the result */
+	size_t first_field;
+} _file_fmt_unit_t;
+
+typedef struct _file_fmt_job {
+	mcfg_file_t *file;
+
+	size_t unit_count;
+	_file_fmt_unit_t *units;
+
+	/** @brief The next unit to be picked up by a worker */
+	size_t next_unit;
+
+	mcfg_formatted_field_t *out;
+} _file_fmt_job_t;
+
+/**
+ * @brief Formats all string fields of a section. All fields share a single
+ * compilation context, so fields embedded by multiple other fields of the
+ * section are only compiled once.
+ */
+void
+_format_section(_file_fmt_job_t *job, _file_fmt_unit_t unit)
+{
+	_compile_ctx_t ctx = {
+		.file = job->file,
+		.rel =
+			{
+				.absolute = true,
+				.sector = unit.sector->name,
+				.section = unit.section->name,
+			},
+		.root = NULL,
+		.memo = {0},
+		.visiting = NULL,
+		.scope = NULL,
+		.borrow_sources = true,
+	};
+
+	/* empty root template which owns every template of the section */
+	const mcfg_fmt_err_t root_err = _compile(&ctx, "").err;
+
+	mcfg_formatted_field_t *out = job->out + unit.first_field;
+	for(size_t ix = 0; ix < unit.section->field_count; ix++) {
+		mcfg_field_t *field = &unit.section->fields[ix];
+		if(field->type != TYPE_STRING) {
+			continue;
+		}
+
+		out->field = field;
+		out->err = root_err;
+
+		mcfg_template_t *tmpl = NULL;
+		if(out->err == MCFG_FMT_OK) {
+			tmpl = _memo_get(&ctx.memo, field);
+		}
+
+		if(out->err == MCFG_FMT_OK && tmpl == NULL) {
+			mcfg_template_res_t compiled =
+				_compile_visiting(&ctx, field, mcfg_data_as_string(*field));
+
+			out->err = compiled.err;
+			if(out->err == MCFG_FMT_OK) {
+				tmpl = compiled.value;
+				out->err = _memo_put(&ctx.memo, field, tmpl);
+			}
+		}
+
+		if(out->err == MCFG_FMT_OK) {
+			mcfg_fmt_res_t rendered = _render_alloc(tmpl, NULL, tmpl->file);
+			out->err = rendered.err;
+			out->formatted = rendered.formatted;
+		}
+
+		out++;
+	}
+
+	free(ctx.memo.entries);
+	mcfg_template_free(ctx.root);
+}
+
+void *
+_format_file_worker(void *arg)
+{
+	_file_fmt_job_t *job = arg;
+
+	for(;;) {
+		const size_t ix =
+			__atomic_fetch_add(&job->next_unit, 1, __ATOMIC_RELAXED);
+		if(ix >= job->unit_count) {
+			break;
+		}
+
+		_format_section(job, job->units[ix]);
+	}
+
+	return NULL;
+}
+
+int
+_dep_node_cmp(const void *a, const void *b)
+{
+	const uintptr_t field_a = (uintptr_t)((mcfg_fmt_dep_node_t *)a)->field;
+	const uintptr_t field_b = (uintptr_t)((mcfg_fmt_dep_node_t *)b)->field;
+	return (field_a > field_b) - (field_a < field_b);
+}
+
+/**
+ * @brief Finds the node of a field by binary search.
+ * @return The index of the node, deps->node_count if there is none.
+ */
+size_t
+_find_node(const mcfg_fmt_deps_t *deps, const mcfg_field_t *field)
+{
+	size_t low = 0;
+	size_t high = deps->node_count;
+
+	while(low < high) {
+		const size_t mid = low + (high - low) / 2;
+		const mcfg_field_t *mid_field = deps->nodes[mid].field;
+
+		if(mid_field == field) {
+			return mid;
+		}
+
+		if((uintptr_t)mid_field < (uintptr_t)field) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return deps->node_count;
+}
+
+/**
+ * @brief Records that node from embeds node to. Duplicate embeds of the
+ * same field are only recorded once.
+ */
+mcfg_fmt_err_t
+_add_dependency(mcfg_fmt_deps_t *deps, size_t from, size_t to)
+{
+	mcfg_fmt_dep_node_t *node = &deps->nodes[from];
+	for(size_t ix = 0; ix < node->embed_count; ix++) {
+		if(node->embeds[ix] == to) {
+			return MCFG_FMT_OK;
+		}
+	}
+
+	size_t *embeds =
+		realloc(node->embeds, sizeof(*embeds) * (node->embed_count + 1));
+	if(embeds == NULL) {
+		return MCFG_FMT_MALLOC_FAIL;
+	}
+
+	node->embeds = embeds;
+	node->embeds[node->embed_count] = to;
+	node->embed_count++;
+
+	mcfg_fmt_dep_node_t *target = &deps->nodes[to];
+	if(target->dependent_count == target->dependent_capacity) {
+		const size_t capacity = target->dependent_capacity == 0
+									? 4
+									: target->dependent_capacity * 2;
+
+		size_t *dependents =
+			realloc(target->dependents, sizeof(*dependents) * capacity);
+		if(dependents == NULL) {
+			return MCFG_FMT_MALLOC_FAIL;
+		}
+
+		target->dependents = dependents;
+		target->dependent_capacity = capacity;
+	}
+
+	target->dependents[target->dependent_count] = from;
+	target->dependent_count++;
+
+	return MCFG_FMT_OK;
+}
+
+/**
+ * @brief Whether node from already has an edge to node to.
+ */
+bool
+_has_dependency(const mcfg_fmt_deps_t *deps, size_t from, size_t to)
+{
+	const mcfg_fmt_dep_node_t *node = &deps->nodes[from];
+	for(size_t ix = 0; ix < node->embed_count; ix++) {
+		if(node->embeds[ix] == to) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* indexing recurses through the fields reached by embeds */
+mcfg_fmt_err_t _index_field(mcfg_fmt_deps_t *deps,
+							size_t root_ix,
+							const mcfg_field_t *field);
+
+/**
+ * @brief Adds every field reached from the embeds in text to the root node.
+ * Embeds are resolved against the relativity of the root, the same way the
+ * renderer resolves the embeds of nested fields. Embeds which can not be
+ * resolved are skipped.
+ */
+mcfg_fmt_err_t
+_index_text(mcfg_fmt_deps_t *deps, size_t root_ix, char *text)
+{
+	if(text == NULL) {
+		return MCFG_FMT_OK;
+	}
+
+	_embeds_t embeds = _extract_embeds(text);
+	mcfg_fmt_err_t err = embeds.err;
+
+	const mcfg_path_t rel = deps->nodes[root_ix].relativity;
+
+	for(size_t ix = 0; ix < embeds.count && err == MCFG_FMT_OK; ix++) {
+		if(embeds.embeds[ix].ignore_me) {
+			continue;
+		}
+
+		const mcfg_path_view_t path = mcfg_parse_path_view_n(
+			text + embeds.embeds[ix].name.offset,
+			embeds.embeds[ix].name.length);
+
+		mcfg_field_t *field;
+		if(path.dynfield_path) {
+			size_t name_len;
+			const char *name = _dynfield_name(path, rel, &name_len);
+			field = _get_dynfield(deps->file, NULL, name, name_len);
+		} else {
+			field = _resolve_embed(deps->file, path, rel);
+		}
+
+		/* every field is only followed once per root, which also stops at
+		 * embed cycles
+		 */
+		const size_t target = _find_node(deps, field);
+		if(target == deps->node_count || target == root_ix ||
+		   _has_dependency(deps, root_ix, target)) {
+			continue;
+		}
+
+		err = _add_dependency(deps, root_ix, target);
+		if(err == MCFG_FMT_OK) {
+			err = _index_field(deps, root_ix, field);
+		}
+	}
+
+	_free__embeds(embeds);
+	return err;
+}
+
+/**
+ * @brief Adds every field reached from the embeds in the data of field to
+ * the root node. Only strings and string lists can contain embeds.
+ */
+mcfg_fmt_err_t
+_index_field(mcfg_fmt_deps_t *deps, size_t root_ix, const mcfg_field_t *field)
+{
+	if(field->type == TYPE_STRING) {
+		return _index_text(deps, root_ix, mcfg_data_as_string(*field));
+	}
+
+	if(field->type != TYPE_LIST) {
+		return MCFG_FMT_OK;
+	}
+
+	const mcfg_list_t *list = mcfg_data_as_list(*field);
+	if(list == NULL || list->type != TYPE_STRING) {
+		return MCFG_FMT_OK;
+	}
+
+	mcfg_fmt_err_t err = MCFG_FMT_OK;
+	for(size_t ix = 0; ix < list->field_count && err == MCFG_FMT_OK; ix++) {
+		err = _index_text(deps, root_ix,
+						  mcfg_data_as_string(list->fields[ix]));
+	}
+
+	return err;
+}
+
+/**
+ * @brief Indexes the embeds of a section field, including the embeds of all
+ * fields it reaches through them.
+ */
+mcfg_fmt_err_t
+_index_node(mcfg_fmt_deps_t *deps, size_t node_ix)
+{
+	/* dynfields are resolved relative to the field embedding them, so they
+	 * are indexed as part of every field which reaches them
+	 */
+	if(deps->nodes[node_ix].relativity.sector == NULL) {
+		return MCFG_FMT_OK;
+	}
+
+	return _index_field(deps, node_ix, deps->nodes[node_ix].field);
+}
+
+/**
+ * @brief Removes the embeds of a node from the index.
+ */
+void
+_unindex_node(mcfg_fmt_deps_t *deps, size_t node_ix)
+{
+	mcfg_fmt_dep_node_t *node = &deps->nodes[node_ix];
+
+	for(size_t ix = 0; ix < node->embed_count; ix++) {
+		mcfg_fmt_dep_node_t *target = &deps->nodes[node->embeds[ix]];
+
+		for(size_t dep_ix = 0; dep_ix < target->dependent_count; dep_ix++) {
+			if(target->dependents[dep_ix] != node_ix) {
+				continue;
+			}
+
+			target->dependent_count--;
+			target->dependents[dep_ix] =
+				target->dependents[target->dependent_count];
+			break;
+		}
+	}
+
+	free(node->embeds);
+	node->embeds = NULL;
+	node->embed_count = 0;
+}
+
+/**
+ * @brief Collects the node at start and all its dependents. Every node has an
+ * edge to every field it reaches, so the direct dependents are complete.
+ * @param out Receives the node indices, has to hold deps->node_count
+ * elements.
+ * @return The amount of nodes written to out.
+ */
+size_t
+_collect_dependents(const mcfg_fmt_deps_t *deps, size_t start, size_t *out)
+{
+	const mcfg_fmt_dep_node_t *node = &deps->nodes[start];
+
+	out[0] = start;
+	memcpy(out + 1, node->dependents,
+		   sizeof(*out) * node->dependent_count);
+
+	return node->dependent_count + 1;
+}
+
+/* mcfg_format.h functions */
+
+mcfg_fmt_res_t
+mcfg_format_field_embeds(mcfg_field_t field,
+						 mcfg_file_t file,
+						 mcfg_path_t relativity)
+{
+	ERR_CHECK(field.data != NULL, MCFG_FMT_NULLPTR);
+	ERR_CHECK(field.type == TYPE_STRING, MCFG_FMT_INVALID_TYPE);
+
+	char *input = mcfg_data_as_string(field);
+	return mcfg_format_field_embeds_str(input, file, relativity);
+}
+
+mcfg_fmt_res_t
+mcfg_format_field_embeds_str(char *input,
+							 mcfg_file_t file,
+							 mcfg_path_t relativity)
+{
+	STATS_BEGIN(format_start);
+	mcfg_fmt_res_t res = _format_str(input, &file, relativity, NULL);
+	STATS_END(STATS_FORMAT, format_start);
+
+	return res;
+}
+
+mcfg_fmt_err_t
+mcfg_format_field_embeds_into(char *buf,
+							  size_t cap,
+							  size_t *length,
+							  char *input,
+							  mcfg_file_t file,
+							  mcfg_path_t relativity)
+{
+	if(input == NULL || length == NULL || (buf == NULL && cap > 0)) {
+		return MCFG_FMT_NULLPTR;
+	}
+
+	if(cap > 0) {
+		buf[0] = 0;
+	}
+
+	STATS_BEGIN(format_start);
+
+	_buffer_sink_t buffer = {.buf = buf, .cap = cap, .length = 0};
+	if(_format_direct(input, &file, relativity, &buffer)) {
+		STATS_END(STATS_FORMAT, format_start);
+
+		*length = buffer.length;
+		return MCFG_FMT_OK;
+	}
+
+	if(cap > 0) {
+		buf[0] = 0;
+	}
+
+	buffer.length = 0;
+	const mcfg_fmt_err_t err = mcfg_format_field_embeds_to(
+		_buffer_sink, &buffer, input, file, relativity);
+
+	STATS_END(STATS_FORMAT, format_start);
+
+	*length = buffer.length;
+	return err;
+}
+
+mcfg_fmt_res_t
+mcfg_format_field_embeds_scoped(char *input,
+								mcfg_file_t file,
+								mcfg_path_t relativity,
+								const mcfg_dyn_scope_t *scope)
+{
+	/* file is a copy, dropping the path cache only affects this call */
+	file.path_cache = NULL;
+
+	STATS_BEGIN(format_start);
+	mcfg_fmt_res_t res = _format_str(input, &file, relativity, scope);
+	STATS_END(STATS_FORMAT, format_start);
+
+	return res;
+}
+
+mcfg_template_res_t
+mcfg_template_compile(const char *input,
+					  mcfg_file_t *file,
+					  mcfg_path_t relativity)
+{
+	mcfg_template_res_t res = {.err = MCFG_FMT_MALLOC_FAIL, .value = NULL};
+
+	mcfg_path_t rel = relativity;
+	rel.sector = relativity.sector ? strdup(relativity.sector) : NULL;
+	rel.section = relativity.section ? strdup(relativity.section) : NULL;
+	rel.field = relativity.field ? strdup(relativity.field) : NULL;
+
+	if((relativity.sector != NULL && rel.sector == NULL) ||
+	   (relativity.section != NULL && rel.section == NULL) ||
+	   (relativity.field != NULL && rel.field == NULL)) {
+		mcfg_free_path(rel);
+		return res;
+	}
+
+	res = _compile_root(input, file, rel, NULL, NULL, false);
+	if(res.err != MCFG_FMT_OK) {
+		mcfg_free_path(rel);
+		return res;
+	}
+
+	res.value->owns_relativity = true;
+	return res;
+}
+
+mcfg_fmt_res_t
+mcfg_template_render(const mcfg_template_t *tmpl)
+{
+	ERR_CHECK(tmpl != NULL, MCFG_FMT_NULLPTR);
+
+	STATS_BEGIN(format_start);
+	mcfg_fmt_res_t res = _render_alloc(tmpl, NULL, tmpl->file);
+	STATS_END(STATS_FORMAT, format_start);
+
+	return res;
+}
+
+mcfg_fmt_res_t
+mcfg_template_render_scoped(const mcfg_template_t *tmpl,
+							const mcfg_dyn_scope_t *scope)
+{
+	ERR_CHECK(tmpl != NULL, MCFG_FMT_NULLPTR);
+
+	mcfg_file_t view = *tmpl->file;
+	view.path_cache = NULL;
+
+	STATS_BEGIN(format_start);
+	mcfg_fmt_res_t res = _render_alloc(tmpl, scope, &view);
+	STATS_END(STATS_FORMAT, format_start);
+
+	return res;
+}
+
+mcfg_fmt_err_t
+mcfg_template_render_to_buffer(const mcfg_template_t *tmpl,
+							   char *buf,
+							   size_t cap,
+							   size_t *length)
+{
+	if(tmpl == NULL || length == NULL || (buf == NULL && cap > 0)) {
+		return MCFG_FMT_NULLPTR;
+	}
+
+	if(cap > 0) {
+		buf[0] = 0;
+	}
+
+	_buffer_sink_t buffer = {.buf = buf, .cap = cap, .length = 0};
+	const _render_ctx_t rctx = {
+		.sink = _buffer_sink,
+		.sink_ctx = &buffer,
+		.scope = NULL,
+		.file = tmpl->file,
+	};
+
+	STATS_BEGIN(format_start);
+	const mcfg_fmt_err_t err = _render(tmpl, &rctx, NULL);
+	STATS_END(STATS_FORMAT, format_start);
+
+	*length = buffer.length;
+	return err;
+}
+
+mcfg_fmt_err_t
+mcfg_template_render_to(const mcfg_template_t *tmpl,
+						mcfg_fmt_sink_t sink,
+						void *sink_ctx)
+{
+	if(tmpl == NULL || sink == NULL) {
+		return MCFG_FMT_NULLPTR;
+	}
+
+	const _render_ctx_t rctx = {
+		.sink = sink,
+		.sink_ctx = sink_ctx,
+		.scope = NULL,
+		.file = tmpl->file,
+	};
+
+	STATS_BEGIN(format_start);
+	const mcfg_fmt_err_t err = _render(tmpl, &rctx, NULL);
+	STATS_END(STATS_FORMAT, format_start);
+
+	return err;
+}
+
+mcfg_fmt_err_t
+mcfg_format_field_embeds_to(mcfg_fmt_sink_t sink,
+							void *sink_ctx,
+							char *input,
+							mcfg_file_t file,
+							mcfg_path_t relativity)
+{
+	if(sink == NULL || input == NULL) {
+		return MCFG_FMT_NULLPTR;
+	}
+
+	STATS_BEGIN(format_start);
+
+	mcfg_template_res_t compiled =
+		_compile_root(input, &file, relativity, NULL, NULL, true);
+	if(compiled.err != MCFG_FMT_OK) {
+		STATS_END(STATS_FORMAT, format_start);
+		return compiled.err;
+	}
+
+	const _render_ctx_t rctx = {
+		.sink = sink,
+		.sink_ctx = sink_ctx,
+		.scope = NULL,
+		.file = &file,
+	};
+
+	const mcfg_fmt_err_t err = _render(compiled.value, &rctx, NULL);
+	mcfg_template_free(compiled.value);
+
+	STATS_END(STATS_FORMAT, format_start);
+	return err;
+}
+
+mcfg_fmt_err_t
+mcfg_fmt_sink_file(void *ctx, const char *data, size_t length)
+{
+	if(fwrite(data, 1, length, (FILE *)ctx) != length) {
+		return (mcfg_fmt_err_t)(errno | MCFG_OS_ERROR_MASK);
+	}
+
+	return MCFG_FMT_OK;
+}
+
+mcfg_fmt_err_t
+mcfg_fmt_sink_fd(void *ctx, const char *data, size_t length)
+{
+	const int fd = *(int *)ctx;
+
+	while(length > 0) {
+		const ssize_t written = write(fd, data, length);
+		if(written < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			return (mcfg_fmt_err_t)(errno | MCFG_OS_ERROR_MASK);
+		}
+
+		data += written;
+		length -= written;
+	}
+
+	return MCFG_FMT_OK;
+}
+
+mcfg_fmt_err_t
+mcfg_fmt_sink_string(void *ctx, const char *data, size_t length)
+{
+	return (mcfg_fmt_err_t)mcfg_string_append_n((mcfg_string_t **)ctx, data,
+												length);
+}
+
+void
+mcfg_template_free(mcfg_template_t *tmpl)
+{
+	if(tmpl == NULL) {
+		return;
+	}
+
+	for(size_t ix = 0; ix < tmpl->owned_count; ix++) {
+		_free_template(tmpl->owned[ix]);
+	}
+
+	if(tmpl->owns_relativity) {
+		mcfg_free_path(tmpl->relativity);
+	}
+
+	_free_template(tmpl);
+}
+
+mcfg_file_fmt_res_t
+mcfg_format_file(mcfg_file_t *file, size_t nthreads)
+{
+	mcfg_file_fmt_res_t res = {
+		.err = MCFG_FMT_OK, .field_count = 0, .fields = NULL};
+
+	if(file == NULL) {
+		res.err = MCFG_FMT_NULLPTR;
+		return res;
+	}
+
+	/* the path cache is not thread-safe, so the workers use a view of the
+	 * file without it.
+	 */
+	mcfg_file_t view = *file;
+	view.path_cache = NULL;
+
+	_file_fmt_job_t job = {.file = &view, .unit_count = 0, .next_unit = 0};
+
+	size_t section_count = 0;
+	for(size_t sector_ix = 0; sector_ix < file->sector_count; sector_ix++) {
+		section_count += file->sectors[sector_ix].section_count;
+	}
+
+	job.units = malloc(sizeof(*job.units) * (section_count + 1));
+	if(job.units == NULL) {
+		res.err = MCFG_FMT_MALLOC_FAIL;
+		return res;
+	}
+
+	for(size_t sector_ix = 0; sector_ix < file->sector_count; sector_ix++) {
+		mcfg_sector_t *sector = &file->sectors[sector_ix];
+
+		for(size_t ix = 0; ix < sector->section_count; ix++) {
+			mcfg_section_t *section = &sector->sections[ix];
+
+			size_t string_count = 0;
+			for(size_t field_ix = 0; field_ix < section->field_count;
+				field_ix++) {
+				string_count += section->fields[field_ix].type == TYPE_STRING;
+			}
+
+			if(string_count == 0) {
+				continue;
+			}
+
+			job.units[job.unit_count] = (_file_fmt_unit_t){
+				.sector = sector,
+				.section = section,
+				.first_field = res.field_count,
+			};
+			job.unit_count++;
+			res.field_count += string_count;
+		}
+	}
+
+	res.fields = calloc(res.field_count + 1, sizeof(*res.fields));
+	if(res.fields == NULL) {
+		free(job.units);
+		res.field_count = 0;
+		res.err = MCFG_FMT_MALLOC_FAIL;
+		return res;
+	}
+
+	job.out = res.fields;
+
+	STATS_BEGIN(format_start);
+
+	if(nthreads == 0) {
+		const long online = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = online > 0 ? (size_t)online : 1;
+	}
+
+	if(nthreads > job.unit_count) {
+		nthreads = job.unit_count;
+	}
+
+	/* the calling thread is a worker as well */
+	size_t started = 0;
+	pthread_t *threads = NULL;
+	if(nthreads > 1) {
+		threads = malloc(sizeof(*threads) * (nthreads - 1));
+	}
+
+	if(threads != NULL) {
+		for(; started < nthreads - 1; started++) {
+			if(pthread_create(&threads[started], NULL, _format_file_worker,
+							  &job) != 0) {
+				break;
+			}
+		}
+	}
+
+	_format_file_worker(&job);
+
+	for(size_t ix = 0; ix < started; ix++) {
+		pthread_join(threads[ix], NULL);
+	}
+
+	free(threads);
+	free(job.units);
+
+	STATS_END(STATS_FORMAT, format_start);
+
+	for(size_t ix = 0; ix < res.field_count; ix++) {
+		if(res.fields[ix].err != MCFG_FMT_OK) {
+			res.err = res.fields[ix].err;
+			break;
+		}
+	}
+
+	return res;
+}
+
+void
+mcfg_free_file_fmt_res(mcfg_file_fmt_res_t res)
+{
+	if(res.fields == NULL) {
+		return;
+	}
+
+	for(size_t ix = 0; ix < res.field_count; ix++) {
+		free(res.fields[ix].formatted);
+	}
+
+	free(res.fields);
+}
+
+mcfg_fmt_err_t
+mcfg_fmt_deps_build(mcfg_fmt_deps_t *deps, mcfg_file_t *file)
+{
+	if(deps == NULL || file == NULL) {
+		return MCFG_FMT_NULLPTR;
+	}
+
+	*deps = (mcfg_fmt_deps_t){.file = file, .node_count = 0, .nodes = NULL};
+
+	size_t node_count = file->dynfield_count;
+	for(size_t sector_ix = 0; sector_ix < file->sector_count; sector_ix++) {
+		const mcfg_sector_t *sector = &file->sectors[sector_ix];
+
+		for(size_t ix = 0; ix < sector->section_count; ix++) {
+			node_count += sector->sections[ix].field_count;
+		}
+	}
+
+	deps->nodes = calloc(node_count + 1, sizeof(*deps->nodes));
+	if(deps->nodes == NULL) {
+		return MCFG_FMT_MALLOC_FAIL;
+	}
+
+	for(size_t ix = 0; ix < file->dynfield_count; ix++) {
+		deps->nodes[deps->node_count].field = &file->dynfields[ix];
+		deps->nodes[deps->node_count].relativity.absolute = true;
+		deps->node_count++;
+	}
+
+	for(size_t sector_ix = 0; sector_ix < file->sector_count; sector_ix++) {
+		mcfg_sector_t *sector = &file->sectors[sector_ix];
+
+		for(size_t ix = 0; ix < sector->section_count; ix++) {
+			mcfg_section_t *section = &sector->sections[ix];
+
+			for(size_t field_ix = 0; field_ix < section->field_count;
+				field_ix++) {
+				deps->nodes[deps->node_count] = (mcfg_fmt_dep_node_t){
+					.field = &section->fields[field_ix],
+					.relativity =
+						{
+							.absolute = true,
+							.sector = sector->name,
+							.section = section->name,
+						},
+				};
+				deps->node_count++;
+			}
+		}
+	}
+
+	qsort(deps->nodes, deps->node_count, sizeof(*deps->nodes),
+		  _dep_node_cmp);
+
+	for(size_t ix = 0; ix < deps->node_count; ix++) {
+		const mcfg_fmt_err_t err = _index_node(deps, ix);
+		if(err != MCFG_FMT_OK) {
+			mcfg_fmt_deps_free(deps);
+			return err;
+		}
+	}
+
+	return MCFG_FMT_OK;
+}
+
+mcfg_fmt_err_t
+mcfg_fmt_deps_update(mcfg_fmt_deps_t *deps, const mcfg_field_t *field)
+{
+	if(deps == NULL || field == NULL) {
+		return MCFG_FMT_NULLPTR;
+	}
+
+	const size_t node_ix = _find_node(deps, field);
+	if(node_ix == deps->node_count) {
+		return MCFG_FMT_NOT_FOUND;
+	}
+
+	/* the fields reaching this one may reach different fields through it
+	 * now, so they are indexed again as well
+	 */
+	const size_t dependent_count = deps->nodes[node_ix].dependent_count;
+	size_t *dependents = malloc(sizeof(*dependents) * (dependent_count + 1));
+	if(dependents == NULL) {
+		return MCFG_FMT_MALLOC_FAIL;
+	}
+
+	dependents[0] = node_ix;
+	memcpy(dependents + 1, deps->nodes[node_ix].dependents,
+		   sizeof(*dependents) * dependent_count);
+
+	mcfg_fmt_err_t err = MCFG_FMT_OK;
+	for(size_t ix = 0; ix <= dependent_count && err == MCFG_FMT_OK; ix++) {
+		_unindex_node(deps, dependents[ix]);
+		err = _index_node(deps, dependents[ix]);
+	}
+
+	free(dependents);
+	return err;
+}
+
+void
+mcfg_fmt_deps_free(mcfg_fmt_deps_t *deps)
+{
+	if(deps == NULL || deps->nodes == NULL) {
+		return;
+	}
+
+	for(size_t ix = 0; ix < deps->node_count; ix++) {
+		free(deps->nodes[ix].embeds);
+		free(deps->nodes[ix].dependents);
+	}
+
+	free(deps->nodes);
+	deps->nodes = NULL;
+	deps->node_count = 0;
+}
+
+mcfg_fmt_dependents_t
+mcfg_format_dependents(const mcfg_fmt_deps_t *deps, const mcfg_field_t *field)
+{
+	mcfg_fmt_dependents_t res = {
+		.err = MCFG_FMT_OK, .count = 0, .fields = NULL};
+
+	if(deps == NULL || field == NULL) {
+		res.err = MCFG_FMT_NULLPTR;
+		return res;
+	}
+
+	const size_t node_ix = _find_node(deps, field);
+	if(node_ix == deps->node_count) {
+		res.err = MCFG_FMT_NOT_FOUND;
+		return res;
+	}
+
+	size_t *nodes = malloc(sizeof(*nodes) * deps->node_count);
+	const size_t count =
+		nodes == NULL ? 0 : _collect_dependents(deps, node_ix, nodes);
+	if(count == 0) {
+		free(nodes);
+		res.err = MCFG_FMT_MALLOC_FAIL;
+		return res;
+	}
+
+	/* the first node is field itself */
+	res.fields = malloc(sizeof(*res.fields) * count);
+	if(res.fields == NULL) {
+		free(nodes);
+		res.err = MCFG_FMT_MALLOC_FAIL;
+		return res;
+	}
+
+	for(size_t ix = 1; ix < count; ix++) {
+		res.fields[ix - 1] = deps->nodes[nodes[ix]].field;
+	}
+
+	res.count = count - 1;
+	free(nodes);
+	return res;
+}
+
+mcfg_fmt_err_t
+mcfg_fmt_cache_init(mcfg_fmt_cache_t *cache, mcfg_file_t *file)
+{
+	if(cache == NULL) {
+		return MCFG_FMT_NULLPTR;
+	}
+
+	cache->entries = NULL;
+
+	const mcfg_fmt_err_t err = mcfg_fmt_deps_build(&cache->deps, file);
+	if(err != MCFG_FMT_OK) {
+		return err;
+	}
+
+	cache->entries =
+		calloc(cache->deps.node_count + 1, sizeof(*cache->entries));
+	if(cache->entries == NULL) {
+		mcfg_fmt_deps_free(&cache->deps);
+		return MCFG_FMT_MALLOC_FAIL;
+	}
+
+	return MCFG_FMT_OK;
+}
+
+mcfg_fmt_err_t
+mcfg_fmt_cache_get(mcfg_fmt_cache_t *cache,
+				   const mcfg_field_t *field,
+				   const char **formatted)
+{
+	if(cache == NULL || field == NULL || formatted == NULL) {
+		return MCFG_FMT_NULLPTR;
+	}
+
+	const size_t node_ix = _find_node(&cache->deps, field);
+	if(node_ix == cache->deps.node_count) {
+		return MCFG_FMT_NOT_FOUND;
+	}
+
+	mcfg_fmt_cache_entry_t *entry = &cache->entries[node_ix];
+	if(!entry->valid) {
+		mcfg_fmt_res_t res =
+			mcfg_format_field_embeds(*field, *cache->deps.file,
+									 cache->deps.nodes[node_ix].relativity);
+
+		entry->valid = true;
+		entry->err = res.err;
+		entry->formatted = res.formatted;
+	}
+
+	*formatted = entry->formatted;
+	return entry->err;
+}
+
+mcfg_fmt_err_t
+mcfg_fmt_cache_invalidate(mcfg_fmt_cache_t *cache, const mcfg_field_t *field)
+{
+	if(cache == NULL || field == NULL) {
+		return MCFG_FMT_NULLPTR;
+	}
+
+	const mcfg_fmt_err_t err = mcfg_fmt_deps_update(&cache->deps, field);
+	if(err != MCFG_FMT_OK) {
+		return err;
+	}
+
+	const mcfg_fmt_deps_t *deps = &cache->deps;
+	const size_t node_ix = _find_node(deps, field);
+
+	size_t *nodes = malloc(sizeof(*nodes) * deps->node_count);
+	const size_t count =
+		nodes == NULL ? 0 : _collect_dependents(deps, node_ix, nodes);
+	if(count == 0) {
+		free(nodes);
+		return MCFG_FMT_MALLOC_FAIL;
+	}
+
+	for(size_t ix = 0; ix < count; ix++) {
+		mcfg_fmt_cache_entry_t *entry = &cache->entries[nodes[ix]];
+
+		free(entry->formatted);
+		*entry = (mcfg_fmt_cache_entry_t){.valid = false};
+	}
+
+	free(nodes);
+	return MCFG_FMT_OK;
+}
+
+void
+mcfg_fmt_cache_free(mcfg_fmt_cache_t *cache)
+{
+	if(cache == NULL) {
+		return;
+	}
+
+	if(cache->entries != NULL) {
+		for(size_t ix = 0; ix < cache->deps.node_count; ix++) {
+			free(cache->entries[ix].formatted);
+		}
+
+		free(cache->entries);
+		cache->entries = NULL;
+	}
+
+	mcfg_fmt_deps_free(&cache->deps);
+}
+
+mcfg_fmt_err_t
+mcfg_dyn_scope_bind(mcfg_dyn_scope_t *scope,
+					mcfg_field_type_t type,
+					char *name,
+					void *data,
+					size_t size)
+{
+	if(scope == NULL || name == NULL) {
+		return MCFG_FMT_NULLPTR;
+	}
+
+	const mcfg_field_t binding = {
+		.name = name, .type = type, .data = data, .size = size};
+
+	mcfg_field_t *existing = mcfg_dyn_scope_get(scope, name, strlen(name));
+	if(existing != NULL) {
+		*existing = binding;
+		return MCFG_FMT_OK;
+	}
+
+	if(scope->count == scope->capacity) {
+		const size_t capacity = scope->capacity == 0 ? 4 : scope->capacity * 2;
+
+		mcfg_field_t *bindings =
+			realloc(scope->bindings, sizeof(*bindings) * capacity);
+		if(bindings == NULL) {
+			return MCFG_FMT_MALLOC_FAIL;
+		}
+
+		scope->bindings = bindings;
+		scope->capacity = capacity;
+	}
+
+	scope->bindings[scope->count] = binding;
+	scope->count++;
+
+	return MCFG_FMT_OK;
+}
+
+mcfg_field_t *
+mcfg_dyn_scope_get(const mcfg_dyn_scope_t *scope,
+				   const char *name,
+				   size_t length)
+{
+	if(scope == NULL || name == NULL) {
+		return NULL;
+	}
+
+	for(size_t ix = 0; ix < scope->count; ix++) {
+		mcfg_field_t *binding = &scope->bindings[ix];
+
+		if(strncmp(binding->name, name, length) == 0 &&
+		   binding->name[length] == 0) {
+			return binding;
+		}
+	}
+
+	return NULL;
+}
+
+void
+mcfg_dyn_scope_free(mcfg_dyn_scope_t *scope)
+{
+	if(scope == NULL) {
+		return;
+	}
+
+	free(scope->bindings);
+	*scope = (mcfg_dyn_scope_t){.count = 0, .capacity = 0, .bindings = NULL};
+}
+
+mcfg_fmt_foreach_res_t
+mcfg_format_foreach(char *input,
+					mcfg_file_t file,
+					mcfg_path_t relativity,
+					const mcfg_list_t *list,
+					char *binding_name)
+{
+	mcfg_fmt_foreach_res_t res = {
+		.err = MCFG_FMT_OK, .count = 0, .arena = NULL, .offsets = NULL};
+
+	if(input == NULL || list == NULL || binding_name == NULL) {
+		res.err = MCFG_FMT_NULLPTR;
+		return res;
+	}
+
+	res.offsets = malloc(sizeof(*res.offsets) * (list->field_count + 1));
+	if(res.offsets == NULL) {
+		res.err = MCFG_FMT_MALLOC_FAIL;
+		return res;
+	}
+
+	res.offsets[0] = 0;
+	if(list->field_count == 0) {
+		return res;
+	}
+
+	STATS_BEGIN(format_start);
+
+	/* the binding has to exist while compiling so that the embed becomes a
+	 * dynfield segment, even if the file has a dynfield of the same name.
+	 */
+	mcfg_dyn_scope_t scope = {0};
+	_arena_t arena = {.data = NULL, .length = 0, .capacity = 0};
+
+	mcfg_template_t *tmpl = NULL;
+	mcfg_template_res_t compiled = {.err = MCFG_FMT_OK, .value = NULL};
+
+	const _render_ctx_t rctx = {
+		.sink = _arena_sink,
+		.sink_ctx = &arena,
+		.scope = &scope,
+		.file = &file,
+	};
+
+	for(size_t ix = 0; ix < list->field_count; ix++) {
+		const mcfg_field_t element = list->fields[ix];
+
+		res.err = mcfg_dyn_scope_bind(&scope, element.type, binding_name,
+									  element.data, element.size);
+		if(res.err != MCFG_FMT_OK) {
+			goto exit;
+		}
+
+		if(tmpl == NULL) {
+			compiled =
+				_compile_root(input, &file, relativity, NULL, &scope, true);
+			res.err = compiled.err;
+			if(res.err != MCFG_FMT_OK) {
+				goto exit;
+			}
+
+			tmpl = compiled.value;
+		}
+
+		res.offsets[ix] = arena.length;
+
+		res.err = _render(tmpl, &rctx, NULL);
+		if(res.err == MCFG_FMT_OK) {
+			res.err = _arena_sink(&arena, "", 1);
+		}
+
+		if(res.err != MCFG_FMT_OK) {
+			goto exit;
+		}
+
+		/* assume the remaining elements render to the same length as the
+		 * first one, to avoid most of the reallocations.
+		 */
+		if(ix == 0) {
+			res.err = _arena_reserve(&arena, arena.length * list->field_count);
+			if(res.err != MCFG_FMT_OK) {
+				goto exit;
+			}
+		}
+	}
+
+	res.offsets[list->field_count] = arena.length;
+	res.count = list->field_count;
+	res.arena = arena.data;
+	arena.data = NULL;
+
+exit:
+	if(res.err != MCFG_FMT_OK) {
+		free(res.offsets);
+		res.offsets = NULL;
+	}
+
+	free(arena.data);
+	mcfg_template_free(tmpl);
+	mcfg_dyn_scope_free(&scope);
+
+	STATS_END(STATS_FORMAT, format_start);
+	return res;
+}
+
+void
+mcfg_free_fmt_foreach_res(mcfg_fmt_foreach_res_t res)
+{
+	free(res.arena);
+	free(res.offsets);
 }
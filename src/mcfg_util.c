@@ -8,125 +8,168 @@
 #define _XOPEN_SOURCE	700
 #define _POSIX_C_SOURCE 2
 
-#include <math.h>
+#include <errno.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "mcfg.h"
 #include "mcfg_util.h"
+#include "path_cache.h"
 #include "shared.h"
+#include "stats.h"
 
 #ifndef MCFG_STRING_RESIZE_ALIGNMENT
 #	define MCFG_STRING_RESIZE_ALIGNMENT 64
 #endif
 
-mcfg_path_t
-mcfg_parse_path(char *path)
+#define NAMESPACE			  mcfg_util
+
+#define _compare_path_parents NAMESPACED_DECL(_compare_path_parents)
+#define _resolve_path_view	  NAMESPACED_DECL(_resolve_path_view)
+#define _int_to_text		  NAMESPACED_DECL(_int_to_text)
+#define _list_to_buffer		  NAMESPACED_DECL(_list_to_buffer)
+#define _list_to_heap		  NAMESPACED_DECL(_list_to_heap)
+#define string_append		  NAMESPACED_DECL(string_append)
+#define string_resize		  NAMESPACED_DECL(string_resize)
+#define string_realloc		  NAMESPACED_DECL(string_realloc)
+
+mcfg_path_view_t
+mcfg_parse_path_view(const char *path)
 {
-	mcfg_path_t ret = {.absolute = false,
-					   .dynfield_path = false,
-					   .sector = NULL,
-					   .section = NULL,
-					   .field = NULL};
+	return mcfg_parse_path_view_n(path, path != NULL ? strlen(path) : 0);
+}
 
-	if(path == NULL) {
+mcfg_path_view_t
+mcfg_parse_path_view_n(const char *path, size_t length)
+{
+	mcfg_path_view_t ret = {.source = path,
+							.absolute = false,
+							.dynfield_path = false,
+							.sector = {0, 0},
+							.section = {0, 0},
+							.field = {0, 0}};
+
+	if(path == NULL || length == 0) {
 		return ret;
 	}
 
-	const char *path_seperator = "/";
+	const char path_seperator = '/';
 
-	ssize_t element_count = 0;
-	char **elements;
-	bool absolute = path[0] == path_seperator[0];
+	ret.absolute = path[0] == path_seperator;
 
-	/* duplicate path so that we can modify it to our hearts content and avoid
-	 * crashes when this function is called with a string literal
+	/* Absolute paths only use their first three elements, relative paths only
+	 * their last three. For absolute paths the elements are therefore stored
+	 * in order of appearance, for relative paths the newest element is always
+	 * stored at the end, pushing out the oldest one.
 	 */
-	path = strdup(path);
-	char *strtok_saveptr = NULL;
-	char *tok = strtok_r(path, path_seperator, &strtok_saveptr);
-
-	while(tok != NULL) {
-		if(element_count == 0) {
-			elements = malloc(sizeof(char *));
-
-			if(elements == NULL) {
-				free(path);
-				return (mcfg_path_t){
-					.sector = NULL, .section = NULL, .field = NULL};
-			}
-		} else {
-			elements = realloc(elements, sizeof(char *) * (element_count + 1));
-			if(elements == NULL) {
-				free(path);
-				return (mcfg_path_t){
-					.sector = NULL, .section = NULL, .field = NULL};
-			}
+	mcfg_path_slice_t elements[3] = {{0, 0}, {0, 0}, {0, 0}};
+	size_t element_count = 0;
+
+	size_t ix = 0;
+	while(ix < length) {
+		if(path[ix] == path_seperator) {
+			ix++;
+			continue;
 		}
 
-		elements[element_count] = malloc(strlen(tok) + 1);
-		if(elements[element_count] == NULL) {
-			free(path);
-			return (mcfg_path_t){
-				.sector = NULL, .section = NULL, .field = NULL};
+		const size_t element_start = ix;
+		while(ix < length && path[ix] != path_seperator) {
+			ix++;
 		}
 
-		strcpy(elements[element_count], tok);
+		const mcfg_path_slice_t element = {.offset = element_start,
+										   .length = ix - element_start};
+
+		if(ret.absolute) {
+			if(element_count < 3) {
+				elements[element_count] = element;
+			}
+		} else {
+			elements[0] = elements[1];
+			elements[1] = elements[2];
+			elements[2] = element;
+		}
 
 		element_count++;
-		tok = strtok_r(NULL, path_seperator, &strtok_saveptr);
 	}
 
 	if(element_count == 0) {
-		free(path);
+		ret.absolute = false;
 		return ret;
 	}
 
-	ret.absolute = absolute;
-
-	if(absolute) {
+	if(ret.absolute) {
 		ret.sector = elements[0];
-		if(element_count > 1) {
-			ret.section = elements[1];
-		}
-		if(element_count > 2) {
-			ret.field = elements[2];
-		}
+		ret.section = elements[1];
+		ret.field = elements[2];
+		return ret;
+	}
 
-		goto exit;
+	ret.field = elements[2];
+	ret.section = elements[1];
+	ret.sector = elements[0];
+
+	if(element_count > 1 || ret.field.length < 2) {
+		return ret;
 	}
 
-	if(element_count == 1) {
-		if(elements[0][0] == '%' &&
-		   elements[0][strlen(elements[0]) - 1] == '%') {
-			ret.dynfield_path = true;
+	if(path[ret.field.offset] == '%' &&
+	   path[ret.field.offset + ret.field.length - 1] == '%') {
+		ret.dynfield_path = true;
+		ret.field.offset++;
+		ret.field.length -= 2;
+	}
 
-			size_t newsize = strlen(elements[0]) - 1;
-			char *new = malloc(newsize);
-			memcpy(new, elements[0] + 1, newsize - 1);
-			new[newsize - 1] = 0;
+	return ret;
+}
 
-			free(elements[0]);
-			elements[0] = new;
-		}
+mcfg_path_t
+mcfg_parse_path(char *path)
+{
+	mcfg_path_t ret = {.absolute = false,
+					   .dynfield_path = false,
+					   .sector = NULL,
+					   .section = NULL,
+					   .field = NULL};
 
-		ret.field = elements[0];
-		goto exit;
+	const mcfg_path_view_t view = mcfg_parse_path_view(path);
+
+	/* every element gets its own allocation so that the mcfg_path_t stays
+	 * compatible with mcfg_free_path
+	 */
+	if(view.sector.length > 0) {
+		ret.sector = strndup(MCFG_PATH_VIEW_ELEM(view, sector),
+							 view.sector.length);
+		if(ret.sector == NULL) {
+			goto fail;
+		}
 	}
 
-	ret.field = elements[element_count - 1];
-	if(element_count - 2 > -1) {
-		ret.section = elements[element_count - 2];
+	if(view.section.length > 0) {
+		ret.section = strndup(MCFG_PATH_VIEW_ELEM(view, section),
+							  view.section.length);
+		if(ret.section == NULL) {
+			goto fail;
+		}
 	}
-	if(element_count - 3 > -1) {
-		ret.sector = elements[element_count - 3];
+
+	if(view.field.length > 0) {
+		ret.field =
+			strndup(MCFG_PATH_VIEW_ELEM(view, field), view.field.length);
+		if(ret.field == NULL) {
+			goto fail;
+		}
 	}
 
-exit:
-	free(elements);
-	free(path);
+	ret.absolute = view.absolute;
+	ret.dynfield_path = view.dynfield_path;
 	return ret;
+
+fail:
+	mcfg_free_path(ret);
+	return (mcfg_path_t){.sector = NULL, .section = NULL, .field = NULL};
 }
 
 void
@@ -213,31 +256,355 @@ mcfg_get_field_by_path(mcfg_file_t *file, mcfg_path_t path)
 		return NULL;
 	}
 
+	/* build the paths string representation as the cache key, paths which
+	 * would be too long to be cached anyways are not built
+	 */
+	const size_t sector_len = strlen(path.sector);
+	const size_t section_len = strlen(path.section);
+	const size_t field_len = strlen(path.field);
+	const size_t key_len = sector_len + section_len + field_len + 3;
+
+	char key[PATH_CACHE_KEY_MAX];
+	const bool use_cache =
+		file->path_cache != NULL && key_len <= PATH_CACHE_KEY_MAX;
+
+	mcfg_field_t *field;
+
+	if(use_cache) {
+		key[0] = '/';
+		memcpy(key + 1, path.sector, sector_len);
+		key[sector_len + 1] = '/';
+		memcpy(key + sector_len + 2, path.section, section_len);
+		key[sector_len + section_len + 2] = '/';
+		memcpy(key + sector_len + section_len + 3, path.field, field_len);
+
+		if(path_cache_lookup(file->path_cache, file, key, key_len, &field)) {
+			return field;
+		}
+	}
+
+	field = NULL;
+
 	mcfg_sector_t *sector = mcfg_get_sector(file, path.sector);
-	if(sector == NULL) {
+	mcfg_section_t *section =
+		sector != NULL ? mcfg_get_section(sector, path.section) : NULL;
+	if(section != NULL) {
+		field = mcfg_get_field(section, path.field);
+	}
+
+	if(use_cache) {
+		path_cache_store(file->path_cache, file, key, key_len, sector, section,
+						 field);
+	}
+
+	return field;
+}
+
+/**
+ * @brief qsort comparison function used to group paths by their sector and
+ * section.
+ */
+int
+_compare_path_parents(const void *a, const void *b)
+{
+	const mcfg_path_t *path_a = *(const mcfg_path_t **)a;
+	const mcfg_path_t *path_b = *(const mcfg_path_t **)b;
+
+	const int sector_cmp = strcmp(path_a->sector, path_b->sector);
+	if(sector_cmp != 0) {
+		return sector_cmp;
+	}
+
+	return strcmp(path_a->section, path_b->section);
+}
+
+size_t
+mcfg_get_fields_by_paths(mcfg_file_t *file,
+						 mcfg_path_t *paths,
+						 size_t count,
+						 mcfg_field_t **out,
+						 bool *missing)
+{
+	if(count == 0) {
+		return 0;
+	}
+
+	/* pointers to all paths which require a sector & section lookup, paths
+	 * which do not are resolved immediatly.
+	 */
+	mcfg_path_t **grouped = malloc(sizeof(*grouped) * count);
+	size_t grouped_count = 0;
+
+	for(size_t ix = 0; ix < count; ix++) {
+		mcfg_path_t *path = &paths[ix];
+
+		if(grouped != NULL && !path->dynfield_path && path->absolute &&
+		   path->sector != NULL && path->section != NULL &&
+		   path->field != NULL) {
+			grouped[grouped_count] = path;
+			grouped_count++;
+			continue;
+		}
+
+		/* fall back to resolving one-by-one if the allocation failed */
+		out[ix] = mcfg_get_field_by_path(file, *path);
+	}
+
+	if(grouped_count > 0) {
+		qsort(grouped, grouped_count, sizeof(*grouped), &_compare_path_parents);
+	}
+
+	mcfg_sector_t *sector = NULL;
+	mcfg_section_t *section = NULL;
+
+	for(size_t ix = 0; ix < grouped_count; ix++) {
+		const mcfg_path_t *path = grouped[ix];
+		const mcfg_path_t *prev = ix > 0 ? grouped[ix - 1] : NULL;
+
+		const bool new_sector =
+			prev == NULL || strcmp(prev->sector, path->sector) != 0;
+		if(new_sector) {
+			sector = mcfg_get_sector(file, path->sector);
+		}
+
+		if(new_sector || strcmp(prev->section, path->section) != 0) {
+			section = sector != NULL ? mcfg_get_section(sector, path->section)
+									 : NULL;
+		}
+
+		out[path - paths] =
+			section != NULL ? mcfg_get_field(section, path->field) : NULL;
+	}
+
+	free(grouped);
+
+	size_t missing_count = 0;
+	for(size_t ix = 0; ix < count; ix++) {
+		if(missing != NULL) {
+			missing[ix] = out[ix] == NULL;
+		}
+
+		if(out[ix] == NULL) {
+			missing_count++;
+		}
+	}
+
+	return missing_count;
+}
+
+/**
+ * @brief Resolves a path view without consulting the path cache.
+ * @param sector Pointer to write the sector found to, NULL if not found
+ * @param section Pointer to write the section found to, NULL if not found
+ * @see mcfg_get_field_by_path_view
+ */
+mcfg_field_t *
+_resolve_path_view(mcfg_file_t *file,
+				   mcfg_path_view_t path,
+				   mcfg_sector_t **sector,
+				   mcfg_section_t **section)
+{
+	*sector = NULL;
+	*section = NULL;
+
+	if(path.dynfield_path) {
+		return mcfg_get_dynfield_n(file, MCFG_PATH_VIEW_ELEM(path, field),
+								   path.field.length);
+	}
+
+	if(!path.absolute) {
+		return NULL;
+	}
+
+	if(path.sector.length == 0 || path.section.length == 0 ||
+	   path.field.length == 0) {
 		return NULL;
 	}
 
-	mcfg_section_t *section = mcfg_get_section(sector, path.section);
-	if(section == NULL) {
+	*sector = mcfg_get_sector_n(file, MCFG_PATH_VIEW_ELEM(path, sector),
+								path.sector.length);
+	if(*sector == NULL) {
 		return NULL;
 	}
 
-	mcfg_field_t *field = mcfg_get_field(section, path.field);
+	*section = mcfg_get_section_n(*sector, MCFG_PATH_VIEW_ELEM(path, section),
+								  path.section.length);
+	if(*section == NULL) {
+		return NULL;
+	}
+
+	return mcfg_get_field_n(*section, MCFG_PATH_VIEW_ELEM(path, field),
+							path.field.length);
+}
+
+mcfg_field_t *
+mcfg_get_field_by_path_view(mcfg_file_t *file, mcfg_path_view_t path)
+{
+	mcfg_sector_t *sector;
+	mcfg_section_t *section;
+
+	if(file->path_cache == NULL || path.dynfield_path || !path.absolute ||
+	   path.field.length == 0) {
+		return _resolve_path_view(file, path, &sector, &section);
+	}
+
+	/* The source string up to the end of the field is used as the key, since
+	 * parsing the same string always results in the same view.
+	 */
+	const size_t key_len = path.field.offset + path.field.length;
+
+	mcfg_field_t *field;
+	if(path_cache_lookup(file->path_cache, file, path.source, key_len,
+						 &field)) {
+		return field;
+	}
+
+	field = _resolve_path_view(file, path, &sector, &section);
+	path_cache_store(file->path_cache, file, path.source, key_len, sector,
+					 section, field);
+
 	return field;
 }
 
-char *
-mcfg_data_to_string(mcfg_field_t field)
+mcfg_field_t *
+mcfg_get_field_by_path_str(mcfg_file_t *file, const char *path)
+{
+	mcfg_sector_t *sector;
+	mcfg_section_t *section;
+
+	if(file->path_cache == NULL || path == NULL || path[0] != '/') {
+		return _resolve_path_view(file, mcfg_parse_path_view(path), &sector,
+								  &section);
+	}
+
+	/* absolute paths can be looked up in the cache before being parsed */
+	const size_t path_len = strlen(path);
+
+	mcfg_field_t *field;
+	if(path_cache_lookup(file->path_cache, file, path, path_len, &field)) {
+		return field;
+	}
+
+	field = _resolve_path_view(file, mcfg_parse_path_view_n(path, path_len),
+							   &sector, &section);
+	path_cache_store(file->path_cache, file, path, path_len, sector, section,
+					 field);
+
+	return field;
+}
+
+mcfg_err_t
+mcfg_enable_path_cache(mcfg_file_t *file, size_t slot_count)
 {
+	if(file == NULL) {
+		return MCFG_NULLPTR;
+	}
+
+	mcfg_path_cache_t *cache = path_cache_new(slot_count);
+	if(cache == NULL) {
+		return MCFG_MALLOC_FAIL;
+	}
+
+	mcfg_disable_path_cache(file);
+	file->path_cache = cache;
+
+	return MCFG_OK;
+}
+
+void
+mcfg_disable_path_cache(mcfg_file_t *file)
+{
+	if(file == NULL || file->path_cache == NULL) {
+		return;
+	}
+
+	path_cache_destroy(file->path_cache);
+	file->path_cache = NULL;
+}
+
+/* every two-digit number in order, used to convert numbers to text two digits
+ * at a time.
+ */
+static const char _digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536"
+	"37383940414243444546474849505152535455565758596061626364656667686970717273"
+	"7475767778798081828384858687888990919293949596979899";
+
+/**
+ * @brief Converts a number to its decimal text representation.
+ * @param value The number to convert
+ * @param out The buffer to write to, has to be at least
+ * MCFG_NUMBER_BUFFER_SIZE - 1 bytes large. No NULL terminator is written.
+ * @return The number of bytes written.
+ */
+size_t
+_int_to_text(int64_t value, char *out)
+{
+	char digits[MCFG_NUMBER_BUFFER_SIZE];
+	char *start = digits + sizeof(digits);
+
+	/* negate as unsigned, so that INT64_MIN does not overflow */
+	uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+	while(magnitude >= 100) {
+		const size_t pair = (magnitude % 100) * 2;
+		magnitude /= 100;
+
+		start -= 2;
+		memcpy(start, _digit_pairs + pair, 2);
+	}
+
+	if(magnitude >= 10) {
+		start -= 2;
+		memcpy(start, _digit_pairs + magnitude * 2, 2);
+	} else {
+		start--;
+		*start = (char)('0' + magnitude);
+	}
+
+	if(value < 0) {
+		start--;
+		*start = '-';
+	}
+
+	const size_t length = digits + sizeof(digits) - start;
+	memcpy(out, start, length);
+	return length;
+}
+
+size_t
+mcfg_data_to_buffer(mcfg_field_t field, char *buf, size_t cap)
+{
+	char number[MCFG_NUMBER_BUFFER_SIZE];
+	const char *text = number;
+	size_t length = 0;
 	int64_t num = 0;
+
+	if(cap > 0) {
+		buf[0] = 0;
+	}
+
 	switch(field.type) {
-		case TYPE_LIST:
-			return mcfg_list_as_string(*((mcfg_list_t *)field.data));
+		case TYPE_LIST: {
+			const mcfg_list_t *list = mcfg_data_as_list(field);
+			if(list == NULL) {
+				return 0;
+			}
+
+			return mcfg_list_to_buffer(*list, buf, cap);
+		}
 		case TYPE_STRING:
-			return strdup(mcfg_data_as_string(field));
+			text = mcfg_data_as_string(field);
+			if(text == NULL) {
+				return 0;
+			}
+
+			buffer_put(buf, cap, &length, text, strlen(text));
+			return length;
 		case TYPE_BOOL:
-			return strdup(mcfg_data_as_bool(field) ? "true" : "false");
+			text = mcfg_data_as_bool(field) ? "true" : "false";
+			buffer_put(buf, cap, &length, text, strlen(text));
+			return length;
 		case TYPE_U8:
 			num = mcfg_data_as_u8(field);
 			break;
@@ -257,110 +624,122 @@ mcfg_data_to_string(mcfg_field_t field)
 			num = mcfg_data_as_i32(field);
 			break;
 		default:
-			return strdup("(invalid type)");
+			text = "(invalid type)";
+			buffer_put(buf, cap, &length, text, strlen(text));
+			return length;
 	}
 
-	// mystic string length calculation for number conversion
-	// has a "slight" overhead (:
-	char *number_ret = malloc((size_t)floor(log10((double)INT64_MAX)));
-	sprintf(number_ret, "%ld", num);
-	return number_ret;
+	const size_t number_length = _int_to_text(num, number);
+	buffer_put(buf, cap, &length, number, number_length);
+	return length;
 }
 
 char *
-mcfg_format_list(mcfg_list_t list, char *prefix, char *postfix)
+mcfg_data_to_string(mcfg_field_t field)
 {
-	if(list.field_count == 0 || list.fields == NULL) {
-		return strdup("");
+	switch(field.type) {
+		case TYPE_LIST:
+			return mcfg_list_as_string(*((mcfg_list_t *)field.data));
+		case TYPE_STRING:
+			return strdup(mcfg_data_as_string(field));
+		default:
+			break;
 	}
 
-	char space[2] = " ";
-	size_t base_alloc_size = strlen(prefix) + strlen(postfix) + sizeof(space);
-
-	char *seperator = malloc(base_alloc_size);
-	if(seperator != NULL) {
-		return NULL;
-	}
+	char number[MCFG_NUMBER_BUFFER_SIZE];
+	mcfg_data_to_buffer(field, number, sizeof(number));
+	return strdup(number);
+}
 
-	strcpy(seperator, postfix);
-	strcpy(seperator + strlen(postfix), space);
-	strcpy(seperator + strlen(postfix) + strlen(space), prefix);
+/**
+ * @brief Writes every element of list into buf, each one surrounded by prefix
+ * and postfix and separated from the previous one by separator. The semantics
+ * for buf, cap and the return value are the same as for mcfg_data_to_buffer.
+ */
+size_t
+_list_to_buffer(mcfg_list_t list,
+				const char *prefix,
+				const char *postfix,
+				const char *separator,
+				char *buf,
+				size_t cap)
+{
+	const size_t prefix_len = strlen(prefix);
+	const size_t postfix_len = strlen(postfix);
+	const size_t separator_len = strlen(separator);
+	size_t length = 0;
 
-	size_t cpy_offs = 0;
-	char *tmp = mcfg_data_to_string(list.fields[0]);
-	char *out = malloc(base_alloc_size + strlen(tmp) + strlen(prefix));
-	if(out == NULL) {
-		goto exit;
+	if(cap > 0) {
+		buf[0] = 0;
 	}
 
-	strcpy(out, prefix);
-	cpy_offs += strlen(prefix);
-	strcpy(out + cpy_offs, tmp);
-	cpy_offs += strlen(tmp);
-	free(tmp);
-
-	for(size_t ix = 1; ix < list.field_count; ix++) {
-		memcpy(out + cpy_offs, seperator, strlen(seperator));
-		cpy_offs += strlen(seperator);
-		tmp = mcfg_data_to_string(list.fields[ix]);
-		out = realloc(out, strlen(out) + strlen(tmp) + strlen(seperator) + 1);
-		if(out == NULL) {
-			goto exit;
-		}
-
-		strcpy(out + cpy_offs, tmp);
-		cpy_offs = strlen(out);
-		free(tmp);
+	if(list.fields == NULL) {
+		return 0;
 	}
 
-	size_t prev_end = strlen(out);
-	out = realloc(out, strlen(out) + strlen(postfix) + 1);
+	for(size_t ix = 0; ix < list.field_count; ix++) {
+		if(ix > 0) {
+			buffer_put(buf, cap, &length, separator, separator_len);
+		}
 
-	if(out != NULL) {
-		strcpy(out + prev_end, postfix);
+		buffer_put(buf, cap, &length, prefix, prefix_len);
+		length += mcfg_data_to_buffer(list.fields[ix],
+									  length < cap ? buf + length : NULL,
+									  length < cap ? cap - length : 0);
+		buffer_put(buf, cap, &length, postfix, postfix_len);
 	}
 
-exit:
-	free(seperator);
-
-	return out;
+	return length;
 }
 
+/**
+ * @brief Measures the output of _list_to_buffer and writes it into a single
+ * heap allocation of the exact size.
+ */
 char *
-mcfg_list_as_string(mcfg_list_t list)
+_list_to_heap(mcfg_list_t list,
+			  const char *prefix,
+			  const char *postfix,
+			  const char *separator)
 {
-	if(list.field_count == 0 || list.fields == NULL) {
-		return strdup("");
-	}
+	const size_t length =
+		_list_to_buffer(list, prefix, postfix, separator, NULL, 0);
 
-	size_t cpy_offs = 0;
-	char *tmp = mcfg_data_to_string(list.fields[0]);
-	char seperator[3] = ", ";
-	char *out = malloc(strlen(tmp) + sizeof(seperator));
+	char *out = malloc(length + 1);
 	if(out == NULL) {
-		goto exit;
+		return NULL;
 	}
 
-	strcpy(out, tmp);
-	cpy_offs += strlen(out);
+	_list_to_buffer(list, prefix, postfix, separator, out, length + 1);
+	return out;
+}
+
+size_t
+mcfg_format_list_to_buffer(mcfg_list_t list,
+						   const char *prefix,
+						   const char *postfix,
+						   char *buf,
+						   size_t cap)
+{
+	return _list_to_buffer(list, prefix, postfix, " ", buf, cap);
+}
 
-	for(size_t ix = 1; ix < list.field_count; ix++) {
-		free(tmp);
+char *
+mcfg_format_list(mcfg_list_t list, char *prefix, char *postfix)
+{
+	return _list_to_heap(list, prefix, postfix, " ");
+}
 
-		strcpy(out + cpy_offs, seperator);
-		cpy_offs += strlen(seperator);
-		tmp = mcfg_data_to_string(list.fields[ix]);
-		out = realloc(out, strlen(out) + strlen(tmp) + sizeof(seperator) + 1);
-		if(out == NULL) {
-			goto exit;
-		}
-		strcpy(out + cpy_offs, tmp);
-		cpy_offs = strlen(out);
-	}
+size_t
+mcfg_list_to_buffer(mcfg_list_t list, char *buf, size_t cap)
+{
+	return _list_to_buffer(list, "", "", ", ", buf, cap);
+}
 
-exit:
-	free(tmp);
-	return out;
+char *
+mcfg_list_as_string(mcfg_list_t list)
+{
+	return _list_to_heap(list, "", "", ", ");
 }
 
 mcfg_list_t *
@@ -461,11 +840,66 @@ mcfg_data_as_i32(mcfg_field_t field)
 	return (int32_t)*(int32_t *)field.data;
 }
 
-/* mcfg_string functions */
+/**
+ * @brief Copies up to n elements of list into out, converting every element
+ * from src_type. The type dispatch happens once per list instead of once per
+ * element.
+ */
+#define LIST_COPY_AS(list, out, n, src_type)                         \
+	({                                                               \
+		const size_t _count =                                        \
+			(list).field_count < (n) ? (list).field_count : (n);     \
+		for(size_t _ix = 0; _ix < _count; _ix++) {                   \
+			(out)[_ix] = *(const src_type *)(list).fields[_ix].data; \
+		}                                                            \
+		(ssize_t)_count;                                             \
+	})
+
+ssize_t
+mcfg_list_copy_as_i64(mcfg_list_t list, int64_t *out, size_t n)
+{
+	if(list.field_count > 0 && (list.fields == NULL || out == NULL)) {
+		return -1;
+	}
+
+	switch(list.type) {
+		case TYPE_U8:
+			return LIST_COPY_AS(list, out, n, uint8_t);
+		case TYPE_I8:
+			return LIST_COPY_AS(list, out, n, int8_t);
+		case TYPE_U16:
+			return LIST_COPY_AS(list, out, n, uint16_t);
+		case TYPE_I16:
+			return LIST_COPY_AS(list, out, n, int16_t);
+		case TYPE_U32:
+			return LIST_COPY_AS(list, out, n, uint32_t);
+		case TYPE_I32:
+			return LIST_COPY_AS(list, out, n, int32_t);
+		default:
+			return -1;
+	}
+}
+
+ssize_t
+mcfg_list_copy_as_u32(mcfg_list_t list, uint32_t *out, size_t n)
+{
+	if(list.field_count > 0 && (list.fields == NULL || out == NULL)) {
+		return -1;
+	}
+
+	switch(list.type) {
+		case TYPE_U8:
+			return LIST_COPY_AS(list, out, n, uint8_t);
+		case TYPE_U16:
+			return LIST_COPY_AS(list, out, n, uint16_t);
+		case TYPE_U32:
+			return LIST_COPY_AS(list, out, n, uint32_t);
+		default:
+			return -1;
+	}
+}
 
-#define NAMESPACE	  mcfg_util
-#define string_append NAMESPACED_DECL(string_append)
-#define string_resize NAMESPACED_DECL(string_resize)
+/* mcfg_string functions */
 
 mcfg_string_t *
 mcfg_string_new_sized(size_t size)
@@ -474,8 +908,9 @@ mcfg_string_new_sized(size_t size)
 		malloc(sizeof(mcfg_string_t) + sizeof(char) * size + 1);
 
 	if(result != NULL) {
-		result->capacity = size;
+		result->capacity = size + 1;
 		result->length = 0;
+		result->data[0] = 0;
 	}
 
 	return result;
@@ -495,26 +930,46 @@ mcfg_string_new(const char *initial)
 	return result;
 }
 
+/**
+ * @brief Reallocate a so that its data can hold at least capacity bytes
+ * (including the NULL terminator). The capacity is aligned to
+ * MCFG_STRING_RESIZE_ALIGNMENT. a is left untouched on failure.
+ */
 mcfg_err_t
-string_resize(mcfg_string_t **a, size_t new_length)
+string_realloc(mcfg_string_t **a, size_t capacity)
 {
-	const size_t resize_amount =
-		(new_length + 1 + MCFG_STRING_RESIZE_ALIGNMENT) &
+	const size_t aligned_capacity =
+		(capacity + MCFG_STRING_RESIZE_ALIGNMENT - 1) &
 		~(MCFG_STRING_RESIZE_ALIGNMENT - 1);
 
-	const size_t new_size =
-		resize_amount * sizeof(*(*a)->data) + sizeof(*(*a)) + 1;
-
-	*a = realloc((*a), new_size);
-	if(*a == NULL) {
+	mcfg_string_t *resized =
+		realloc(*a, sizeof(**a) + aligned_capacity * sizeof(*(*a)->data));
+	if(resized == NULL) {
 		return MCFG_MALLOC_FAIL;
 	}
 
-	(*a)->capacity = sizeof(char) * resize_amount;
+	resized->capacity = aligned_capacity;
+	*a = resized;
 
 	return MCFG_OK;
 }
 
+/**
+ * @brief Grow a so that it can hold new_length characters. The capacity is at
+ * least doubled, so that repeated appends only cause a logarithmic amount of
+ * reallocations.
+ */
+mcfg_err_t
+string_resize(mcfg_string_t **a, size_t new_length)
+{
+	size_t capacity = (*a)->capacity * 2;
+	if(capacity < new_length + 1) {
+		capacity = new_length + 1;
+	}
+
+	return string_realloc(a, capacity);
+}
+
 mcfg_err_t
 string_append(mcfg_string_t **a, const char *b, size_t b_len)
 {
@@ -545,4 +1000,75 @@ mcfg_err_t
 mcfg_string_append_cstr(mcfg_string_t **a, const char *b)
 {
 	return string_append(a, b, strlen(b));
-}
\ No newline at end of file
+}
+
+mcfg_err_t
+mcfg_string_append_n(mcfg_string_t **a, const char *b, size_t length)
+{
+	return string_append(a, b, length);
+}
+
+mcfg_err_t
+mcfg_string_append_fmt(mcfg_string_t **a, const char *fmt, ...)
+{
+	if(a == NULL || *a == NULL || fmt == NULL) {
+		return MCFG_NULLPTR;
+	}
+
+	va_list args;
+	va_list args_retry;
+	va_start(args, fmt);
+	va_copy(args_retry, args);
+
+	mcfg_err_t ret = MCFG_OK;
+
+	/* try to format into the remaining capacity first, so that only strings
+	 * which do not fit have to be formatted twice.
+	 */
+	const size_t space = (*a)->capacity - (*a)->length;
+	const int written =
+		vsnprintf((*a)->data + (*a)->length, space, fmt, args);
+	if(written < 0) {
+		ret = errno | MCFG_OS_ERROR_MASK;
+		goto exit;
+	}
+
+	if((size_t)written >= space) {
+		ret = string_resize(a, (*a)->length + written);
+		if(ret != MCFG_OK) {
+			goto exit;
+		}
+
+		vsnprintf((*a)->data + (*a)->length, written + 1, fmt, args_retry);
+	}
+
+	(*a)->length += written;
+
+exit:
+	va_end(args_retry);
+	va_end(args);
+	return ret;
+}
+
+mcfg_err_t
+mcfg_string_reserve(mcfg_string_t **a, size_t length)
+{
+	if(a == NULL || *a == NULL) {
+		return MCFG_NULLPTR;
+	}
+
+	if(length + 1 <= (*a)->capacity) {
+		return MCFG_OK;
+	}
+
+	return string_realloc(a, length + 1);
+}
+
+void
+mcfg_string_clear(mcfg_string_t *a)
+{
+	a->length = 0;
+	if(a->capacity > 0) {
+		a->data[0] = 0;
+	}
+}
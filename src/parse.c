@@ -13,8 +13,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "cst.h"
 #include "parse.h"
 #include "shared.h"
+#include "stats.h"
 
 #define NAMESPACE parse
 
@@ -34,6 +36,7 @@
 #define _parse_list_field	  NAMESPACED_DECL(_parse_list_field)
 #define _parse_field		  NAMESPACED_DECL(_parse_field)
 #define _parse_list			  NAMESPACED_DECL(_parse_list)
+#define _record_span		  NAMESPACED_DECL(_record_span)
 
 char *
 mcfg_token_str(token_t tk)
@@ -109,14 +112,14 @@ mcfg_token_str(token_t tk)
  * @param val The value to check for
  * @param tk The token enum value to set on match
  */
-#define TOKEN_CHECKED_SET(cnode, str, val, tk)                            \
-	if(strncmp(str, val, sizeof(val) - 1) == 0 &&                         \
-	   (isspace(str[sizeof(val) - 1]) || str[sizeof(val) - 1] == '\0')) { \
-		ERR_CHECK_RET(_set_node(&cnode, tk, NULL, 1));                    \
-		ix += sizeof(val) - 2;                                            \
-		break;                                                            \
-	}                                                                     \
-	do {                                                                  \
+#define TOKEN_CHECKED_SET(cnode, str, val, tk)                              \
+	if(strncmp(str, val, sizeof(val) - 1) == 0 &&                           \
+	   (isspace(str[sizeof(val) - 1]) || str[sizeof(val) - 1] == '\0')) {   \
+		ERR_CHECK_RET(_set_node(&cnode, tk, NULL, 1, ix, sizeof(val) - 1)); \
+		ix += sizeof(val) - 2;                                              \
+		break;                                                              \
+	}                                                                       \
+	do {                                                                    \
 	} while(0)
 
 /**
@@ -129,7 +132,8 @@ mcfg_token_str(token_t tk)
 	if(strncmp(str, val, sizeof(val) - 1) == 0 &&                        \
 	   (isspace(str[sizeof(val) - 1]) || str[sizeof(val) - 1] == '\0' || \
 		str[sizeof(val) - 1] == ',')) {                                  \
-		ERR_CHECK_RET(_set_node(&cnode, tk, strdup(val), 1));            \
+		ERR_CHECK_RET(                                                   \
+			_set_node(&cnode, tk, strdup(val), 1, ix, sizeof(val) - 1)); \
 		ix += sizeof(val) - 2;                                           \
 		break;                                                           \
 	}                                                                    \
@@ -144,14 +148,25 @@ mcfg_token_str(token_t tk)
  * @param value The string value to be set, can be NULL. Ownership should be
  * considered to be transfered to the current node.
  * @param line_count The count of lines on which the node resides
+ * @param offset Offset of the first byte of the node in the input
+ * @param length The amount of bytes the node takes up in the input
  * @return MCFG_OK on success.
  */
 mcfg_err_t
-_set_node(syntax_tree_t **node, token_t token, char *value, size_t line_count)
+_set_node(syntax_tree_t **node,
+		  token_t token,
+		  char *value,
+		  size_t line_count,
+		  size_t offset,
+		  size_t length)
 {
+	STATS_ADD_TOKEN();
+
 	(*node)->token = token;
 	(*node)->value = value;
 	(*node)->linespan.line_count = line_count;
+	(*node)->offset = offset;
+	(*node)->length = length;
 
 	if((*node)->linespan.starting_line == 0) {
 		(*node)->linespan.starting_line =
@@ -166,6 +181,8 @@ _set_node(syntax_tree_t **node, token_t token, char *value, size_t line_count)
 	new_current->next = NULL;
 	new_current->linespan.starting_line = 0;
 	new_current->linespan.line_count = 1;
+	new_current->offset = 0;
+	new_current->length = 0;
 
 	(*node)->next = new_current;
 
@@ -320,9 +337,13 @@ _extract_string(syntax_tree_t **node,
 
 	*line_number += processing_result.linefeed_count;
 
+	/* the closing quote is missing if the string ends with the input */
+	const size_t close_offset = *ix + value_size;
 	ERR_CHECK_RET(_set_node(node, TK_STRING, processing_result.result,
-							processing_result.linefeed_count));
-	ERR_CHECK_RET(_set_node(node, TK_QUOTE, NULL, 1));
+							processing_result.linefeed_count, *ix + 1,
+							value_size - 1));
+	ERR_CHECK_RET(_set_node(node, TK_QUOTE, NULL, 1, close_offset,
+							input[close_offset] == '\'' ? 1 : 0));
 
 	*ix += value_size;
 
@@ -356,7 +377,7 @@ _extract_word(syntax_tree_t **node, char *input, size_t *ix, token_t tk)
 	value[value_size - 1] = '\0';
 
 	/* finish up */
-	ERR_CHECK_RET(_set_node(node, tk, value, 1));
+	ERR_CHECK_RET(_set_node(node, tk, value, 1, *ix, value_size - 1));
 
 	/* subtract one from value_size because of null terminator */
 	*ix += value_size - 2;
@@ -398,10 +419,10 @@ lex_input(char *input, syntax_tree_t *tree)
 				break;
 			}
 			case ',':
-				_set_node(&current_node, TK_COMMA, NULL, 1);
+				_set_node(&current_node, TK_COMMA, NULL, 1, ix, 1);
 				break;
 			case '\'': /* possibly a string open/close quote */
-				_set_node(&current_node, TK_QUOTE, NULL, 1);
+				_set_node(&current_node, TK_QUOTE, NULL, 1, ix, 1);
 
 				ERR_CHECK_RET(
 					_extract_string(&current_node, input, &ix, &line_number));
@@ -698,6 +719,31 @@ _parse_literal(const mcfg_field_type_t type, const char *const value)
 	return result;
 }
 
+/**
+ * @brief Records the span of the value of the field which was added last to
+ * the file, if a CST is being built.
+ * @param first The first token of the value
+ * @param last The last token of the value
+ */
+mcfg_err_t
+_record_span(mcfg_cst_t *cst,
+			 mcfg_file_t *file,
+			 const syntax_tree_t *first,
+			 const syntax_tree_t *last)
+{
+	if(cst == NULL) {
+		return MCFG_OK;
+	}
+
+	const size_t sector_ix = file->sector_count - 1;
+	const size_t section_ix = file->sectors[sector_ix].section_count - 1;
+	const size_t field_ix =
+		file->sectors[sector_ix].sections[section_ix].field_count - 1;
+
+	return cst_add_span(cst, sector_ix, section_ix, field_ix, first->offset,
+						last->offset + last->length);
+}
+
 /**
  * @todo document
  */
@@ -711,7 +757,9 @@ typedef enum _parse_list_field_state {
  * @todo document, finish implementation
  */
 _parse_result_t
-_parse_list_field(mcfg_file_t *destination_file, syntax_tree_t **current_ptr)
+_parse_list_field(mcfg_file_t *destination_file,
+				  syntax_tree_t **current_ptr,
+				  mcfg_cst_t *cst)
 {
 	_parse_result_t result = {
 		.err = MCFG_OK, .err_linespan = {.starting_line = 0, .line_count = 0}};
@@ -768,10 +816,12 @@ _parse_list_field(mcfg_file_t *destination_file, syntax_tree_t **current_ptr)
 
 	list->type = list_field_type;
 	list->field_count = 0;
+	list->dirty = false;
 
 	_parse_list_field_state_t state = PLFS_LITERAL;
 
 	current = current->next;
+	const syntax_tree_t *first_literal = current;
 	while(current != NULL) {
 		switch(state) {
 			case PLFS_LITERAL:
@@ -845,8 +895,10 @@ _parse_list_field(mcfg_file_t *destination_file, syntax_tree_t **current_ptr)
 	if(result.err != MCFG_OK) {
 		mcfg_free_list(*list);
 		free(list);
+		return result;
 	}
 
+	result.err = _record_span(cst, destination_file, first_literal, current);
 	return result;
 }
 
@@ -856,13 +908,15 @@ _parse_list_field(mcfg_file_t *destination_file, syntax_tree_t **current_ptr)
  * field should be added to
  * @param current_ptr Pointer to the current-node pointer. The underlying
  * pointer will be updated to point to the last consumed token on success.
+ * @param cst CST to record the span of the value in, can be NULL.
  * @return A _parse_result_t struct
  * @see _parse_result_t
  */
 _parse_result_t
 _parse_field(const token_t field_type_token,
 			 mcfg_file_t *destination_file,
-			 syntax_tree_t **current_ptr)
+			 syntax_tree_t **current_ptr,
+			 mcfg_cst_t *cst)
 {
 	_parse_result_t result = {
 		.err = MCFG_OK, .err_linespan = {.starting_line = 0, .line_count = 0}};
@@ -938,8 +992,10 @@ _parse_field(const token_t field_type_token,
 
 	if(result.err != MCFG_OK) {
 		free(parse_result.value);
+		return result;
 	}
 
+	result.err = _record_span(cst, destination_file, current, *current_ptr);
 	return result;
 }
 
@@ -954,7 +1010,7 @@ typedef enum _parse_tree_state {
 } _parse_tree_state_t;
 
 _parse_result_t
-parse_tree(syntax_tree_t tree, mcfg_file_t *destination_file)
+parse_tree(syntax_tree_t tree, mcfg_file_t *destination_file, mcfg_cst_t *cst)
 {
 	/* MCFG/2 Syntax Rules:
 	 *    0. Unless explicitly stated, a token can not appear by itself.
@@ -1070,7 +1126,7 @@ parse_tree(syntax_tree_t tree, mcfg_file_t *destination_file)
 			case TK_LIST:
 				VALIDATE_PARSER_STATE(state, PTS_IN_SECTION,
 									  MCFG_STRUCTURE_ERROR);
-				result = _parse_list_field(destination_file, &current);
+				result = _parse_list_field(destination_file, &current, cst);
 				if(result.err != MCFG_OK) {
 					return result;
 				}
@@ -1085,8 +1141,8 @@ parse_tree(syntax_tree_t tree, mcfg_file_t *destination_file)
 			case TK_U32:
 				VALIDATE_PARSER_STATE(state, PTS_IN_SECTION,
 									  MCFG_STRUCTURE_ERROR);
-				result =
-					_parse_field(current->token, destination_file, &current);
+				result = _parse_field(current->token, destination_file,
+									  &current, cst);
 				if(result.err != MCFG_OK) {
 					return result;
 				}
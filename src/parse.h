@@ -120,6 +120,12 @@ struct syntax_tree {
 	/** @brief The span of lines the node in the "tree" takes up */
 	mcfg_linespan_t linespan;
 
+	/** @brief Offset of the first byte of the node in the input */
+	size_t offset;
+
+	/** @brief The amount of bytes the node takes up in the input */
+	size_t length;
+
 	/** @brief The previous entry in the "tree" */
 	syntax_tree_t *prev;
 
@@ -156,8 +162,11 @@ typedef struct _parse_result {
  * @brief Parses the given syntax tree into a mcfg_file_t struct
  * @param tree The tree to be parsed
  * @param mcfg Pointer to write the result to
+ * @param cst CST to record the spans of all field values in, can be NULL.
  * @return mcfg_parse_result_t.err == MCFG_OK on success
  */
-_parse_result_t parse_tree(syntax_tree_t tree, mcfg_file_t *mcfg);
+_parse_result_t parse_tree(syntax_tree_t tree,
+						   mcfg_file_t *mcfg,
+						   mcfg_cst_t *cst);
 
 #endif	// ifndef PARSE_H
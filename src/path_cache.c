@@ -0,0 +1,200 @@
+/* path_cache.c ; marie config format internal path lookup cache
+ * implementation for MCFG/2
+ *
+ * Copyright (c) 2025, Marie Eckert
+ * Licensend under the BSD 3-Clause License.
+ */
+
+#define _XOPEN_SOURCE	700
+#define _POSIX_C_SOURCE 2
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "path_cache.h"
+#include "shared.h"
+#include "stats.h"
+
+#define NAMESPACE	   path_cache
+
+#define _clear_cache   NAMESPACED_DECL(_clear_cache)
+#define _resolve_entry NAMESPACED_DECL(_resolve_entry)
+
+typedef struct _path_cache_entry {
+	uint64_t hash;
+
+	/** @brief The length of key, 0 if the entry is unused */
+	size_t key_length;
+	char key[PATH_CACHE_KEY_MAX];
+
+	/**
+	 * @brief The number of path elements which were found, 3 if the path
+	 * resolved to a field.
+	 */
+	size_t found;
+
+	/** @brief The positions of the sector, section and field found */
+	size_t positions[3];
+
+	/**
+	 * @brief The element count of the container the first missing element was
+	 * searched in, unused if all elements were found.
+	 */
+	size_t count;
+} _path_cache_entry_t;
+
+struct mcfg_path_cache {
+	/** @brief The number of entries, always a power of two */
+	size_t slot_count;
+	_path_cache_entry_t slots[];
+};
+
+void
+_clear_cache(mcfg_path_cache_t *cache)
+{
+	for(size_t ix = 0; ix < cache->slot_count; ix++) {
+		cache->slots[ix].key_length = 0;
+	}
+}
+
+mcfg_path_cache_t *
+path_cache_new(size_t slot_count)
+{
+	size_t rounded_count = 1;
+	while(rounded_count < slot_count) {
+		rounded_count <<= 1;
+	}
+
+	mcfg_path_cache_t *cache =
+		malloc(sizeof(*cache) + sizeof(_path_cache_entry_t) * rounded_count);
+	if(cache == NULL) {
+		return NULL;
+	}
+
+	cache->slot_count = rounded_count;
+	_clear_cache(cache);
+
+	return cache;
+}
+
+void
+path_cache_destroy(mcfg_path_cache_t *cache)
+{
+	free(cache);
+}
+
+/**
+ * @brief Checks if the cached positions are still in bounds and whether the
+ * container of a cached miss still has the same size.
+ * @return The cached field on success, else NULL with valid set to false.
+ */
+mcfg_field_t *
+_resolve_entry(const _path_cache_entry_t *entry,
+			   mcfg_file_t *file,
+			   bool *valid)
+{
+	*valid = false;
+
+	if(entry->found == 0) {
+		*valid = file->sector_count == entry->count;
+		return NULL;
+	}
+
+	if(entry->positions[0] >= file->sector_count) {
+		return NULL;
+	}
+
+	mcfg_sector_t *sector = &file->sectors[entry->positions[0]];
+	if(entry->found == 1) {
+		*valid = sector->section_count == entry->count;
+		return NULL;
+	}
+
+	if(entry->positions[1] >= sector->section_count) {
+		return NULL;
+	}
+
+	mcfg_section_t *section = &sector->sections[entry->positions[1]];
+	if(entry->found == 2) {
+		*valid = section->field_count == entry->count;
+		return NULL;
+	}
+
+	if(entry->positions[2] >= section->field_count) {
+		return NULL;
+	}
+
+	*valid = true;
+	return &section->fields[entry->positions[2]];
+}
+
+bool
+path_cache_lookup(mcfg_path_cache_t *cache,
+				  mcfg_file_t *file,
+				  const char *key,
+				  size_t length,
+				  mcfg_field_t **field)
+{
+	const uint64_t hash = name_hash(key, length);
+	const _path_cache_entry_t *entry =
+		&cache->slots[hash & (cache->slot_count - 1)];
+
+	if(entry->key_length != length || entry->hash != hash ||
+	   memcmp(entry->key, key, length) != 0) {
+		return false;
+	}
+
+	bool valid;
+	mcfg_field_t *cached = _resolve_entry(entry, file, &valid);
+	if(!valid) {
+		return false;
+	}
+
+	*field = cached;
+	return true;
+}
+
+void
+path_cache_store(mcfg_path_cache_t *cache,
+				 mcfg_file_t *file,
+				 const char *key,
+				 size_t length,
+				 mcfg_sector_t *sector,
+				 mcfg_section_t *section,
+				 mcfg_field_t *field)
+{
+	if(length == 0 || length > PATH_CACHE_KEY_MAX) {
+		return;
+	}
+
+	const uint64_t hash = name_hash(key, length);
+	_path_cache_entry_t *entry = &cache->slots[hash & (cache->slot_count - 1)];
+
+	entry->hash = hash;
+	entry->key_length = length;
+	memcpy(entry->key, key, length);
+
+	if(sector == NULL) {
+		entry->found = 0;
+		entry->count = file->sector_count;
+		return;
+	}
+
+	entry->positions[0] = (size_t)(sector - file->sectors);
+	if(section == NULL) {
+		entry->found = 1;
+		entry->count = sector->section_count;
+		return;
+	}
+
+	entry->positions[1] = (size_t)(section - sector->sections);
+	if(field == NULL) {
+		entry->found = 2;
+		entry->count = section->field_count;
+		return;
+	}
+
+	entry->positions[2] = (size_t)(field - section->fields);
+	entry->found = 3;
+}
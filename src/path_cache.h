@@ -0,0 +1,88 @@
+/* path_cache.h ; marie config format internal path lookup cache header
+ * for MCFG/2
+ *
+ * Copyright (c) 2025, Marie Eckert
+ * Licensend under the BSD 3-Clause License.
+ */
+
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mcfg.h"
+#include "shared.h"
+
+/* This header is included by translation units with their own NAMESPACE, so
+ * the declarations are namespaced explicitly.
+ */
+#define _PATH_CACHE_DECL(name) \
+	_NAMESPACED_DECL(INTERNAL_PREFIX(path_cache), name)
+
+/**
+ * @brief Paths longer than this are never cached, this allows the keys to be
+ * stored inside of the cache entries themselves.
+ */
+#define PATH_CACHE_KEY_MAX 64
+
+#define path_cache_new _PATH_CACHE_DECL(path_cache_new)
+
+/**
+ * @brief Create a new direct-mapped path cache.
+ * @param slot_count The number of entries, rounded up to the next power of two
+ * @return The new cache, NULL if the allocation failed.
+ */
+mcfg_path_cache_t *path_cache_new(size_t slot_count);
+
+#define path_cache_destroy _PATH_CACHE_DECL(path_cache_destroy)
+
+/**
+ * @brief Free the given cache.
+ */
+void path_cache_destroy(mcfg_path_cache_t *cache);
+
+#define path_cache_lookup _PATH_CACHE_DECL(path_cache_lookup)
+
+/**
+ * @brief Look up a path in the cache. Entries store the positions of the
+ * elements a path resolved to instead of pointers, since the arrays holding
+ * them are reallocated whenever elements are added. Elements are never removed
+ * or reordered, so a found position stays valid. A cached miss is only valid as
+ * long as the container the missing element was searched in did not grow.
+ * @param cache The cache to search in
+ * @param file The file the cache belongs to
+ * @param key The path string, does not need to be NULL-terminated
+ * @param length The length of key in bytes
+ * @param field Pointer to write the cached field to on a hit, the cached
+ * field can be NULL if the path was cached as not existing.
+ * @return true on a hit.
+ */
+bool path_cache_lookup(mcfg_path_cache_t *cache,
+					   mcfg_file_t *file,
+					   const char *key,
+					   size_t length,
+					   mcfg_field_t **field);
+
+#define path_cache_store _PATH_CACHE_DECL(path_cache_store)
+
+/**
+ * @brief Store the result of resolving a path in the cache, replacing whatever
+ * entry occupied its slot.
+ * @param cache The cache to store in
+ * @param file The file the cache belongs to
+ * @param key The path string, does not need to be NULL-terminated
+ * @param length The length of key in bytes
+ * @param sector The sector the path resolved to, NULL if not found
+ * @param section The section the path resolved to, NULL if not found
+ * @param field The field the path resolved to, NULL if not found
+ */
+void path_cache_store(mcfg_path_cache_t *cache,
+					  mcfg_file_t *file,
+					  const char *key,
+					  size_t length,
+					  mcfg_sector_t *sector,
+					  mcfg_section_t *section,
+					  mcfg_field_t *field);
+
+#endif	// ifndef PATH_CACHE_H
@@ -7,16 +7,24 @@
 
 #define _XOPEN_SOURCE	700
 #define _POSIX_C_SOURCE 2
+#define _DEFAULT_SOURCE /* pwritev */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
-#include "cptrlist.h"
 #include "mcfg.h"
 #include "mcfg_util.h"
 #include "serialize.h"
 #include "shared.h"
+#include "stats.h"
 
 #define NAMESPACE		serialize
 
@@ -33,528 +41,1331 @@
 #define KEYWORD_I32		"i32"
 #define KEYWORD_U32		"u32"
 
-#undef ERR_CHECK
+/* size of the buffer used when streaming, the peak memory use of a streamed
+ * serialization does not depend on the size of the output
+ */
+#define STREAM_BUFFER_SIZE (64 * 1024)
+
+/* the amount of buffer ranges and direct writes collected for one writev */
+#define STREAM_IOV_COUNT 64
+
+/* writes of at least this size are not copied into the buffer, but passed on
+ * as they are
+ */
+#define STREAM_DIRECT_SIZE 512
+
+/* space for the suffix of temporary files: a pid, a counter and ".tmp" */
+#define TEMP_SUFFIX_SIZE 64
+
+/* internal helper functions */
+
+#define _writev_all		  NAMESPACED_DECL(_writev_all)
+#define _stream_flush	  NAMESPACED_DECL(_stream_flush)
+#define _stream_close_range NAMESPACED_DECL(_stream_close_range)
+#define _stream_put		  NAMESPACED_DECL(_stream_put)
+#define _write			  NAMESPACED_DECL(_write)
+#define _write_cstr		  NAMESPACED_DECL(_write_cstr)
+#define _write_indent	  NAMESPACED_DECL(_write_indent)
+#define _write_string	  NAMESPACED_DECL(_write_string)
+#define _write_data		  NAMESPACED_DECL(_write_data)
+#define _write_value	  NAMESPACED_DECL(_write_value)
+#define _type_keyword	  NAMESPACED_DECL(_type_keyword)
+#define _write_field	  NAMESPACED_DECL(_write_field)
+#define _write_section	  NAMESPACED_DECL(_write_section)
+#define _write_unit		  NAMESPACED_DECL(_write_unit)
+#define _write_sector	  NAMESPACED_DECL(_write_sector)
+#define _write_file		  NAMESPACED_DECL(_write_file)
+#define _run_workers	  NAMESPACED_DECL(_run_workers)
+#define _measure_worker	  NAMESPACED_DECL(_measure_worker)
+#define _write_worker	  NAMESPACED_DECL(_write_worker)
+#define _prepare_job	  NAMESPACED_DECL(_prepare_job)
+#define _worker_count	  NAMESPACED_DECL(_worker_count)
+#define _positioned_offset NAMESPACED_DECL(_positioned_offset)
+#define _sector_dirty	  NAMESPACED_DECL(_sector_dirty)
+#define _cache_sector	  NAMESPACED_DECL(_cache_sector)
+#define _compare_writer	  NAMESPACED_DECL(_compare_writer)
+#define _unchanged		  NAMESPACED_DECL(_unchanged)
+#define _open_temp		  NAMESPACED_DECL(_open_temp)
+#define _sync_dir		  NAMESPACED_DECL(_sync_dir)
 
 /**
- * Returns an error if the given value is not equal to MCFG_OK.
- * Works only in functions which return a struct called "result" which has an
- * mcfg_err_t field called err and a label called "exit" to jump to on error.
+ * @brief Output of a streamed serialization. Small writes are collected in a
+ * fixed-size buffer, large ones are referenced where they are. Both are
+ * passed on in batches, to a file descriptor using a single writev per batch.
  */
-#define ERR_CHECK(e)         \
-	({                       \
-		mcfg_err_t _e = e;   \
-		if(_e != MCFG_OK) {  \
-			ERR_NOTE(_e);    \
-			result.err = _e; \
-			goto exit;       \
-		}                    \
-	})
+typedef struct _stream {
+	/** @brief The callback to write to, NULL to write to fd */
+	mcfg_serialize_writer_t write;
+	void *ctx;
+	int fd;
 
-#define ASSERT_OR_RETURN(c, e) ERR_CHECK((c) ? MCFG_OK : e)
+	mcfg_err_t err;
 
-#define NULL_CHECK(p, e)	   ASSERT_OR_RETURN(p != NULL, e)
+	char *buffer;
+	size_t buffered;
 
-/* internal helper functions */
+	/** @brief Start of the buffer range not yet referenced by iov */
+	size_t range_start;
+
+	/** @brief Offset in fd to write at using pwritev, -1 to use writev */
+	off_t offset;
+
+	struct iovec iov[STREAM_IOV_COUNT];
+	int iov_count;
+} _stream_t;
+
+/**
+ * @brief Destination of a serialization pass. For mcfg_serialize, the file
+ * is serialized twice: once without data to measure the exact size of the
+ * output and once more to write it into a buffer of that size, so every byte
+ * is written exactly once. Streamed serializations only use a single pass.
+ */
+typedef struct _writer {
+	/** @brief The buffer to write to, NULL when measuring or streaming */
+	char *data;
+
+	size_t length;
+
+	/** @brief The stream to write to, NULL unless streaming */
+	_stream_t *stream;
+} _writer_t;
+
+#define _write_literal(w, s) _write(w, s, sizeof(s) - 1)
 
-#define _make_indent			   NAMESPACED_DECL(_make_indent)
-#define _serialize_string		   NAMESPACED_DECL(_serialize_string)
-#define _number_serialization_func NAMESPACED_DECL(_number_serialization_func)
-#define _bool_serialization_func   NAMESPACED_DECL(_bool_serialization_func)
-#define _string_serialization_func NAMESPACED_DECL(_string_serialization_func)
+/* indentation is copied from these instead of being built for every line */
+static const char _tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+static const char _spaces[] = "                                ";
 
 /**
- * @brief Build a string used for indentation which is stored on the heap.
- * @return C-String for indentation, NULL if malloc fails.
+ * @brief Writes all of iov to fd, retrying on partial writes. If offset is
+ * not NULL, the data is written at and offset is advanced past it.
  */
-char *
-_make_indent(mcfg_serialize_options_t options, int depth)
+mcfg_err_t
+_writev_all(int fd, off_t *offset, struct iovec *iov, int count)
 {
-	if(options.tab_indentation) {
-		char *ret = malloc(depth + 1);
-		if(ret == NULL) {
-			return ret;
+	while(count > 0) {
+		ssize_t written = offset == NULL ? writev(fd, iov, count)
+										 : pwritev(fd, iov, count, *offset);
+		if(written < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			return errno | MCFG_OS_ERROR_MASK;
+		}
+
+		if(offset != NULL) {
+			*offset += written;
 		}
 
-		memset(ret, '\t', depth);
-		ret[depth] = 0;
-		return ret;
+		while(count > 0 && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+
+		if(count > 0) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
 	}
 
-	const size_t total = options.space_count * depth + 1;
-	char *ret = malloc(total);
-	if(ret == NULL) {
-		return ret;
+	return MCFG_OK;
+}
+
+/**
+ * @brief References the part of the buffer written since the last reference
+ * in iov.
+ */
+void
+_stream_close_range(_stream_t *stream)
+{
+	if(stream->buffered == stream->range_start) {
+		return;
 	}
 
-	memset(ret, ' ', total - 1);
-	ret[total] = 0;
-	return ret;
+	stream->iov[stream->iov_count] = (struct iovec){
+		.iov_base = stream->buffer + stream->range_start,
+		.iov_len = stream->buffered - stream->range_start,
+	};
+	stream->iov_count++;
+	stream->range_start = stream->buffered;
 }
 
 /**
- * @brief Converts a string into a valid MCFG/2 string (including opening and
- * closing quotes).
+ * @brief Passes everything collected so far on and empties the buffer.
  */
-mcfg_serialize_result_t
-_serialize_string(mcfg_field_t field)
+void
+_stream_flush(_stream_t *stream)
 {
-	mcfg_serialize_result_t result = {0};
-	result.value = mcfg_string_new_sized(field.size + 2);
-	NULL_CHECK(result.value, MCFG_MALLOC_FAIL);
+	_stream_close_range(stream);
 
-	char *org = (char *)field.data;
-	NULL_CHECK(org, MCFG_MALLOC_FAIL);
+	if(stream->err == MCFG_OK && stream->write == NULL) {
+		stream->err =
+			_writev_all(stream->fd, stream->offset < 0 ? NULL : &stream->offset,
+						stream->iov, stream->iov_count);
+	}
 
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, "'"));
+	for(int ix = 0; ix < stream->iov_count && stream->write != NULL &&
+					stream->err == MCFG_OK;
+		ix++) {
+		stream->err = stream->write(stream->ctx, stream->iov[ix].iov_base,
+									stream->iov[ix].iov_len);
+	}
 
-	char *current_pos = org;
-	do {
-		char *new_pos = strchrnul(current_pos, '\'');
-		const bool hit = *new_pos == '\'';
-		new_pos[0] = 0; /* set the position where strchrnul landed to NULL so
-						   that we can be sure that mcfg_string_append_cstr only
-						   appends the range we actually want to append*/
+	stream->iov_count = 0;
+	stream->buffered = 0;
+	stream->range_start = 0;
+}
 
-		ERR_CHECK(mcfg_string_append_cstr(&result.value, current_pos));
+/**
+ * @brief Writes to a stream. Data passed on directly is only read when the
+ * stream is flushed, so it has to stay valid until then. This is the case
+ * for everything from the file and for static data; the small stack buffers
+ * used for numbers are always copied.
+ */
+void
+_stream_put(_stream_t *stream, const char *src, size_t length)
+{
+	if(stream->err != MCFG_OK) {
+		return;
+	}
 
-		if(hit) {
-			ERR_CHECK(mcfg_string_append_cstr(&result.value, "''"));
-		}
+	/* one slot for the current range of the buffer, one for src */
+	if(stream->iov_count + 2 > STREAM_IOV_COUNT) {
+		_stream_flush(stream);
+	}
 
-		current_pos = new_pos + 1;
-	} while((size_t)(current_pos - org) < field.size);
+	if(length >= STREAM_DIRECT_SIZE) {
+		_stream_close_range(stream);
+		stream->iov[stream->iov_count] =
+			(struct iovec){.iov_base = (char *)src, .iov_len = length};
+		stream->iov_count++;
+		return;
+	}
+
+	if(stream->buffered + length > STREAM_BUFFER_SIZE) {
+		_stream_flush(stream);
+	}
 
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, "'"));
+	memcpy(stream->buffer + stream->buffered, src, length);
+	stream->buffered += length;
+}
 
-exit:
-	if(result.err != MCFG_OK && result.value != NULL) {
-		free(result.value);
+void
+_write(_writer_t *writer, const char *src, size_t length)
+{
+	if(writer->stream != NULL) {
+		_stream_put(writer->stream, src, length);
+	} else if(writer->data != NULL) {
+		memcpy(writer->data + writer->length, src, length);
 	}
 
-	return result;
+	writer->length += length;
+}
+
+void
+_write_cstr(_writer_t *writer, const char *src)
+{
+	_write(writer, src, strlen(src));
+}
+
+void
+_write_indent(_writer_t *writer, mcfg_serialize_options_t options, int depth)
+{
+	const char *table = options.tab_indentation ? _tabs : _spaces;
+	const size_t table_len =
+		options.tab_indentation ? sizeof(_tabs) - 1 : sizeof(_spaces) - 1;
+
+	size_t remaining = options.tab_indentation
+						   ? (size_t)depth
+						   : (size_t)options.space_count * depth;
+
+	while(remaining > 0) {
+		const size_t chunk = remaining < table_len ? remaining : table_len;
+		_write(writer, table, chunk);
+		remaining -= chunk;
+	}
 }
 
 /**
- * @brief This type is primarly used to cleanup the logic in
- * serialize_list_field. These functions are currently not used
- * in any other serialize_..._field functions to avoid reallocations.
- * @see serialize_list_field
+ * @brief Writes a string as valid MCFG/2 string (including opening and
+ * closing quotes), doubling every quote inside of it.
  */
-typedef mcfg_err_t(list_serialization_func_t)(mcfg_field_t field,
-											  mcfg_string_t **dest);
+void
+_write_string(_writer_t *writer, const char *value)
+{
+	_write_literal(writer, "'");
+
+	const char *quote;
+	while((quote = strchr(value, '\'')) != NULL) {
+		_write(writer, value, quote - value);
+		_write_literal(writer, "''");
+		value = quote + 1;
+	}
+
+	_write_cstr(writer, value);
+	_write_literal(writer, "'");
+}
 
 /**
- * @brief Generic serialization function for number types.
- * @see list_serialization_func_t
+ * @brief Writes the value of a non-list field.
  */
 mcfg_err_t
-_number_serialization_func(mcfg_field_t field, mcfg_string_t **dest)
+_write_data(_writer_t *writer, mcfg_field_t field)
 {
-	char *temp = mcfg_data_to_string(field);
-	mcfg_err_t result = mcfg_string_append_cstr(dest, temp);
-	free(temp);
-	return result;
+	switch(field.type) {
+		case TYPE_STRING:
+			if(field.data == NULL) {
+				return MCFG_NULLPTR;
+			}
+
+			_write_string(writer, mcfg_data_as_string(field));
+			return MCFG_OK;
+		case TYPE_BOOL:
+			_write_cstr(writer, mcfg_data_as_bool(field) ? "true" : "false");
+			return MCFG_OK;
+		case TYPE_I8:
+		case TYPE_U8:
+		case TYPE_I16:
+		case TYPE_U16:
+		case TYPE_I32:
+		case TYPE_U32: {
+			char number[MCFG_NUMBER_BUFFER_SIZE];
+			_write(writer, number,
+				   mcfg_data_to_buffer(field, number, sizeof(number)));
+			return MCFG_OK;
+		}
+		default:
+			return MCFG_INVALID_TYPE;
+	}
 }
 
 /**
- * @brief Generic serialization function for booleans.
- * @see list_serialization_func_t
+ * @brief Get the keyword of a non-list type, NULL if there is none.
  */
-mcfg_err_t
-_bool_serialization_func(mcfg_field_t field, mcfg_string_t **dest)
+const char *
+_type_keyword(mcfg_field_type_t type)
 {
-	return mcfg_string_append_cstr(dest,
-								   mcfg_data_as_bool(field) ? "true" : "false");
+	switch(type) {
+		case TYPE_STRING:
+			return KEYWORD_STR;
+		case TYPE_BOOL:
+			return KEYWORD_BOOL;
+		case TYPE_I8:
+			return KEYWORD_I8;
+		case TYPE_U8:
+			return KEYWORD_U8;
+		case TYPE_I16:
+			return KEYWORD_I16;
+		case TYPE_U16:
+			return KEYWORD_U16;
+		case TYPE_I32:
+			return KEYWORD_I32;
+		case TYPE_U32:
+			return KEYWORD_U32;
+		default:
+			return NULL;
+	}
 }
 
 /**
- * @brief Generic serialization function for strings.
- * @see _serialize_string
- * @see list_serialization_func_t
+ * @brief Writes the value of a field, the elements of a list are separated by
+ * commas.
  */
 mcfg_err_t
-_string_serialization_func(mcfg_field_t field, mcfg_string_t **dest)
+_write_value(_writer_t *writer, mcfg_field_t field)
 {
-	mcfg_serialize_result_t result = _serialize_string(field);
-	ERR_CHECK(result.err);
-	ERR_CHECK(mcfg_string_append(dest, result.value));
+	if(field.type != TYPE_LIST) {
+		return _write_data(writer, field);
+	}
 
-exit:
-	if(result.value != NULL) {
-		free(result.value);
+	mcfg_list_t *list = mcfg_data_as_list(field);
+	if(list == NULL) {
+		return MCFG_NULLPTR;
 	}
-	return result.err;
-}
 
-/* serialize.h functions */
+	for(size_t ix = 0; ix < list->field_count; ix++) {
+		if(ix > 0) {
+			_write_literal(writer, ", ");
+		}
 
-mcfg_serialize_result_t
-serialize_file(mcfg_file_t file, mcfg_serialize_options_t options)
+		const mcfg_err_t err = _write_data(writer, list->fields[ix]);
+		if(err != MCFG_OK) {
+			return err;
+		}
+	}
+
+	return MCFG_OK;
+}
+
+mcfg_err_t
+_write_field(_writer_t *writer,
+			 mcfg_field_t field,
+			 mcfg_serialize_options_t options)
 {
-	mcfg_serialize_result_t result = {0};
+	_write_indent(writer, options, 2);
 
-	CPtrList sector_strings;
-	ASSERT_OR_RETURN(cptrlist_init(&sector_strings, 16, 16), MCFG_MALLOC_FAIL);
+	if(field.type != TYPE_LIST) {
+		const char *keyword = _type_keyword(field.type);
+		if(keyword == NULL) {
+			return MCFG_INVALID_TYPE;
+		}
 
-	size_t result_size = 0;
+		_write_cstr(writer, keyword);
+		_write_literal(writer, " ");
+		_write_cstr(writer, field.name);
+		_write_literal(writer, " ");
+		return _write_data(writer, field);
+	}
 
-	for(size_t ix = 0; ix < file.sector_count; ix++) {
-		result = serialize_sector(file.sectors[ix], options);
-		if(result.err != MCFG_OK) {
-			goto exit;
+	mcfg_list_t *list = mcfg_data_as_list(field);
+	if(list == NULL) {
+		return MCFG_NULLPTR;
+	}
+
+	const char *keyword = _type_keyword(list->type);
+	if(keyword == NULL) {
+		return MCFG_INVALID_TYPE;
+	}
+
+	_write_literal(writer, KEYWORD_LIST " ");
+	_write_cstr(writer, keyword);
+	_write_literal(writer, " ");
+	_write_cstr(writer, field.name);
+	_write_literal(writer, " ");
+
+	return _write_value(writer, field);
+}
+
+mcfg_err_t
+_write_section(_writer_t *writer,
+			   mcfg_section_t section,
+			   mcfg_serialize_options_t options)
+{
+	_write_indent(writer, options, 1);
+	_write_literal(writer, KEYWORD_SECTION " ");
+	_write_cstr(writer, section.name);
+	_write_literal(writer, "\n");
+
+	for(size_t ix = 0; ix < section.field_count; ix++) {
+		const mcfg_err_t err =
+			_write_field(writer, section.fields[ix], options);
+		if(err != MCFG_OK) {
+			return err;
 		}
 
-		result_size += result.value->length;
-		ASSERT_OR_RETURN(cptrlist_append(&sector_strings, result.value) >= 0,
-						 MCFG_MALLOC_FAIL);
+		_write_literal(writer, "\n");
 	}
 
-	result.value = mcfg_string_new_sized(result_size + 1);
-	NULL_CHECK(result.value, MCFG_MALLOC_FAIL);
+	_write_indent(writer, options, 1);
+	_write_literal(writer, KEYWORD_END "\n");
 
-	size_t copy_offset = 0;
-	for(size_t ix = 0; ix < sector_strings.size; ix++) {
-		mcfg_string_t *item = ((mcfg_string_t *)sector_strings.items[ix]);
+	return MCFG_OK;
+}
 
-		memcpy(result.value->data + copy_offset, item->data, item->length);
-		copy_offset += item->length;
+/**
+ * @brief A part of the file which can be serialized independently of all
+ * others: one section, including the start of its sector if it is the first
+ * section and the end of it if it is the last one. A sector without
+ * sections is a unit of its own.
+ */
+typedef struct _unit {
+	const mcfg_sector_t *sector;
+	size_t section;
+
+	/** @brief The length of the serialized unit, set when measuring */
+	size_t length;
+} _unit_t;
+
+mcfg_err_t
+_write_unit(_writer_t *writer, _unit_t unit, mcfg_serialize_options_t options)
+{
+	if(unit.section == 0) {
+		_write_literal(writer, KEYWORD_SECTOR " ");
+		_write_cstr(writer, unit.sector->name);
+		_write_literal(writer, "\n");
 	}
 
-	result.value->data[result_size] = 0;
+	if(unit.section < unit.sector->section_count) {
+		if(unit.section > 0) {
+			_write_literal(writer, "\n");
+		}
 
-exit:
-	cptrlist_destroy(&sector_strings);
-	return result;
+		const mcfg_err_t err = _write_section(
+			writer, unit.sector->sections[unit.section], options);
+		if(err != MCFG_OK) {
+			return err;
+		}
+	}
+
+	if(unit.section + 1 >= unit.sector->section_count) {
+		_write_literal(writer, KEYWORD_END "\n\n");
+	}
+
+	return MCFG_OK;
 }
 
-mcfg_serialize_result_t
-serialize_sector(mcfg_sector_t sector, mcfg_serialize_options_t options)
+mcfg_err_t
+_write_sector(_writer_t *writer,
+			  mcfg_sector_t sector,
+			  mcfg_serialize_options_t options)
 {
-	mcfg_serialize_result_t result = {0};
+	_unit_t unit = {.sector = &sector, .section = 0};
 
-	CPtrList section_strings;
-	ASSERT_OR_RETURN((cptrlist_init(&section_strings, 16, 16)),
-					 MCFG_MALLOC_FAIL);
+	do {
+		const mcfg_err_t err = _write_unit(writer, unit, options);
+		if(err != MCFG_OK) {
+			return err;
+		}
 
-	size_t result_size = 0;
-	for(size_t ix = 0; ix < sector.section_count; ix++) {
-		result = serialize_section(sector.sections[ix], options);
-		if(result.err != MCFG_OK) {
-			goto exit;
+		unit.section++;
+	} while(unit.section < sector.section_count);
+
+	return MCFG_OK;
+}
+
+mcfg_err_t
+_write_file(_writer_t *writer,
+			mcfg_file_t file,
+			mcfg_serialize_options_t options)
+{
+	for(size_t ix = 0; ix < file.sector_count; ix++) {
+		const mcfg_err_t err = _write_sector(writer, file.sectors[ix], options);
+		if(err != MCFG_OK) {
+			return err;
+		}
+	}
+
+	return MCFG_OK;
+}
+
+/**
+ * @brief A contiguous run of units written by one worker.
+ */
+typedef struct _range {
+	size_t first_unit;
+	size_t unit_count;
+
+	/** @brief Offset of the first unit in the output */
+	size_t offset;
+} _range_t;
+
+/**
+ * @brief Shared state of a parallel serialization. Workers first measure the
+ * units, picking them up one by one. The units are then split into ranges of
+ * about the same length, each of which is written by a single worker
+ * directly to its offset in the output, so no worker output is copied.
+ */
+typedef struct _job {
+	mcfg_serialize_options_t options;
+
+	size_t unit_count;
+	_unit_t *units;
+
+	/** @brief The next unit to be measured by a worker */
+	size_t next_unit;
+
+	/** @brief The first error found when measuring */
+	mcfg_err_t err;
+
+	size_t range_count;
+	_range_t ranges[MCFG_SERIALIZE_MAX_WORKERS];
+
+	/** @brief The next range to be written by a worker */
+	size_t next_range;
+
+	/** @brief The buffer to write to, NULL to write to fd */
+	char *data;
+	int fd;
+	off_t fd_offset;
+} _job_t;
+
+/**
+ * @brief Runs worker on nthreads threads, one of which is the calling thread.
+ * Workers pick up their work from the job themselves, so if not all threads
+ * can be started the remaining ones do all of it.
+ */
+void
+_run_workers(void *(*worker)(void *), _job_t *job, size_t nthreads)
+{
+	pthread_t threads[MCFG_SERIALIZE_MAX_WORKERS];
+	size_t started = 0;
+
+	for(; started + 1 < nthreads; started++) {
+		if(pthread_create(&threads[started], NULL, worker, job) != 0) {
+			break;
 		}
+	}
+
+	worker(job);
 
-		result_size += result.value->length;
-		ASSERT_OR_RETURN(cptrlist_append(&section_strings, result.value) >= 0,
-						 MCFG_MALLOC_FAIL);
+	for(size_t ix = 0; ix < started; ix++) {
+		pthread_join(threads[ix], NULL);
 	}
+}
 
-	result.value =
-		mcfg_string_new_sized(result_size + sizeof(KEYWORD_SECTOR) +
-							  sizeof(KEYWORD_END) + 1 + strlen(sector.name));
-	NULL_CHECK(result.value, MCFG_MALLOC_FAIL);
+void *
+_measure_worker(void *arg)
+{
+	_job_t *job = arg;
+
+	for(;;) {
+		const size_t ix =
+			__atomic_fetch_add(&job->next_unit, 1, __ATOMIC_RELAXED);
+		if(ix >= job->unit_count) {
+			break;
+		}
+
+		_writer_t writer = {.data = NULL, .length = 0, .stream = NULL};
+		const mcfg_err_t err =
+			_write_unit(&writer, job->units[ix], job->options);
+		if(err != MCFG_OK) {
+			mcfg_err_t expected = MCFG_OK;
+			__atomic_compare_exchange_n(&job->err, &expected, err, false,
+										__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		}
 
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, KEYWORD_SECTOR " "));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, sector.name));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, "\n"));
+		job->units[ix].length = writer.length;
+	}
 
-	for(size_t ix = 0; ix < section_strings.size; ix++) {
-		mcfg_string_t *item = ((mcfg_string_t *)section_strings.items[ix]);
-		ERR_CHECK(mcfg_string_append(&result.value, item));
+	return NULL;
+}
 
-		if(ix + 1 < section_strings.size) {
-			ERR_CHECK(mcfg_string_append_cstr(&result.value, "\n"));
+void *
+_write_worker(void *arg)
+{
+	_job_t *job = arg;
+
+	_stream_t stream = {
+		.write = NULL,
+		.fd = job->fd,
+		.err = MCFG_OK,
+		.buffer = NULL,
+	};
+
+	if(job->data == NULL) {
+		stream.buffer = malloc(STREAM_BUFFER_SIZE);
+		if(stream.buffer == NULL) {
+			stream.err = MCFG_MALLOC_FAIL;
 		}
 	}
 
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, KEYWORD_END "\n\n"));
+	for(;;) {
+		const size_t ix =
+			__atomic_fetch_add(&job->next_range, 1, __ATOMIC_RELAXED);
+		if(ix >= job->range_count) {
+			break;
+		}
+
+		const _range_t range = job->ranges[ix];
+		_writer_t writer = {.data = NULL, .length = 0, .stream = NULL};
+		if(job->data != NULL) {
+			writer.data = job->data + range.offset;
+		} else {
+			stream.offset = job->fd_offset + range.offset;
+			writer.stream = &stream;
+		}
+
+		for(size_t unit = 0; unit < range.unit_count; unit++) {
+			_write_unit(&writer, job->units[range.first_unit + unit],
+						job->options);
+		}
 
-exit:
-	cptrlist_destroy(&section_strings);
-	if(result.err != MCFG_OK && result.value != NULL) {
-		free(result.value);
+		if(writer.stream != NULL) {
+			_stream_flush(&stream);
+		}
 	}
-	return result;
+
+	if(stream.err != MCFG_OK) {
+		mcfg_err_t expected = MCFG_OK;
+		__atomic_compare_exchange_n(&job->err, &expected, stream.err, false,
+									__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+
+	free(stream.buffer);
+	return NULL;
 }
 
-mcfg_serialize_result_t
-serialize_section(mcfg_section_t section, mcfg_serialize_options_t options)
+/**
+ * @brief Splits the file into units and measures them.
+ * @return The total length of the output, the error is stored in job.
+ */
+size_t
+_prepare_job(_job_t *job,
+			 mcfg_file_t file,
+			 mcfg_serialize_options_t options,
+			 size_t nthreads)
 {
-	mcfg_serialize_result_t result = {0};
-	char *indent = _make_indent(options, 1);
-	CPtrList field_strings;
+	job->options = options;
+	job->err = MCFG_OK;
+	job->next_unit = 0;
+	job->next_range = 0;
+	job->range_count = 0;
+	job->data = NULL;
+	job->fd = -1;
+	job->fd_offset = -1;
+
+	job->unit_count = 0;
+	for(size_t ix = 0; ix < file.sector_count; ix++) {
+		const size_t section_count = file.sectors[ix].section_count;
+		job->unit_count += section_count > 0 ? section_count : 1;
+	}
 
-	ASSERT_OR_RETURN(cptrlist_init(&field_strings, 16, 16), MCFG_MALLOC_FAIL);
-	NULL_CHECK(indent, MCFG_MALLOC_FAIL);
+	job->units = malloc(sizeof(*job->units) * job->unit_count);
+	if(job->units == NULL) {
+		job->err = MCFG_MALLOC_FAIL;
+		return 0;
+	}
 
-	size_t result_size = 0;
-	for(size_t ix = 0; ix < section.field_count; ix++) {
-		mcfg_field_t field = section.fields[ix];
-		switch(field.type) {
-			case TYPE_STRING:
-				result = serialize_string_field(field, options);
-				break;
-			case TYPE_LIST:
-				result = serialize_list_field(field, options);
-				break;
-			case TYPE_BOOL:
-				result = serialize_bool_field(field, options);
-				break;
-			case TYPE_I8:
-			case TYPE_U8:
-			case TYPE_I16:
-			case TYPE_U16:
-			case TYPE_I32:
-			case TYPE_U32:
-				result = serialize_number_field(field, options);
-				break;
-			case TYPE_INVALID:
-				result.err = MCFG_INVALID_TYPE;
-				goto exit;
-		}
-
-		ERR_CHECK(result.err);
-
-		if(result.value == NULL) {
+	size_t unit_ix = 0;
+	for(size_t ix = 0; ix < file.sector_count; ix++) {
+		size_t section = 0;
+		do {
+			job->units[unit_ix] =
+				(_unit_t){.sector = &file.sectors[ix], .section = section};
+			unit_ix++;
+			section++;
+		} while(section < file.sectors[ix].section_count);
+	}
+
+	_run_workers(_measure_worker, job, nthreads);
+	if(job->err != MCFG_OK) {
+		return 0;
+	}
+
+	size_t total = 0;
+	for(size_t ix = 0; ix < job->unit_count; ix++) {
+		total += job->units[ix].length;
+	}
+
+	/* a range is closed once the output up to its end reaches its share, the
+	 * last range takes all remaining units
+	 */
+	size_t offset = 0;
+	size_t range_offset = 0;
+	size_t first_unit = 0;
+	for(size_t ix = 0; ix < job->unit_count; ix++) {
+		offset += job->units[ix].length;
+
+		const bool last = ix + 1 == job->unit_count;
+		const bool full =
+			offset >= total / nthreads * (job->range_count + 1) &&
+			job->range_count + 1 < nthreads;
+		if(!last && !full) {
 			continue;
 		}
 
-		result_size += result.value->length;
-		ASSERT_OR_RETURN(cptrlist_append(&field_strings, result.value) >= 0,
-						 MCFG_MALLOC_FAIL);
+		job->ranges[job->range_count] = (_range_t){
+			.first_unit = first_unit,
+			.unit_count = ix + 1 - first_unit,
+			.offset = range_offset,
+		};
+		job->range_count++;
+
+		first_unit = ix + 1;
+		range_offset = offset;
 	}
 
-	result.value = mcfg_string_new_sized(
-		result_size + strlen(indent) + sizeof(KEYWORD_SECTION) +
-		sizeof(KEYWORD_END) + 1 + strlen(section.name));
-	NULL_CHECK(result.value, MCFG_MALLOC_FAIL);
+	return total;
+}
 
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, indent));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, KEYWORD_SECTION " "));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, section.name));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, "\n"));
+/**
+ * @brief The amount of workers to use for a serialization.
+ */
+size_t
+_worker_count(mcfg_file_t file, mcfg_serialize_options_t options)
+{
+	if(options.worker_count <= 1 || file.sector_count == 0) {
+		return 1;
+	}
 
-	for(size_t ix = 0; ix < field_strings.size; ix++) {
-		mcfg_string_t *item = ((mcfg_string_t *)field_strings.items[ix]);
-		ERR_CHECK(mcfg_string_append(&result.value, item));
+	return options.worker_count > MCFG_SERIALIZE_MAX_WORKERS
+			   ? MCFG_SERIALIZE_MAX_WORKERS
+			   : (size_t)options.worker_count;
+}
 
-		ERR_CHECK(mcfg_string_append_cstr(&result.value, "\n"));
+/**
+ * @brief The current offset of a file descriptor, if the output of multiple
+ * workers can be written into it at fixed offsets. On a descriptor opened with
+ * O_APPEND, pwritev ignores the offset, so those are not positioned.
+ * @return The current offset, -1 if the descriptor is not a regular file
+ * written at its offset.
+ */
+off_t
+_positioned_offset(int fd)
+{
+	struct stat st;
+	if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		return -1;
 	}
 
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, indent));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, KEYWORD_END "\n"));
+	const int flags = fcntl(fd, F_GETFL);
+	if(flags < 0 || (flags & O_APPEND) != 0) {
+		return -1;
+	}
+
+	return lseek(fd, 0, SEEK_CUR);
+}
 
-exit:
-	cptrlist_destroy(&field_strings);
-	if(result.err != MCFG_OK && result.value != NULL) {
-		free(result.value);
+/**
+ * @brief The serialized text of one sector.
+ */
+typedef struct _cached_sector {
+	/**
+	 * @brief The id of the sector the text belongs to, to notice when sectors
+	 * were replaced. 0 if the entry holds no valid text.
+	 */
+	uint64_t id;
+
+	char *text;
+	size_t length;
+} _cached_sector_t;
+
+struct mcfg_serialize_cache {
+	/** @brief The options all cached text was serialized with */
+	mcfg_serialize_options_t options;
+
+	/** @brief Cached text by index of the sector */
+	size_t sector_count;
+	_cached_sector_t *sectors;
+};
+
+bool
+_sector_dirty(const mcfg_sector_t *sector)
+{
+	if(sector->dirty) {
+		return true;
 	}
-	free(indent);
 
-	return result;
+	for(size_t ix = 0; ix < sector->section_count; ix++) {
+		const mcfg_section_t *section = &sector->sections[ix];
+		if(section->dirty) {
+			return true;
+		}
+
+		for(size_t field_ix = 0; field_ix < section->field_count; field_ix++) {
+			const mcfg_list_t *list =
+				mcfg_data_as_list(section->fields[field_ix]);
+			if(list != NULL && list->dirty) {
+				return true;
+			}
+		}
+	}
+
+	return false;
 }
 
-mcfg_serialize_result_t
-serialize_string_field(mcfg_field_t field, mcfg_serialize_options_t options)
+/**
+ * @brief Serializes a sector into its cache entry and clears its dirty flags.
+ */
+mcfg_err_t
+_cache_sector(_cached_sector_t *entry,
+			  mcfg_sector_t *sector,
+			  mcfg_serialize_options_t options)
+{
+	_writer_t writer = {.data = NULL, .length = 0, .stream = NULL};
+	const mcfg_err_t err = _write_sector(&writer, *sector, options);
+	if(err != MCFG_OK) {
+		return err;
+	}
+
+	char *text = realloc(entry->text, writer.length);
+	if(text == NULL && writer.length > 0) {
+		return MCFG_MALLOC_FAIL;
+	}
+
+	entry->id = sector->id;
+	entry->text = text;
+	entry->length = writer.length;
+
+	writer = (_writer_t){.data = text, .length = 0, .stream = NULL};
+	_write_sector(&writer, *sector, options);
+
+	sector->dirty = false;
+	for(size_t ix = 0; ix < sector->section_count; ix++) {
+		mcfg_section_t *section = &sector->sections[ix];
+		section->dirty = false;
+
+		for(size_t field_ix = 0; field_ix < section->field_count; field_ix++) {
+			mcfg_list_t *list = mcfg_data_as_list(section->fields[field_ix]);
+			if(list != NULL) {
+				list->dirty = false;
+			}
+		}
+	}
+
+	return MCFG_OK;
+}
+
+/**
+ * @brief Compares serialized text to the contents of a file, which are read
+ * in blocks of the size of the stream buffer.
+ */
+typedef struct _compare {
+	int fd;
+
+	char *block;
+	size_t block_length;
+	size_t block_pos;
+
+	/** @brief The total amount of text compared */
+	size_t compared;
+	bool differs;
+} _compare_t;
+
+mcfg_err_t
+_compare_writer(void *ctx, const char *data, size_t length)
 {
-	mcfg_serialize_result_t result = {0};
+	_compare_t *compare = ctx;
+
+	while(length > 0) {
+		if(compare->block_pos == compare->block_length) {
+			ssize_t got;
+			do {
+				got = read(compare->fd, compare->block, STREAM_BUFFER_SIZE);
+			} while(got < 0 && errno == EINTR);
+
+			if(got < 0) {
+				return errno | MCFG_OS_ERROR_MASK;
+			}
 
-	char *indent = _make_indent(options, 2);
-	mcfg_serialize_result_t string_value = _serialize_string(field);
-	ERR_CHECK(string_value.err);
-	NULL_CHECK(indent, MCFG_MALLOC_FAIL);
+			compare->block_length = got;
+			compare->block_pos = 0;
+		}
 
-	result.value = mcfg_string_new_sized(
-		sizeof(KEYWORD_STR) + strlen(field.name) + string_value.value->length);
-	NULL_CHECK(result.value, MCFG_MALLOC_FAIL);
+		size_t chunk = compare->block_length - compare->block_pos;
+		chunk = chunk < length ? chunk : length;
 
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, indent));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, KEYWORD_STR " "));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, field.name));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, " "));
-	ERR_CHECK(mcfg_string_append(&result.value, string_value.value));
+		/* the file ended early or its contents differ; stop serializing */
+		if(chunk == 0 ||
+		   memcmp(compare->block + compare->block_pos, data, chunk) != 0) {
+			compare->differs = true;
+			return ECANCELED | MCFG_OS_ERROR_MASK;
+		}
 
-exit:
-	if(result.err != MCFG_OK && result.value != NULL) {
-		free(result.value);
+		compare->block_pos += chunk;
+		compare->compared += chunk;
+		data += chunk;
+		length -= chunk;
 	}
 
-	if(string_value.value != NULL) {
-		free(string_value.value);
+	return MCFG_OK;
+}
+
+/**
+ * @brief Checks if the file at fd already holds exactly the serialized text.
+ * @param unchanged Set to the result of the comparison
+ */
+mcfg_err_t
+_unchanged(int fd,
+		   off_t size,
+		   mcfg_file_t file,
+		   mcfg_serialize_options_t options,
+		   bool *unchanged)
+{
+	_compare_t compare = {
+		.fd = fd,
+		.block = malloc(STREAM_BUFFER_SIZE),
+		.block_length = 0,
+		.block_pos = 0,
+		.compared = 0,
+		.differs = false,
+	};
+
+	if(compare.block == NULL) {
+		return MCFG_MALLOC_FAIL;
 	}
 
-	if(indent != NULL) {
-		free(indent);
+	mcfg_err_t err = serialize_to(_compare_writer, &compare, -1, file, options);
+	free(compare.block);
+
+	if(compare.differs) {
+		err = MCFG_OK;
 	}
 
-	return result;
+	*unchanged = !compare.differs && compare.compared == (size_t)size;
+	return err;
 }
 
-mcfg_serialize_result_t
-serialize_list_field(mcfg_field_t field, mcfg_serialize_options_t options)
+/**
+ * @brief Creates a new temporary file next to path.
+ * @param temp_path Buffer for the path of the temporary file, which has to be
+ * at least strlen(path) + TEMP_SUFFIX_SIZE bytes long.
+ * @return The file descriptor, -1 on error with errno set.
+ */
+int
+_open_temp(const char *path, char *temp_path, mode_t mode)
 {
-	mcfg_serialize_result_t result = {0};
+	static unsigned long counter = 0;
 
-	mcfg_list_t *list = mcfg_data_as_list(field);
-	if(list == NULL) {
-		result.err = MCFG_NULLPTR;
-		return result;
+	int fd;
+	do {
+		const unsigned long id =
+			__atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+		snprintf(temp_path, strlen(path) + TEMP_SUFFIX_SIZE, "%s.%ld.%lu.tmp",
+				 path, (long)getpid(), id);
+		fd = open(temp_path, O_WRONLY | O_CREAT | O_EXCL, mode);
+	} while(fd < 0 && errno == EEXIST);
+
+	return fd;
+}
+
+/**
+ * @brief Syncs the directory containing path, so a rename within it is
+ * durable.
+ */
+mcfg_err_t
+_sync_dir(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+
+	char *dir = NULL;
+	if(slash == NULL) {
+		dir = strdup(".");
+	} else {
+		dir = strndup(path, slash == path ? 1 : (size_t)(slash - path));
 	}
 
-	char *datatype;
-	list_serialization_func_t *serialize_func;
+	if(dir == NULL) {
+		return MCFG_MALLOC_FAIL;
+	}
 
-	switch(list->type) {
-		case TYPE_I8:
-			datatype = KEYWORD_LIST " " KEYWORD_I8 " ";
-			serialize_func = &_number_serialization_func;
-			break;
-		case TYPE_U8:
-			datatype = KEYWORD_LIST " " KEYWORD_U8 " ";
-			serialize_func = &_number_serialization_func;
-			break;
-		case TYPE_I16:
-			datatype = KEYWORD_LIST " " KEYWORD_I16 " ";
-			serialize_func = &_number_serialization_func;
-			break;
-		case TYPE_U16:
-			datatype = KEYWORD_LIST " " KEYWORD_U16 " ";
-			serialize_func = &_number_serialization_func;
-			break;
-		case TYPE_I32:
-			datatype = KEYWORD_LIST " " KEYWORD_I32 " ";
-			serialize_func = &_number_serialization_func;
-			break;
-		case TYPE_U32:
-			datatype = KEYWORD_LIST " " KEYWORD_U32 " ";
-			serialize_func = &_number_serialization_func;
-			break;
-		case TYPE_BOOL:
-			datatype = KEYWORD_LIST " " KEYWORD_BOOL " ";
-			serialize_func = &_bool_serialization_func;
-			break;
-		case TYPE_STRING:
-			datatype = KEYWORD_LIST " " KEYWORD_STR " ";
-			serialize_func = &_string_serialization_func;
-			break;
-		default:
-			result.err = MCFG_INVALID_TYPE;
-			return result;
+	const int fd = open(dir, O_RDONLY);
+	free(dir);
+	if(fd < 0) {
+		return errno | MCFG_OS_ERROR_MASK;
 	}
 
-	char *indent = _make_indent(options, 2);
-	result.value = mcfg_string_new_sized(strlen(indent) + strlen(datatype) +
-										 strlen(field.name) + 2);
+	mcfg_err_t err = MCFG_OK;
+	if(fsync(fd) != 0) {
+		err = errno | MCFG_OS_ERROR_MASK;
+	}
 
-	NULL_CHECK(indent, MCFG_MALLOC_FAIL);
-	NULL_CHECK(result.value, MCFG_MALLOC_FAIL);
+	close(fd);
+	return err;
+}
 
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, indent));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, datatype));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, field.name));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, " "));
+/* serialize.h functions */
 
-	for(size_t ix = 0; ix < list->field_count; ix++) {
-		ERR_CHECK(serialize_func(list->fields[ix], &result.value));
+mcfg_serialize_result_t
+serialize_file(mcfg_file_t file, mcfg_serialize_options_t options)
+{
+	mcfg_serialize_result_t result = {.err = MCFG_OK, .value = NULL};
+
+	const size_t nthreads = _worker_count(file, options);
+	if(nthreads > 1) {
+		_job_t job;
+		const size_t length = _prepare_job(&job, file, options, nthreads);
+		if(job.err == MCFG_OK) {
+			result.value = mcfg_string_new_sized(length);
+		}
+
+		if(job.err == MCFG_OK && result.value == NULL) {
+			job.err = MCFG_MALLOC_FAIL;
+		}
 
-		if(ix + 1 < list->field_count) {
-			ERR_CHECK(mcfg_string_append_cstr(&result.value, ", "));
+		if(job.err == MCFG_OK) {
+			job.data = result.value->data;
+			_run_workers(_write_worker, &job, job.range_count);
+			result.value->length = length;
+			result.value->data[length] = 0;
 		}
+
+		free(job.units);
+		result.err = job.err;
+		return result;
 	}
 
-exit:
-	if(result.err != MCFG_OK && result.value != NULL) {
-		free(result.value);
+	/* the measuring pass is also the only one which can fail */
+	_writer_t writer = {.data = NULL, .length = 0, .stream = NULL};
+	result.err = _write_file(&writer, file, options);
+	if(result.err != MCFG_OK) {
+		return result;
 	}
 
-	if(indent != NULL) {
-		free(indent);
+	result.value = mcfg_string_new_sized(writer.length);
+	if(result.value == NULL) {
+		result.err = MCFG_MALLOC_FAIL;
+		return result;
 	}
 
+	writer = (_writer_t){
+		.data = result.value->data, .length = 0, .stream = NULL};
+	_write_file(&writer, file, options);
+
+	result.value->length = writer.length;
+	result.value->data[writer.length] = 0;
+
 	return result;
 }
 
 mcfg_serialize_result_t
-serialize_bool_field(mcfg_field_t field, mcfg_serialize_options_t options)
+serialize_value(mcfg_field_t field)
 {
-	mcfg_serialize_result_t result = {0};
-	char *indent = _make_indent(options, 2);
-	NULL_CHECK(indent, MCFG_MALLOC_FAIL);
+	mcfg_serialize_result_t result = {.err = MCFG_OK, .value = NULL};
 
-	const char *string_value = mcfg_data_as_bool(field) ? " true" : " false";
+	_writer_t writer = {.data = NULL, .length = 0, .stream = NULL};
+	result.err = _write_value(&writer, field);
+	if(result.err != MCFG_OK) {
+		return result;
+	}
 
-	result.value =
-		mcfg_string_new_sized(strlen(indent) + sizeof(KEYWORD_BOOL) +
-							  strlen(field.name) + strlen(string_value));
-	NULL_CHECK(result.value, MCFG_MALLOC_FAIL);
+	result.value = mcfg_string_new_sized(writer.length);
+	if(result.value == NULL) {
+		result.err = MCFG_MALLOC_FAIL;
+		return result;
+	}
+
+	writer = (_writer_t){
+		.data = result.value->data, .length = 0, .stream = NULL};
+	_write_value(&writer, field);
 
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, indent));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, KEYWORD_BOOL " "));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, field.name));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, string_value));
+	result.value->length = writer.length;
+	result.value->data[writer.length] = 0;
 
-exit:
-	free(indent);
 	return result;
 }
 
+mcfg_err_t
+serialize_to(mcfg_serialize_writer_t write,
+			 void *ctx,
+			 int fd,
+			 mcfg_file_t file,
+			 mcfg_serialize_options_t options)
+{
+	/* output of multiple workers can only be put together in a file which
+	 * can be written at an offset
+	 */
+	const size_t nthreads = _worker_count(file, options);
+	const off_t fd_offset =
+		write == NULL && nthreads > 1 ? _positioned_offset(fd) : -1;
+	if(fd_offset >= 0) {
+		_job_t job;
+		const size_t length = _prepare_job(&job, file, options, nthreads);
+		if(job.err == MCFG_OK) {
+			job.fd = fd;
+			job.fd_offset = fd_offset;
+			_run_workers(_write_worker, &job, job.range_count);
+		}
+
+		/* pwritev does not move the file offset */
+		if(job.err == MCFG_OK && lseek(fd, fd_offset + length, SEEK_SET) < 0) {
+			job.err = errno | MCFG_OS_ERROR_MASK;
+		}
+
+		free(job.units);
+		return job.err;
+	}
+
+	_stream_t stream = {
+		.write = write,
+		.ctx = ctx,
+		.fd = fd,
+		.err = MCFG_OK,
+		.buffer = malloc(STREAM_BUFFER_SIZE),
+		.buffered = 0,
+		.range_start = 0,
+		.offset = -1,
+		.iov_count = 0,
+	};
+
+	if(stream.buffer == NULL) {
+		return MCFG_MALLOC_FAIL;
+	}
+
+	_writer_t writer = {.data = NULL, .length = 0, .stream = &stream};
+	mcfg_err_t err = _write_file(&writer, file, options);
+
+	_stream_flush(&stream);
+	free(stream.buffer);
+
+	return err != MCFG_OK ? err : stream.err;
+}
+
+mcfg_err_t
+serialize_stdio_writer(void *ctx, const char *data, size_t length)
+{
+	if(fwrite(data, 1, length, (FILE *)ctx) != length) {
+		return errno | MCFG_OS_ERROR_MASK;
+	}
+
+	return MCFG_OK;
+}
+
 mcfg_serialize_result_t
-serialize_number_field(mcfg_field_t field, mcfg_serialize_options_t options)
+serialize_file_cached(mcfg_file_t file, mcfg_serialize_options_t options)
 {
-	mcfg_serialize_result_t result = {0};
+	mcfg_serialize_result_t result = {.err = MCFG_OK, .value = NULL};
+	mcfg_serialize_cache_t *cache = file.serialize_cache;
 
-	char *string_value = mcfg_data_to_string(field);
+	const bool options_changed =
+		cache->options.tab_indentation != options.tab_indentation ||
+		(!options.tab_indentation &&
+		 cache->options.space_count != options.space_count);
 
-	char *indent = _make_indent(options, 2);
-	NULL_CHECK(indent, MCFG_MALLOC_FAIL);
+	/* entries of removed sectors are dropped, new ones start out empty */
+	for(size_t ix = file.sector_count; ix < cache->sector_count; ix++) {
+		free(cache->sectors[ix].text);
+	}
 
-	char *datatype;
-	switch(field.type) {
-		case TYPE_I8:
-			datatype = KEYWORD_I8 " ";
-			break;
-		case TYPE_U8:
-			datatype = KEYWORD_U8 " ";
-			break;
-		case TYPE_I16:
-			datatype = KEYWORD_I16 " ";
-			break;
-		case TYPE_U16:
-			datatype = KEYWORD_U16 " ";
-			break;
-		case TYPE_I32:
-			datatype = KEYWORD_I32 " ";
-			break;
-		case TYPE_U32:
-			datatype = KEYWORD_U32 " ";
-			break;
-		default:
-			result.err = MCFG_INVALID_TYPE;
-			goto exit;
+	if(cache->sector_count > file.sector_count) {
+		cache->sector_count = file.sector_count;
 	}
 
-	result.value =
-		mcfg_string_new_sized(strlen(indent) + strlen(datatype) +
-							  strlen(field.name) + strlen(string_value) + 3);
-	NULL_CHECK(result.value, MCFG_MALLOC_FAIL);
+	if(cache->sector_count < file.sector_count) {
+		_cached_sector_t *sectors = realloc(
+			cache->sectors, sizeof(*cache->sectors) * file.sector_count);
+		if(sectors == NULL) {
+			result.err = MCFG_MALLOC_FAIL;
+			return result;
+		}
 
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, indent));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, datatype));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, field.name));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, " "));
-	ERR_CHECK(mcfg_string_append_cstr(&result.value, string_value));
+		for(size_t ix = cache->sector_count; ix < file.sector_count; ix++) {
+			sectors[ix] = (_cached_sector_t){0};
+		}
 
-exit:
-	if(result.err != MCFG_OK) {
-		if(result.value != NULL) {
-			free(result.value);
+		cache->sectors = sectors;
+		cache->sector_count = file.sector_count;
+	}
+
+	cache->options = options;
+
+	size_t length = 0;
+	for(size_t ix = 0; ix < file.sector_count; ix++) {
+		_cached_sector_t *entry = &cache->sectors[ix];
+		mcfg_sector_t *sector = &file.sectors[ix];
+
+		if(options_changed || sector->id == 0 || entry->id != sector->id ||
+		   _sector_dirty(sector)) {
+			result.err = _cache_sector(entry, sector, options);
 		}
+
+		if(result.err != MCFG_OK) {
+			/* the entry may hold text of another sector or other options */
+			entry->id = 0;
+			return result;
+		}
+
+		length += entry->length;
+	}
+
+	result.value = mcfg_string_new_sized(length);
+	if(result.value == NULL) {
+		result.err = MCFG_MALLOC_FAIL;
+		return result;
 	}
 
-	if(string_value != NULL) {
-		free(string_value);
+	char *out = result.value->data;
+	for(size_t ix = 0; ix < file.sector_count; ix++) {
+		memcpy(out, cache->sectors[ix].text, cache->sectors[ix].length);
+		out += cache->sectors[ix].length;
 	}
 
-	free(indent);
+	result.value->length = length;
+	result.value->data[length] = 0;
 
 	return result;
 }
+
+mcfg_serialize_cache_t *
+serialize_cache_new(void)
+{
+	mcfg_serialize_cache_t *cache = malloc(sizeof(*cache));
+	if(cache == NULL) {
+		return NULL;
+	}
+
+	cache->options = MCFG_DEFAULT_SERIALIZE_OPTIONS;
+	cache->sector_count = 0;
+	cache->sectors = NULL;
+	return cache;
+}
+
+void
+serialize_cache_destroy(mcfg_serialize_cache_t *cache)
+{
+	for(size_t ix = 0; ix < cache->sector_count; ix++) {
+		free(cache->sectors[ix].text);
+	}
+
+	free(cache->sectors);
+	free(cache);
+}
+
+mcfg_err_t
+serialize_to_path(const char *path,
+				  mcfg_file_t file,
+				  mcfg_serialize_options_t options,
+				  int flags)
+{
+	mode_t mode = 0666;
+	bool exists = false;
+
+	const int existing = open(path, O_RDONLY);
+	if(existing >= 0) {
+		struct stat st;
+		mcfg_err_t err = MCFG_OK;
+		bool unchanged = false;
+
+		if(fstat(existing, &st) != 0) {
+			err = errno | MCFG_OS_ERROR_MASK;
+		} else {
+			exists = true;
+			mode = st.st_mode & 07777;
+		}
+
+		if(err == MCFG_OK && (flags & MCFG_SERIALIZE_SKIP_UNCHANGED)) {
+			err = _unchanged(existing, st.st_size, file, options, &unchanged);
+		}
+
+		close(existing);
+		if(err != MCFG_OK || unchanged) {
+			return err;
+		}
+	} else if(errno != ENOENT) {
+		return errno | MCFG_OS_ERROR_MASK;
+	}
+
+	char *temp_path = malloc(strlen(path) + TEMP_SUFFIX_SIZE);
+	if(temp_path == NULL) {
+		return MCFG_MALLOC_FAIL;
+	}
+
+	const int fd = _open_temp(path, temp_path, mode);
+	if(fd < 0) {
+		free(temp_path);
+		return errno | MCFG_OS_ERROR_MASK;
+	}
+
+	/* the mode given to open is restricted by the umask */
+	mcfg_err_t err = MCFG_OK;
+	if(exists && fchmod(fd, mode) != 0) {
+		err = errno | MCFG_OS_ERROR_MASK;
+	}
+
+	if(err == MCFG_OK) {
+		err = serialize_to(NULL, NULL, fd, file, options);
+	}
+
+	if(err == MCFG_OK && fsync(fd) != 0) {
+		err = errno | MCFG_OS_ERROR_MASK;
+	}
+
+	if(close(fd) != 0 && err == MCFG_OK) {
+		err = errno | MCFG_OS_ERROR_MASK;
+	}
+
+	if(err == MCFG_OK && rename(temp_path, path) != 0) {
+		err = errno | MCFG_OS_ERROR_MASK;
+	}
+
+	if(err != MCFG_OK) {
+		unlink(temp_path);
+	} else {
+		err = _sync_dir(path);
+	}
+
+	free(temp_path);
+	return err;
+}
@@ -17,30 +17,51 @@
 mcfg_serialize_result_t serialize_file(mcfg_file_t file,
 									   mcfg_serialize_options_t options);
 
-#define serialize_sector NAMESPACED_DECL(serialize_sector)
-mcfg_serialize_result_t serialize_sector(mcfg_sector_t sector,
-										 mcfg_serialize_options_t options);
-
-#define serialize_section NAMESPACED_DECL(serialize_section)
-mcfg_serialize_result_t serialize_section(mcfg_section_t sector,
-										  mcfg_serialize_options_t options);
-
-#define serialize_string_field NAMESPACED_DECL(serialize_string_field)
-mcfg_serialize_result_t serialize_string_field(
-	mcfg_field_t sector,
-	mcfg_serialize_options_t options);
-
-#define serialize_list_field NAMESPACED_DECL(serialize_list_field)
-mcfg_serialize_result_t serialize_list_field(mcfg_field_t sector,
-											 mcfg_serialize_options_t options);
-
-#define serialize_bool_field NAMESPACED_DECL(serialize_bool_field)
-mcfg_serialize_result_t serialize_bool_field(mcfg_field_t sector,
-											 mcfg_serialize_options_t options);
-
-#define serialize_number_field NAMESPACED_DECL(serialize_number_field)
-mcfg_serialize_result_t serialize_number_field(
-	mcfg_field_t sector,
-	mcfg_serialize_options_t options);
+#define serialize_value NAMESPACED_DECL(serialize_value)
+/**
+ * @brief Serialize only the value of a field, as it is written after the name
+ * of the field.
+ */
+mcfg_serialize_result_t serialize_value(mcfg_field_t field);
+
+#define serialize_file_cached NAMESPACED_DECL(serialize_file_cached)
+/**
+ * @brief Serialize a file using its serialize cache, only sectors which are
+ * dirty or not cached yet are serialized.
+ */
+mcfg_serialize_result_t serialize_file_cached(mcfg_file_t file,
+											  mcfg_serialize_options_t options);
+
+#define serialize_cache_new NAMESPACED_DECL(serialize_cache_new)
+mcfg_serialize_cache_t *serialize_cache_new(void);
+
+#define serialize_cache_destroy NAMESPACED_DECL(serialize_cache_destroy)
+void serialize_cache_destroy(mcfg_serialize_cache_t *cache);
+
+#define serialize_to NAMESPACED_DECL(serialize_to)
+/**
+ * @brief Serialize a file to write, or to fd if write is NULL.
+ */
+mcfg_err_t serialize_to(mcfg_serialize_writer_t write,
+						void *ctx,
+						int fd,
+						mcfg_file_t file,
+						mcfg_serialize_options_t options);
+
+#define serialize_to_path NAMESPACED_DECL(serialize_to_path)
+/**
+ * @brief Serialize a file to the file at path by replacing it atomically.
+ * @see mcfg_serialize_to_file
+ */
+mcfg_err_t serialize_to_path(const char *path,
+							 mcfg_file_t file,
+							 mcfg_serialize_options_t options,
+							 int flags);
+
+#define serialize_stdio_writer NAMESPACED_DECL(serialize_stdio_writer)
+/**
+ * @brief Writer which writes to the FILE * given as ctx.
+ */
+mcfg_err_t serialize_stdio_writer(void *ctx, const char *data, size_t length);
 
 #endif
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include <string.h>
 
 #include "shared.h"
+#include "stats.h"
 
 char *
 strchrnul(const char *str, int c)
@@ -136,3 +137,76 @@ find_prev(char *src, char *src_org, char delimiter)
 
 	return src - offs;
 }
+
+void
+buffer_put(char *buf,
+		   size_t cap,
+		   size_t *offset,
+		   const char *src,
+		   size_t length)
+{
+	if(*offset + 1 < cap) {
+		const size_t space = cap - *offset - 1;
+		const size_t copy_amount = length < space ? length : space;
+
+		memcpy(buf + *offset, src, copy_amount);
+		buf[*offset + copy_amount] = 0;
+	}
+
+	*offset += length;
+}
+
+// 64-bit FNV-1a
+uint64_t
+name_hash(const char *name, size_t length)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+
+	for(size_t ix = 0; ix < length; ix++) {
+		hash ^= (uint8_t)name[ix];
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+#define FILTER_BIT_COUNT (MCFG_NAME_FILTER_WORDS * 64)
+
+/* Two bit positions are derived from independent halves of the names hash,
+ * FILTER_BIT_COUNT is a power of two so the modulo is a simple mask.
+ */
+#define FILTER_POS_A(h)	 ((h) % FILTER_BIT_COUNT)
+#define FILTER_POS_B(h)	 (((h) >> 32) % FILTER_BIT_COUNT)
+
+void
+name_filter_add(mcfg_name_filter_t *filter, const char *name, size_t length)
+{
+	const uint64_t hash = name_hash(name, length);
+
+	filter->bits[FILTER_POS_A(hash) / 64] |= 1ull << (FILTER_POS_A(hash) % 64);
+	filter->bits[FILTER_POS_B(hash) / 64] |= 1ull << (FILTER_POS_B(hash) % 64);
+}
+
+bool
+name_filter_may_contain(const mcfg_name_filter_t *filter,
+						const char *name,
+						size_t length)
+{
+	uint64_t any_set = 0;
+	for(size_t ix = 0; ix < MCFG_NAME_FILTER_WORDS; ix++) {
+		any_set |= filter->bits[ix];
+	}
+
+	/* the filter was never built, so it can not be used to reject anything */
+	if(any_set == 0) {
+		return true;
+	}
+
+	const uint64_t hash = name_hash(name, length);
+
+	return (filter->bits[FILTER_POS_A(hash) / 64] >>
+			(FILTER_POS_A(hash) % 64)) &
+		   (filter->bits[FILTER_POS_B(hash) / 64] >>
+			(FILTER_POS_B(hash) % 64)) &
+		   1;
+}
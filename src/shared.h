@@ -9,9 +9,12 @@
 #define SHARED_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <sys/types.h>
 
+#include "mcfg.h"
+
 #ifdef MCFG_DO_ERROR_MESSAGES
 #	include <stdio.h>
 #	define ERR_NOTE(e)                                        \
@@ -64,4 +67,30 @@ char *bstrcpy_until(char *src, char *src_org, char delimiter);
 #define find_prev _SHARED_NAMESPACED_DECL(find_prev)
 char *find_prev(char *src, char *src_org, char delimiter);
 
+/**
+ * @brief Append length bytes of src to buf at *offset, truncating the written
+ * data so that buf is always NULL-terminated within cap. *offset is always
+ * advanced by the full length, so that the required size can be measured by
+ * passing a cap of 0.
+ */
+#define buffer_put _SHARED_NAMESPACED_DECL(buffer_put)
+void buffer_put(char *buf,
+				size_t cap,
+				size_t *offset,
+				const char *src,
+				size_t length);
+
+#define name_hash _SHARED_NAMESPACED_DECL(name_hash)
+uint64_t name_hash(const char *name, size_t length);
+
+#define name_filter_add _SHARED_NAMESPACED_DECL(name_filter_add)
+void name_filter_add(mcfg_name_filter_t *filter,
+					 const char *name,
+					 size_t length);
+
+#define name_filter_may_contain _SHARED_NAMESPACED_DECL(name_filter_may_contain)
+bool name_filter_may_contain(const mcfg_name_filter_t *filter,
+							 const char *name,
+							 size_t length);
+
 #endif
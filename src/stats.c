@@ -0,0 +1,197 @@
+/* stats.c ; marie config format internal phase timing and counters
+ * implementation for MCFG/2
+ *
+ * Copyright (c) 2025, Marie Eckert
+ * Licensend under the BSD 3-Clause License.
+ */
+
+#define _XOPEN_SOURCE	700
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STATS_NO_WRAP
+#include "stats.h"
+
+#ifdef MCFG_STATS
+static mcfg_stats_t stats = {0};
+
+/** @brief Nesting depth of the phases timed on this thread */
+static _Thread_local size_t phase_depth = 0;
+
+#	define STAT_ADD(s, n) __atomic_fetch_add(&stats.s, n, __ATOMIC_RELAXED)
+
+#	define COUNT_ALLOCATION(ptr, size)           \
+		do {                                     \
+			if((ptr) != NULL) {                  \
+				STAT_ADD(allocations, 1);        \
+				STAT_ADD(allocated_bytes, size); \
+			}                                    \
+		} while(0)
+
+uint64_t
+stats_phase_begin(void)
+{
+	if(phase_depth++ > 0) {
+		return 0;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void
+stats_phase_end(stats_phase_t phase, uint64_t start)
+{
+	phase_depth--;
+	if(start == 0) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const uint64_t elapsed =
+		(uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec - start;
+
+	switch(phase) {
+		case STATS_READ:
+			STAT_ADD(read_ns, elapsed);
+			break;
+		case STATS_LEX:
+			STAT_ADD(lex_ns, elapsed);
+			break;
+		case STATS_PARSE:
+			STAT_ADD(parse_ns, elapsed);
+			break;
+		case STATS_FREE_TREE:
+			STAT_ADD(free_tree_ns, elapsed);
+			break;
+		case STATS_FORMAT:
+			STAT_ADD(format_ns, elapsed);
+			break;
+		case STATS_SERIALIZE:
+			STAT_ADD(serialize_ns, elapsed);
+			break;
+	}
+}
+
+void
+stats_add_token(void)
+{
+	STAT_ADD(tokens, 1);
+}
+
+void
+stats_add_file(const mcfg_file_t *file)
+{
+	uint64_t largest = 0;
+	for(size_t sector_ix = 0; sector_ix < file->sector_count; sector_ix++) {
+		const mcfg_sector_t *sector = &file->sectors[sector_ix];
+
+		for(size_t ix = 0; ix < sector->section_count; ix++) {
+			if(sector->sections[ix].field_count > largest) {
+				largest = sector->sections[ix].field_count;
+			}
+		}
+	}
+
+	uint64_t current =
+		__atomic_load_n(&stats.largest_section, __ATOMIC_RELAXED);
+	while(largest > current &&
+		  !__atomic_compare_exchange_n(&stats.largest_section, &current,
+									   largest, true, __ATOMIC_RELAXED,
+									   __ATOMIC_RELAXED)) {
+	}
+}
+
+void *
+stats_malloc(size_t size)
+{
+	void *ptr = malloc(size);
+	COUNT_ALLOCATION(ptr, size);
+	return ptr;
+}
+
+void *
+stats_calloc(size_t count, size_t size)
+{
+	void *ptr = calloc(count, size);
+	COUNT_ALLOCATION(ptr, count * size);
+	return ptr;
+}
+
+void *
+stats_realloc(void *ptr, size_t size)
+{
+	void *new_ptr = realloc(ptr, size);
+	COUNT_ALLOCATION(new_ptr, size);
+	return new_ptr;
+}
+
+char *
+stats_strdup(const char *str)
+{
+	char *ptr = strdup(str);
+	COUNT_ALLOCATION(ptr, strlen(str) + 1);
+	return ptr;
+}
+
+char *
+stats_strndup(const char *str, size_t size)
+{
+	char *ptr = strndup(str, size);
+	COUNT_ALLOCATION(ptr, strnlen(str, size) + 1);
+	return ptr;
+}
+#endif
+
+mcfg_stats_t
+mcfg_get_stats(void)
+{
+	mcfg_stats_t result = {0};
+
+#ifdef MCFG_STATS
+#	define STAT_LOAD(s) \
+		result.s = __atomic_load_n(&stats.s, __ATOMIC_RELAXED)
+
+	STAT_LOAD(read_ns);
+	STAT_LOAD(lex_ns);
+	STAT_LOAD(parse_ns);
+	STAT_LOAD(free_tree_ns);
+	STAT_LOAD(format_ns);
+	STAT_LOAD(serialize_ns);
+	STAT_LOAD(tokens);
+	STAT_LOAD(allocations);
+	STAT_LOAD(allocated_bytes);
+	STAT_LOAD(largest_section);
+
+#	undef STAT_LOAD
+#endif
+
+	return result;
+}
+
+void
+mcfg_reset_stats(void)
+{
+#ifdef MCFG_STATS
+#	define STAT_RESET(s) __atomic_store_n(&stats.s, 0, __ATOMIC_RELAXED)
+
+	STAT_RESET(read_ns);
+	STAT_RESET(lex_ns);
+	STAT_RESET(parse_ns);
+	STAT_RESET(free_tree_ns);
+	STAT_RESET(format_ns);
+	STAT_RESET(serialize_ns);
+	STAT_RESET(tokens);
+	STAT_RESET(allocations);
+	STAT_RESET(allocated_bytes);
+	STAT_RESET(largest_section);
+
+#	undef STAT_RESET
+#endif
+}
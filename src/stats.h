@@ -0,0 +1,106 @@
+/* stats.h ; marie config format internal phase timing and counters header
+ * for MCFG/2
+ *
+ * Copyright (c) 2025, Marie Eckert
+ * Licensend under the BSD 3-Clause License.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mcfg.h"
+#include "shared.h"
+
+/* Everything in here compiles to nothing unless the library is built with
+ * MCFG_STATS defined. With it, the allocation functions of every translation
+ * unit including this header are replaced by counting wrappers, so this header
+ * has to be included after all system headers.
+ */
+
+/* This header is included by translation units with their own NAMESPACE, so
+ * the declarations are namespaced explicitly.
+ */
+#define _STATS_DECL(name) _NAMESPACED_DECL(INTERNAL_PREFIX(stats), name)
+
+typedef enum stats_phase {
+	STATS_READ,
+	STATS_LEX,
+	STATS_PARSE,
+	STATS_FREE_TREE,
+	STATS_FORMAT,
+	STATS_SERIALIZE,
+} stats_phase_t;
+
+#ifdef MCFG_STATS
+
+#	define stats_phase_begin _STATS_DECL(stats_phase_begin)
+
+/**
+ * @brief Start timing a phase on the calling thread.
+ * @return The start time, 0 if another phase is already being timed on this
+ * thread. Nested phases are not timed so that calls between the public
+ * functions are not counted twice.
+ */
+uint64_t stats_phase_begin(void);
+
+#	define stats_phase_end _STATS_DECL(stats_phase_end)
+
+/**
+ * @brief Stop timing a phase, has to be paired with stats_phase_begin.
+ * @param phase The phase to add the time to
+ * @param start The start time returned by stats_phase_begin
+ */
+void stats_phase_end(stats_phase_t phase, uint64_t start);
+
+#	define stats_add_token _STATS_DECL(stats_add_token)
+
+/**
+ * @brief Count a token produced by the lexer.
+ */
+void stats_add_token(void);
+
+#	define stats_add_file _STATS_DECL(stats_add_file)
+
+/**
+ * @brief Update the largest section size from the sections of a parsed file.
+ */
+void stats_add_file(const mcfg_file_t *file);
+
+#	define stats_malloc	 _STATS_DECL(stats_malloc)
+#	define stats_calloc	 _STATS_DECL(stats_calloc)
+#	define stats_realloc _STATS_DECL(stats_realloc)
+#	define stats_strdup	 _STATS_DECL(stats_strdup)
+#	define stats_strndup _STATS_DECL(stats_strndup)
+
+void *stats_malloc(size_t size);
+void *stats_calloc(size_t count, size_t size);
+void *stats_realloc(void *ptr, size_t size);
+char *stats_strdup(const char *str);
+char *stats_strndup(const char *str, size_t size);
+
+#	ifndef STATS_NO_WRAP
+#		define malloc(size)		   stats_malloc(size)
+#		define calloc(count, size) stats_calloc(count, size)
+#		define realloc(ptr, size)  stats_realloc(ptr, size)
+#		define strdup(str)		   stats_strdup(str)
+#		define strndup(str, size)  stats_strndup(str, size)
+#	endif
+
+#	define STATS_BEGIN(start)		const uint64_t start = stats_phase_begin()
+#	define STATS_END(phase, start)	stats_phase_end(phase, start)
+#	define STATS_ADD_TOKEN()		stats_add_token()
+#	define STATS_ADD_FILE(file)		stats_add_file(file)
+
+#else
+
+#	define STATS_BEGIN(start)
+#	define STATS_END(phase, start)
+#	define STATS_ADD_TOKEN()
+#	define STATS_ADD_FILE(file)
+
+#endif	// ifdef MCFG_STATS
+
+#endif	// ifndef STATS_H
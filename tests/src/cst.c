@@ -0,0 +1,206 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcfg.h"
+#include "mcfg_util.h"
+
+#include "testing_shared.c"
+
+char *input =
+	"; build configuration\n"
+	"sector config\n"
+	"  section files\n"
+	"    str   obj 'obj/'  ; aligned by hand\n"
+	"    u16   jobs 4\n"
+	"\n"
+	"    list str sources\n"
+	"      'parse',\n"
+	"      'it''s'\n"
+	"  end\n"
+	"end\n";
+
+#define TEST_STEPS 4
+
+mcfg_cst_t *
+test_parse_cst(mcfg_file_t *file)
+{
+	BEGIN_STEP("parsing with a CST");
+
+	mcfg_cst_t *cst = NULL;
+	mcfg_parse_result_t ret = mcfg_parse_cst(input, &cst);
+	if(ret.err != MCFG_OK || cst == NULL) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "mcfg parsing failed: %s (%d)\n",
+				mcfg_err_string(ret.err), ret.err);
+		exit(current_step);
+	}
+
+	/* without changes the input is reproduced exactly */
+	mcfg_serialize_result_t unchanged = mcfg_cst_serialize(cst);
+	if(unchanged.err != MCFG_OK || strcmp(unchanged.value->data, input) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "output differs from input: %s\n",
+				unchanged.value != NULL ? unchanged.value->data : NULL);
+		exit(current_step);
+	}
+
+	free(unchanged.value);
+	*file = ret.value;
+
+	STEP_SUCCESS;
+	return cst;
+}
+
+void
+test_set_values(mcfg_cst_t *cst, mcfg_file_t *file)
+{
+	BEGIN_STEP("changing values");
+
+	mcfg_section_t *files =
+		mcfg_get_section(mcfg_get_sector(file, "config"), "files");
+
+	uint16_t *jobs = malloc(sizeof(*jobs));
+	*jobs = 12;
+	mcfg_err_t err =
+		mcfg_cst_set_field(cst, file, mcfg_get_field(files, "jobs"), jobs, 2);
+	if(err == MCFG_OK) {
+		err = mcfg_cst_set_field(cst, file, mcfg_get_field(files, "obj"),
+								 strdup("build/'obj'"), 12);
+	}
+
+	if(err != MCFG_OK ||
+	   mcfg_data_as_u16(*mcfg_get_field(files, "jobs")) != 12) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "setting values failed: %s (%d)\n",
+				mcfg_err_string(err), err);
+		exit(current_step);
+	}
+
+	const char *expected =
+		"; build configuration\n"
+		"sector config\n"
+		"  section files\n"
+		"    str   obj 'build/''obj'''  ; aligned by hand\n"
+		"    u16   jobs 12\n"
+		"\n"
+		"    list str sources\n"
+		"      'parse',\n"
+		"      'it''s'\n"
+		"  end\n"
+		"end\n";
+
+	mcfg_serialize_result_t changed = mcfg_cst_serialize(cst);
+	if(changed.err != MCFG_OK || strcmp(changed.value->data, expected) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected output: %s\n",
+				changed.value != NULL ? changed.value->data : NULL);
+		exit(current_step);
+	}
+
+	free(changed.value);
+
+	STEP_SUCCESS;
+}
+
+void
+test_set_list(mcfg_cst_t *cst, mcfg_file_t *file)
+{
+	BEGIN_STEP("changing a list");
+
+	mcfg_section_t *files =
+		mcfg_get_section(mcfg_get_sector(file, "config"), "files");
+	mcfg_field_t *sources = mcfg_get_field(files, "sources");
+
+	mcfg_list_t *numbers = calloc(1, sizeof(*numbers));
+	numbers->type = TYPE_U8;
+	if(mcfg_cst_set_field(cst, file, sources, numbers, sizeof(*numbers)) !=
+	   MCFG_INVALID_TYPE) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "element type was changed\n");
+		exit(current_step);
+	}
+
+	free(numbers);
+
+	mcfg_list_t *list = calloc(1, sizeof(*list));
+	list->type = TYPE_STRING;
+	mcfg_add_list_field(list, 5, strdup("cst"));
+	mcfg_add_list_field(list, 7, strdup("parse"));
+
+	mcfg_err_t err =
+		mcfg_cst_set_field(cst, file, sources, list, sizeof(*list));
+	mcfg_serialize_result_t changed = mcfg_cst_serialize(cst);
+	if(err != MCFG_OK || changed.err != MCFG_OK ||
+	   strstr(changed.value->data,
+			  "    list str sources\n      'cst', 'parse'\n  end\n") == NULL) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected output (%d): %s\n", err,
+				changed.value != NULL ? changed.value->data : NULL);
+		exit(current_step);
+	}
+
+	/* the output still parses to the changed file */
+	mcfg_parse_result_t reparsed = mcfg_parse(changed.value->data);
+	mcfg_field_t *reparsed_sources = mcfg_get_field(
+		mcfg_get_section(mcfg_get_sector(&reparsed.value, "config"), "files"),
+		"sources");
+	if(reparsed.err != MCFG_OK || reparsed_sources == NULL ||
+	   mcfg_data_as_list(*reparsed_sources)->field_count != 2) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "output does not parse\n");
+		exit(current_step);
+	}
+
+	mcfg_free_file(reparsed.value);
+	free(changed.value);
+
+	STEP_SUCCESS;
+}
+
+void
+test_foreign_field(mcfg_cst_t *cst, mcfg_file_t *file)
+{
+	BEGIN_STEP("rejecting fields without a span");
+
+	mcfg_section_t *files =
+		mcfg_get_section(mcfg_get_sector(file, "config"), "files");
+	mcfg_add_field(files, TYPE_STRING, strdup("added"), strdup("x"), 2);
+
+	char *data = strdup("y");
+	if(mcfg_cst_set_field(cst, file, mcfg_get_field(files, "added"), data, 2) !=
+	   MCFG_STRUCTURE_ERROR) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "added field was accepted\n");
+		exit(current_step);
+	}
+
+	free(data);
+
+	STEP_SUCCESS;
+}
+
+int
+main(void)
+{
+	TEST_INFO;
+
+	mcfg_file_t file;
+	mcfg_cst_t *cst = test_parse_cst(&file);
+	test_set_values(cst, &file);
+	test_set_list(cst, &file);
+	test_foreign_field(cst, &file);
+
+	mcfg_free_cst(cst);
+	mcfg_free_file(file);
+	return 0;
+}
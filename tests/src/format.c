@@ -0,0 +1,613 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcfg.h"
+#include "mcfg_format.h"
+#include "mcfg_util.h"
+
+#include "testing_shared.c"
+
+char *input =
+	"sector config\n"
+	"  section files\n"
+	"    str obj 'obj/'\n"
+	"    str out '$(obj)bin/'\n"
+	"    u16 jobs 8\n"
+	"    list str sources 'main', 'util'\n"
+	"    str self '$(loop)'\n"
+	"    str loop 'a $(self)'\n"
+	"    list str loop_list '$(loop_list)'\n"
+	"  end\n"
+	"end\n";
+
+#define TEST_STEPS 13
+
+void
+test_format_str(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("formatting embeds in a string");
+
+	const char expected[] =
+		"-j8 $(jobs) obj/bin/ src/main.c src/util.c (nullptr)";
+
+	mcfg_fmt_res_t res = mcfg_format_field_embeds_str(
+		"-j$(jobs) \\$(jobs) $(out) src/$(sources).c $(missing)", *file, rel);
+	if(res.err != MCFG_FMT_OK || strcmp(res.formatted, expected) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected result: %s (%d)\n",
+				res.formatted, res.err);
+		exit(current_step);
+	}
+
+	free(res.formatted);
+
+	STEP_SUCCESS;
+}
+
+void
+test_embed_scanning(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("scanning for embeds in long strings");
+
+	char input[4096 + 64];
+	memset(input, ' ', 4096);
+	strcpy(input + 4096, "\\$(obj) $(a$(obj) $(obj)\\\\ $(obj");
+
+	/* escaped embeds and names containing embeds are literal text */
+	const char expected[] = "$(obj) $(aobj/ obj/\\ $(obj";
+
+	mcfg_fmt_res_t res = mcfg_format_field_embeds_str(input, *file, rel);
+	if(res.err != MCFG_FMT_OK ||
+	   res.formatted_size != 4096 + sizeof(expected) ||
+	   strcmp(res.formatted + 4096, expected) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected result: %s (%d)\n",
+				res.formatted != NULL ? res.formatted + 4096 : NULL,
+				res.err);
+		exit(current_step);
+	}
+
+	free(res.formatted);
+
+	STEP_SUCCESS;
+}
+
+void
+test_format_into(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("formatting embeds into a caller-provided buffer");
+
+	char buf[16];
+	size_t length;
+
+	/* scalars and plain strings are formatted without a template */
+	mcfg_fmt_err_t err = mcfg_format_field_embeds_into(
+		buf, sizeof(buf), &length, "-j$(jobs) $(obj)", *file, rel);
+	if(err != MCFG_FMT_OK || length != 8 || strcmp(buf, "-j8 obj/") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected result: %s (%zu)\n", buf,
+				length);
+		exit(current_step);
+	}
+
+	/* lists and strings with embeds need one, the output is truncated */
+	err = mcfg_format_field_embeds_into(buf, sizeof(buf), &length,
+										"$(out) src/$(sources).c", *file, rel);
+	if(err != MCFG_FMT_OK || length != 30 ||
+	   strcmp(buf, "obj/bin/ src/ma") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected result: %s (%zu)\n", buf,
+				length);
+		exit(current_step);
+	}
+
+	STEP_SUCCESS;
+}
+
+void
+test_template_dynfield(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("rendering a template with a changing dynfield");
+
+	mcfg_template_res_t compiled =
+		mcfg_template_compile("cc -c $(%input%) -o $(obj)x.o", file, rel);
+	if(compiled.err != MCFG_FMT_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "compilation failed: %d\n",
+				compiled.err);
+		exit(current_step);
+	}
+
+	mcfg_add_dynfield(file, TYPE_STRING, strdup("input"), strdup("a.c"), 4);
+
+	mcfg_fmt_res_t first = mcfg_template_render(compiled.value);
+
+	mcfg_field_t *dynfield = mcfg_get_dynfield(file, "input");
+	free(dynfield->data);
+	dynfield->data = strdup("b.c");
+
+	mcfg_fmt_res_t second = mcfg_template_render(compiled.value);
+
+	if(first.err != MCFG_FMT_OK || second.err != MCFG_FMT_OK ||
+	   strcmp(first.formatted, "cc -c a.c -o obj/x.o") != 0 ||
+	   strcmp(second.formatted, "cc -c b.c -o obj/x.o") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected results: %s / %s\n",
+				first.formatted, second.formatted);
+		exit(current_step);
+	}
+
+	free(first.formatted);
+	free(second.formatted);
+	mcfg_template_free(compiled.value);
+
+	STEP_SUCCESS;
+}
+
+void
+test_template_buffer(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("rendering a template into a buffer");
+
+	mcfg_template_res_t compiled =
+		mcfg_template_compile("$(out)$(jobs)", file, rel);
+	if(compiled.err != MCFG_FMT_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "compilation failed: %d\n",
+				compiled.err);
+		exit(current_step);
+	}
+
+	char buf[8];
+	size_t length;
+	mcfg_fmt_err_t err = mcfg_template_render_to_buffer(
+		compiled.value, buf, sizeof(buf), &length);
+	if(err != MCFG_FMT_OK || length != 9 || strcmp(buf, "obj/bin") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected result: %s (%zu)\n", buf,
+				length);
+		exit(current_step);
+	}
+
+	mcfg_template_free(compiled.value);
+
+	STEP_SUCCESS;
+}
+
+void
+test_template_sharing(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("sharing templates of repeated embeds");
+
+	mcfg_template_res_t compiled =
+		mcfg_template_compile("$(out) $(out) $(obj)", file, rel);
+	if(compiled.err != MCFG_FMT_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "compilation failed: %d\n",
+				compiled.err);
+		exit(current_step);
+	}
+
+	/* one template for out and one for obj, which out embeds */
+	if(compiled.value->owned_count != 2) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER
+				"expected 2 nested templates, got %zu\n",
+				compiled.value->owned_count);
+		exit(current_step);
+	}
+
+	mcfg_template_free(compiled.value);
+
+	STEP_SUCCESS;
+}
+
+void
+test_embed_cycle(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("detecting embed cycles");
+
+	mcfg_fmt_res_t res = mcfg_format_field_embeds_str("$(self)", *file, rel);
+	mcfg_fmt_res_t list_res =
+		mcfg_format_field_embeds_str("$(loop_list)", *file, rel);
+
+	mcfg_add_dynfield(file, TYPE_STRING, strdup("dyn"), strdup("$(%dyn%)"), 9);
+	mcfg_fmt_res_t dyn_res =
+		mcfg_format_field_embeds_str("$(%dyn%)", *file, rel);
+
+	if(res.err != MCFG_FMT_EMBED_CYCLE ||
+	   list_res.err != MCFG_FMT_EMBED_CYCLE ||
+	   dyn_res.err != MCFG_FMT_EMBED_CYCLE) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "cycle not detected: %d %d %d\n",
+				res.err, list_res.err, dyn_res.err);
+		exit(current_step);
+	}
+
+	STEP_SUCCESS;
+}
+
+void
+test_format_to_sink(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("formatting embeds into a sink");
+
+	char *fmt = "-j$(jobs) $(out) src/$(sources).c $(missing)";
+
+	mcfg_fmt_res_t res = mcfg_format_field_embeds_str(fmt, *file, rel);
+	mcfg_string_t *streamed = mcfg_string_new_sized(0);
+
+	mcfg_fmt_err_t err = mcfg_format_field_embeds_to(
+		mcfg_fmt_sink_string, &streamed, fmt, *file, rel);
+	if(err != MCFG_FMT_OK || res.err != MCFG_FMT_OK ||
+	   strcmp(streamed->data, res.formatted) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected result: %s (%d)\n",
+				streamed->data, err);
+		exit(current_step);
+	}
+
+	free(res.formatted);
+	free(streamed);
+
+	STEP_SUCCESS;
+}
+
+void
+test_format_file(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("formatting a whole file");
+
+	mcfg_file_fmt_res_t res = mcfg_format_file(file, 4);
+
+	/* self and loop embed each other */
+	if(res.err != MCFG_FMT_EMBED_CYCLE || res.field_count != 4) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected result: %d (%zu fields)\n",
+				res.err, res.field_count);
+		exit(current_step);
+	}
+
+	for(size_t ix = 0; ix < res.field_count; ix++) {
+		mcfg_fmt_res_t single =
+			mcfg_format_field_embeds(*res.fields[ix].field, *file, rel);
+
+		if(single.err != res.fields[ix].err ||
+		   (single.err == MCFG_FMT_OK &&
+			strcmp(single.formatted, res.fields[ix].formatted) != 0)) {
+			STEP_FAIL;
+
+			fprintf(stderr, STEP_LOG_PRIMER "field %s formatted differently\n",
+					res.fields[ix].field->name);
+			exit(current_step);
+		}
+
+		free(single.formatted);
+	}
+
+	mcfg_free_file_fmt_res(res);
+
+	STEP_SUCCESS;
+}
+
+void
+test_incremental_format(mcfg_file_t *file)
+{
+	BEGIN_STEP("re-formatting only the dependents of a changed field");
+
+	mcfg_section_t *section =
+		mcfg_get_section(mcfg_get_sector(file, "config"), "files");
+	mcfg_field_t *obj = mcfg_get_field(section, "obj");
+	mcfg_field_t *out = mcfg_get_field(section, "out");
+
+	mcfg_fmt_cache_t cache;
+	if(mcfg_fmt_cache_init(&cache, file) != MCFG_FMT_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "failed to build the cache\n");
+		exit(current_step);
+	}
+
+	mcfg_fmt_dependents_t dependents =
+		mcfg_format_dependents(&cache.deps, obj);
+	if(dependents.err != MCFG_FMT_OK || dependents.count != 1 ||
+	   dependents.fields[0] != out) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong dependents of obj: %zu\n",
+				dependents.count);
+		exit(current_step);
+	}
+
+	free(dependents.fields);
+
+	const char *before;
+	if(mcfg_fmt_cache_get(&cache, out, &before) != MCFG_FMT_OK ||
+	   strcmp(before, "obj/bin/") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected value: %s\n", before);
+		exit(current_step);
+	}
+
+	char *old_data = obj->data;
+	obj->data = strdup("build/");
+	mcfg_fmt_cache_invalidate(&cache, obj);
+
+	const char *after;
+	mcfg_fmt_err_t err = mcfg_fmt_cache_get(&cache, out, &after);
+	if(err != MCFG_FMT_OK || strcmp(after, "build/bin/") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "stale value: %s (%d)\n", after,
+				err);
+		exit(current_step);
+	}
+
+	free(obj->data);
+	obj->data = old_data;
+	mcfg_fmt_cache_free(&cache);
+
+	STEP_SUCCESS;
+}
+
+char *nested_input =
+	"sector a\n"
+	"  section x\n"
+	"    str t '$(y)'\n"
+	"    str y 'AY'\n"
+	"  end\n"
+	"end\n"
+	"\n"
+	"sector b\n"
+	"  section x\n"
+	"    str y 'BY'\n"
+	"    str z '$(/a/x/t)'\n"
+	"    str d '$(%dyn%)'\n"
+	"  end\n"
+	"end\n";
+
+/* checks that the only dependent of the field at path is the given one */
+bool
+has_single_dependent(mcfg_fmt_deps_t *deps,
+					 mcfg_file_t *file,
+					 const char *path,
+					 mcfg_field_t *dependent)
+{
+	mcfg_fmt_dependents_t dependents = mcfg_format_dependents(
+		deps, mcfg_get_field_by_path_str(file, path));
+	const bool matches = dependents.err == MCFG_FMT_OK &&
+						 dependents.count == 1 &&
+						 dependents.fields[0] == dependent;
+
+	free(dependents.fields);
+	return matches;
+}
+
+void
+test_nested_dependencies(void)
+{
+	BEGIN_STEP("indexing nested embeds relative to the outermost field");
+
+	mcfg_parse_result_t ret = mcfg_parse(nested_input);
+	mcfg_file_t *file = &ret.value;
+	mcfg_add_dynfield(file, TYPE_STRING, strdup("dyn"), strdup("$(/a/x/y)"),
+					  10);
+
+	mcfg_field_t *t = mcfg_get_field_by_path_str(file, "/a/x/t");
+	mcfg_field_t *y = mcfg_get_field_by_path_str(file, "/b/x/y");
+	mcfg_field_t *z = mcfg_get_field_by_path_str(file, "/b/x/z");
+	mcfg_field_t *d = mcfg_get_field_by_path_str(file, "/b/x/d");
+
+	mcfg_fmt_cache_t cache;
+	if(ret.err != MCFG_OK ||
+	   mcfg_fmt_cache_init(&cache, file) != MCFG_FMT_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "failed to build the cache\n");
+		exit(current_step);
+	}
+
+	/* t is formatted relative to the section of z when embedded by it */
+	if(!has_single_dependent(&cache.deps, file, "/b/x/y", z)) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong dependents of /b/x/y\n");
+		exit(current_step);
+	}
+
+	if(!has_single_dependent(&cache.deps, file, "/a/x/t", z)) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong dependents of /a/x/t\n");
+		exit(current_step);
+	}
+
+	/* /a/x/y is reached by t and through the dynfield embedded by d */
+	mcfg_fmt_dependents_t dependents = mcfg_format_dependents(
+		&cache.deps, mcfg_get_field_by_path_str(file, "/a/x/y"));
+	if(dependents.err != MCFG_FMT_OK || dependents.count != 2 ||
+	   (dependents.fields[0] != t && dependents.fields[1] != t) ||
+	   (dependents.fields[0] != d && dependents.fields[1] != d)) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong dependents of /a/x/y\n");
+		exit(current_step);
+	}
+
+	free(dependents.fields);
+
+	const char *before;
+	if(mcfg_fmt_cache_get(&cache, z, &before) != MCFG_FMT_OK ||
+	   strcmp(before, "BY") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected value: %s\n", before);
+		exit(current_step);
+	}
+
+	free(y->data);
+	y->data = strdup("CHANGED");
+	mcfg_fmt_cache_invalidate(&cache, y);
+
+	const char *after;
+	mcfg_fmt_err_t err = mcfg_fmt_cache_get(&cache, z, &after);
+	if(err != MCFG_FMT_OK || strcmp(after, "CHANGED") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "stale value: %s (%d)\n", after,
+				err);
+		exit(current_step);
+	}
+
+	mcfg_fmt_cache_free(&cache);
+	mcfg_free_file(ret.value);
+
+	STEP_SUCCESS;
+}
+
+void
+test_format_foreach(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("formatting a string for every list element");
+
+	mcfg_field_t *sources =
+		mcfg_get_field_by_path_str(file, "/config/files/sources");
+
+	mcfg_fmt_foreach_res_t res =
+		mcfg_format_foreach("$(obj)$(%element%).o", *file, rel,
+							mcfg_data_as_list(*sources), "element");
+	if(res.err != MCFG_FMT_OK || res.count != 2 ||
+	   strcmp(MCFG_FOREACH_STRING(res, 0), "obj/main.o") != 0 ||
+	   strcmp(MCFG_FOREACH_STRING(res, 1), "obj/util.o") != 0 ||
+	   res.offsets[2] - res.offsets[1] - 1 != strlen("obj/util.o")) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unexpected result: %d (%zu)\n",
+				res.err, res.count);
+		exit(current_step);
+	}
+
+	mcfg_free_fmt_foreach_res(res);
+
+	STEP_SUCCESS;
+}
+
+typedef struct scoped_render {
+	const mcfg_template_t *tmpl;
+	char input[16];
+	char expected[32];
+	bool matched;
+} scoped_render_t;
+
+void *
+scoped_render_thread(void *arg)
+{
+	scoped_render_t *job = arg;
+
+	mcfg_dyn_scope_t scope = {0};
+	mcfg_dyn_scope_bind(&scope, TYPE_STRING, "input", job->input,
+						strlen(job->input) + 1);
+
+	job->matched = true;
+	for(size_t ix = 0; ix < 100; ix++) {
+		mcfg_fmt_res_t res = mcfg_template_render_scoped(job->tmpl, &scope);
+		job->matched &= res.err == MCFG_FMT_OK &&
+						strcmp(res.formatted, job->expected) == 0;
+		free(res.formatted);
+	}
+
+	mcfg_dyn_scope_free(&scope);
+	return NULL;
+}
+
+void
+test_dyn_scope(mcfg_file_t *file, mcfg_path_t rel)
+{
+	BEGIN_STEP("rendering with per-thread dynfield scopes");
+
+	/* the file has its own input dynfield, the scopes have to shadow it */
+	mcfg_template_res_t compiled =
+		mcfg_template_compile("cc -c $(%input%) -o $(obj)x.o", file, rel);
+	if(compiled.err != MCFG_FMT_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "compilation failed: %d\n",
+				compiled.err);
+		exit(current_step);
+	}
+
+	scoped_render_t jobs[4];
+	pthread_t threads[4];
+	for(size_t ix = 0; ix < 4; ix++) {
+		jobs[ix].tmpl = compiled.value;
+		snprintf(jobs[ix].input, sizeof(jobs[ix].input), "f%zu.c", ix);
+		snprintf(jobs[ix].expected, sizeof(jobs[ix].expected),
+				 "cc -c f%zu.c -o obj/x.o", ix);
+		pthread_create(&threads[ix], NULL, scoped_render_thread, &jobs[ix]);
+	}
+
+	for(size_t ix = 0; ix < 4; ix++) {
+		pthread_join(threads[ix], NULL);
+
+		if(!jobs[ix].matched) {
+			STEP_FAIL;
+
+			fprintf(stderr, STEP_LOG_PRIMER "thread %zu rendered wrongly\n",
+					ix);
+			exit(current_step);
+		}
+	}
+
+	mcfg_template_free(compiled.value);
+
+	STEP_SUCCESS;
+}
+
+int
+main(void)
+{
+	TEST_INFO;
+
+	mcfg_parse_result_t ret = mcfg_parse(input);
+	if(ret.err != MCFG_OK) {
+		fprintf(stderr, "mcfg parsing failed: %s (%d)\n",
+				mcfg_err_string(ret.err), ret.err);
+		return 1;
+	}
+
+	mcfg_path_t rel = mcfg_parse_path("/config/files");
+
+	test_format_str(&ret.value, rel);
+	test_embed_scanning(&ret.value, rel);
+	test_format_into(&ret.value, rel);
+	test_template_dynfield(&ret.value, rel);
+	test_template_buffer(&ret.value, rel);
+	test_template_sharing(&ret.value, rel);
+	test_embed_cycle(&ret.value, rel);
+	test_format_to_sink(&ret.value, rel);
+	test_format_file(&ret.value, rel);
+	test_incremental_format(&ret.value);
+	test_nested_dependencies();
+	test_dyn_scope(&ret.value, rel);
+	test_format_foreach(&ret.value, rel);
+
+	mcfg_free_path(rel);
+	mcfg_free_file(ret.value);
+	return 0;
+}
@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcfg.h"
+#include "mcfg_util.h"
+
+#include "testing_shared.c"
+
+char *input =
+	"sector config\n"
+	"  section files\n"
+	"    str obj 'obj/'\n"
+	"    str src 'src/'\n"
+	"  end\n"
+	"end\n";
+
+#define TEST_STEPS 7
+
+#define VIEW_ELEM_EQ(v, e, s)                   \
+	((v).e.length == strlen(s) &&               \
+	 strncmp(MCFG_PATH_VIEW_ELEM(v, e), s, (v).e.length) == 0)
+
+void
+test_parse_view(void)
+{
+	BEGIN_STEP("parsing path views");
+
+	mcfg_path_view_t view = mcfg_parse_path_view("/config/files/obj");
+	if(!view.absolute || !VIEW_ELEM_EQ(view, sector, "config") ||
+	   !VIEW_ELEM_EQ(view, section, "files") ||
+	   !VIEW_ELEM_EQ(view, field, "obj")) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "absolute path parsed incorrectly\n");
+		exit(current_step);
+	}
+
+	view = mcfg_parse_path_view("files/obj");
+	if(view.absolute || view.sector.length != 0 ||
+	   !VIEW_ELEM_EQ(view, section, "files") ||
+	   !VIEW_ELEM_EQ(view, field, "obj")) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "relative path parsed incorrectly\n");
+		exit(current_step);
+	}
+
+	view = mcfg_parse_path_view("%element%");
+	if(!view.dynfield_path || !VIEW_ELEM_EQ(view, field, "element")) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "dynfield path parsed incorrectly\n");
+		exit(current_step);
+	}
+
+	STEP_SUCCESS;
+}
+
+void
+test_parse_path(void)
+{
+	BEGIN_STEP("parsing owned paths");
+
+	mcfg_path_t path = mcfg_parse_path("//config/files//obj/");
+	if(!path.absolute || path.sector == NULL || path.section == NULL ||
+	   path.field == NULL || strcmp(path.sector, "config") != 0 ||
+	   strcmp(path.section, "files") != 0 || strcmp(path.field, "obj") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "path parsed incorrectly\n");
+		exit(current_step);
+	}
+
+	mcfg_free_path(path);
+
+	STEP_SUCCESS;
+}
+
+void
+test_lookup(mcfg_file_t *file)
+{
+	BEGIN_STEP("looking up fields by path");
+
+	mcfg_field_t *field = mcfg_get_field_by_path_str(file, "/config/files/src");
+	if(field == NULL || strcmp(mcfg_data_as_string(*field), "src/") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "existing field not found\n");
+		exit(current_step);
+	}
+
+	if(mcfg_get_field_by_path_str(file, "/config/files/sr") != NULL ||
+	   mcfg_get_field_by_path_str(file, "/config/files/srcs") != NULL ||
+	   mcfg_get_field_by_path_str(file, "files/src") != NULL) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "non-existent field found\n");
+		exit(current_step);
+	}
+
+	STEP_SUCCESS;
+}
+
+void
+test_batch_lookup(mcfg_file_t *file)
+{
+	BEGIN_STEP("looking up fields in batch");
+
+	mcfg_path_t paths[4] = {
+		mcfg_parse_path("/config/files/src"),
+		mcfg_parse_path("/config/bogus/src"),
+		mcfg_parse_path("/config/files/obj"),
+		mcfg_parse_path("/bogus/files/obj"),
+	};
+
+	mcfg_field_t *fields[4];
+	bool missing[4];
+
+	const size_t missing_count =
+		mcfg_get_fields_by_paths(file, paths, 4, fields, missing);
+
+	if(missing_count != 2 || missing[0] || !missing[1] || missing[2] ||
+	   !missing[3]) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong paths reported as missing\n");
+		exit(current_step);
+	}
+
+	if(fields[0] != mcfg_get_field_by_path(file, paths[0]) ||
+	   fields[2] != mcfg_get_field_by_path(file, paths[2])) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "results are not in input order\n");
+		exit(current_step);
+	}
+
+	for(size_t ix = 0; ix < 4; ix++) {
+		mcfg_free_path(paths[ix]);
+	}
+
+	STEP_SUCCESS;
+}
+
+/* This test is built directly from the library sources with
+ * MCFG_LOOKUP_STATS defined, see scripts/run-tests.bash.
+ */
+void
+test_name_filter(mcfg_file_t *file)
+{
+	BEGIN_STEP("rejecting missing names with the name filters");
+
+	mcfg_section_t *section =
+		mcfg_get_section(mcfg_get_sector(file, "config"), "files");
+
+	mcfg_reset_lookup_stats();
+
+	char name[32];
+	for(size_t ix = 0; ix < 64; ix++) {
+		snprintf(name, sizeof(name), "missing%zu", ix);
+		if(mcfg_get_field(section, name) != NULL) {
+			STEP_FAIL;
+
+			fprintf(stderr, STEP_LOG_PRIMER "non-existent field found\n");
+			exit(current_step);
+		}
+	}
+
+	mcfg_lookup_stats_t stats = mcfg_get_lookup_stats();
+	if(stats.lookups != 64 ||
+	   stats.filter_rejects + stats.false_positives != 64 ||
+	   stats.false_positive_rate > 0.1) {
+		STEP_FAIL;
+
+		fprintf(stderr,
+				STEP_LOG_PRIMER "%lu lookups, %lu rejects, %lu false "
+								"positives\n",
+				stats.lookups, stats.filter_rejects, stats.false_positives);
+		exit(current_step);
+	}
+
+	/* names which exist pass the filter and are neither rejected nor false
+	 * positives
+	 */
+	mcfg_get_field(section, "obj");
+	mcfg_lookup_stats_t found = mcfg_get_lookup_stats();
+	if(found.lookups != 65 || found.filter_rejects != stats.filter_rejects ||
+	   found.false_positives != stats.false_positives) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "existing field was counted as miss\n");
+		exit(current_step);
+	}
+
+	/* a section filled without mcfg_add_field has no filter and is scanned */
+	mcfg_field_t field = {
+		.name = "field", .type = TYPE_BOOL, .data = &(bool){true}, .size = 1};
+	mcfg_section_t unfiltered = {
+		.name = "unfiltered", .field_count = 1, .fields = &field};
+
+	mcfg_reset_lookup_stats();
+	if(mcfg_get_field(&unfiltered, "field") != &field ||
+	   mcfg_get_field(&unfiltered, "missing") != NULL) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unfiltered lookup failed\n");
+		exit(current_step);
+	}
+
+	stats = mcfg_get_lookup_stats();
+	if(stats.lookups != 2 || stats.filter_rejects != 0 ||
+	   stats.false_positives != 1) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unbuilt filter rejected a name\n");
+		exit(current_step);
+	}
+
+	STEP_SUCCESS;
+}
+
+/* Path cache hits do not look up any names, so they can be told apart from
+ * resolved lookups by the lookup counter.
+ */
+void
+test_path_cache(mcfg_file_t *file)
+{
+	BEGIN_STEP("looking up fields through the path cache");
+
+	if(mcfg_enable_path_cache(file, MCFG_PATH_CACHE_DEFAULT_SLOTS) !=
+	   MCFG_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "failed to enable path cache\n");
+		exit(current_step);
+	}
+
+	mcfg_field_t *uncached =
+		mcfg_get_field_by_path_str(file, "/config/files/obj");
+	mcfg_get_field_by_path_str(file, "/config/files/new");
+
+	mcfg_reset_lookup_stats();
+	mcfg_field_t *cached =
+		mcfg_get_field_by_path_str(file, "/config/files/obj");
+	mcfg_field_t *missing =
+		mcfg_get_field_by_path_str(file, "/config/files/new");
+	if(uncached == NULL || cached != uncached || missing != NULL) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "cached lookup mismatch\n");
+		exit(current_step);
+	}
+
+	if(mcfg_get_lookup_stats().lookups != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "lookups were not cached\n");
+		exit(current_step);
+	}
+
+	/* adding a field reallocates the fields of the section, a cached hit has
+	 * to follow it while the cached miss has to be resolved again
+	 */
+	mcfg_section_t *section =
+		mcfg_get_section(mcfg_get_sector(file, "config"), "files");
+	mcfg_add_field(section, TYPE_STRING, strdup("new"), strdup("new/"), 5);
+
+	mcfg_reset_lookup_stats();
+	mcfg_field_t *moved =
+		mcfg_get_field_by_path_str(file, "/config/files/obj");
+	if(moved != &section->fields[0] || mcfg_get_lookup_stats().lookups != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "cached field was not followed\n");
+		exit(current_step);
+	}
+
+	mcfg_field_t *added =
+		mcfg_get_field_by_path_str(file, "/config/files/new");
+	if(added == NULL || added != mcfg_get_field(section, "new")) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "cached miss was not resolved\n");
+		exit(current_step);
+	}
+
+	STEP_SUCCESS;
+}
+
+void
+test_path_cache_modifications(mcfg_file_t *file)
+{
+	BEGIN_STEP("keeping the path cache across modifications");
+
+	mcfg_parse_result_t other = mcfg_parse(input);
+	if(other.err != MCFG_OK ||
+	   mcfg_enable_path_cache(&other.value, MCFG_PATH_CACHE_DEFAULT_SLOTS) !=
+		   MCFG_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "failed to set up second file\n");
+		exit(current_step);
+	}
+
+	mcfg_field_t *cached =
+		mcfg_get_field_by_path_str(file, "/config/files/src");
+
+	mcfg_section_t *other_section =
+		mcfg_get_section(mcfg_get_sector(&other.value, "config"), "files");
+	mcfg_add_field(other_section, TYPE_STRING, strdup("new"), strdup("new/"),
+				   5);
+
+	mcfg_sector_t *sector = mcfg_get_sector(file, "config");
+	mcfg_add_section(sector, strdup("extra"));
+
+	mcfg_reset_lookup_stats();
+	mcfg_field_t *hit = mcfg_get_field_by_path_str(file, "/config/files/src");
+	if(cached == NULL || hit != cached ||
+	   mcfg_get_lookup_stats().lookups != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "modification dropped cache hit\n");
+		exit(current_step);
+	}
+
+	/* a miss cached for a new section is resolved again once it grows */
+	if(mcfg_get_field_by_path_str(file, "/config/extra/x") != NULL) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "non-existent field found\n");
+		exit(current_step);
+	}
+
+	mcfg_add_field(mcfg_get_section(sector, "extra"), TYPE_STRING,
+				   strdup("x"), strdup("x"), 2);
+	if(mcfg_get_field_by_path_str(file, "/config/extra/x") == NULL) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "cached miss was not resolved\n");
+		exit(current_step);
+	}
+
+	mcfg_free_file(other.value);
+
+	STEP_SUCCESS;
+}
+
+int
+main(void)
+{
+	TEST_INFO;
+
+	mcfg_parse_result_t ret = mcfg_parse(input);
+	if(ret.err != MCFG_OK) {
+		fprintf(stderr, "mcfg parsing failed: %s (%d)\n",
+				mcfg_err_string(ret.err), ret.err);
+		return 1;
+	}
+
+	test_parse_view();
+	test_parse_path();
+	test_lookup(&ret.value);
+	test_batch_lookup(&ret.value);
+	test_name_filter(&ret.value);
+	test_path_cache(&ret.value);
+	test_path_cache_modifications(&ret.value);
+
+	mcfg_free_file(ret.value);
+	return 0;
+}
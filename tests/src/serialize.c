@@ -1,6 +1,10 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "mcfg.h"
 #include "mcfg_util.h"
@@ -50,7 +54,7 @@ char *initial =
 	"  end\n"
 	"end\n";
 
-#define TEST_STEPS 4
+#define TEST_STEPS 10
 
 mcfg_file_t
 test_parse_original()
@@ -259,6 +263,409 @@ test_compare_structs(mcfg_file_t a, mcfg_file_t b)
 	STEP_SUCCESS;
 }
 
+void
+test_reserialize(mcfg_file_t file, mcfg_string_t *serialized)
+{
+	BEGIN_STEP("serializing again");
+
+	/* serializing must not modify the file, so the output stays the same */
+	mcfg_serialize_result_t again =
+		mcfg_serialize(file, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+	if(again.err != MCFG_OK || again.value->length != serialized->length ||
+	   serialized->length != strlen(serialized->data) ||
+	   strcmp(again.value->data, serialized->data) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "output changed: %s\n",
+				again.value != NULL ? again.value->data : NULL);
+		exit(current_step);
+	}
+
+	free(again.value);
+
+	STEP_SUCCESS;
+}
+
+typedef struct {
+	char *data;
+	size_t length;
+} collected_t;
+
+mcfg_err_t
+collect_writer(void *ctx, const char *data, size_t length)
+{
+	collected_t *collected = ctx;
+	collected->data = realloc(collected->data, collected->length + length + 1);
+	memcpy(collected->data + collected->length, data, length);
+	collected->length += length;
+	collected->data[collected->length] = 0;
+	return MCFG_OK;
+}
+
+void
+test_serialize_streamed(mcfg_file_t *file)
+{
+	BEGIN_STEP("serializing to a writer and a file descriptor");
+
+	/* long enough to be passed on without being copied */
+	char *long_value = malloc(4096);
+	memset(long_value, 'x', 4095);
+	long_value[4095] = 0;
+	mcfg_add_field(&file->sectors[0].sections[0], TYPE_STRING,
+				   strdup("long_value"), long_value, 4096);
+
+	mcfg_serialize_result_t expected =
+		mcfg_serialize(*file, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+
+	collected_t collected = {.data = NULL, .length = 0};
+	mcfg_err_t err = mcfg_serialize_to(collect_writer, &collected, *file,
+									   MCFG_DEFAULT_SERIALIZE_OPTIONS);
+	if(err != MCFG_OK || collected.length != expected.value->length ||
+	   strcmp(collected.data, expected.value->data) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "writer output differs (%d): %s\n",
+				err, collected.data);
+		exit(current_step);
+	}
+
+	FILE *tmp = tmpfile();
+	err = mcfg_serialize_to_fd(fileno(tmp), *file,
+							   MCFG_DEFAULT_SERIALIZE_OPTIONS);
+
+	char *read_back = calloc(expected.value->length + 2, 1);
+	rewind(tmp);
+	const size_t read_length =
+		fread(read_back, 1, expected.value->length + 1, tmp);
+	if(err != MCFG_OK || read_length != expected.value->length ||
+	   strcmp(read_back, expected.value->data) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "fd output differs (%d): %s\n", err,
+				read_back);
+		exit(current_step);
+	}
+
+	fclose(tmp);
+	free(read_back);
+	free(collected.data);
+	free(expected.value);
+
+	STEP_SUCCESS;
+}
+
+void
+test_serialize_parallel(mcfg_file_t file, mcfg_string_t *serialized)
+{
+	BEGIN_STEP("serializing with multiple workers");
+
+	mcfg_serialize_options_t options = MCFG_DEFAULT_SERIALIZE_OPTIONS;
+	options.worker_count = 3;
+
+	mcfg_serialize_result_t parallel = mcfg_serialize(file, options);
+	if(parallel.err != MCFG_OK ||
+	   parallel.value->length != serialized->length ||
+	   strcmp(parallel.value->data, serialized->data) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "output differs (%d): %s\n",
+				parallel.err,
+				parallel.value != NULL ? parallel.value->data : NULL);
+		exit(current_step);
+	}
+
+	/* the workers write at offsets relative to the current one */
+	FILE *tmp = tmpfile();
+	fputs("#", tmp);
+	fflush(tmp);
+	mcfg_err_t err = mcfg_serialize_to_fd(fileno(tmp), file, options);
+	fputs("#", tmp);
+
+	char *read_back = calloc(serialized->length + 3, 1);
+	rewind(tmp);
+	const size_t read_length =
+		fread(read_back, 1, serialized->length + 2, tmp);
+	if(err != MCFG_OK || read_length != serialized->length + 2 ||
+	   strncmp(read_back + 1, serialized->data, serialized->length) != 0 ||
+	   read_back[0] != '#' || read_back[read_length - 1] != '#') {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "fd output differs (%d): %s\n", err,
+				read_back);
+		exit(current_step);
+	}
+
+	fclose(tmp);
+	free(read_back);
+	free(parallel.value);
+
+	STEP_SUCCESS;
+}
+
+void
+test_serialize_parallel_append(mcfg_file_t file, mcfg_string_t *serialized)
+{
+	BEGIN_STEP("serializing with multiple workers to an O_APPEND fd");
+
+	mcfg_serialize_options_t options = MCFG_DEFAULT_SERIALIZE_OPTIONS;
+	options.worker_count = 3;
+
+	/* pwritev ignores the offset on an O_APPEND fd, so the ranges of the
+	 * workers would land in the order in which they finish. Moving the offset
+	 * back to the start shows whether the output was written at offsets.
+	 */
+	FILE *tmp = tmpfile();
+	fputs("#", tmp);
+	fflush(tmp);
+
+	const int fd = fileno(tmp);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_APPEND);
+	lseek(fd, 0, SEEK_SET);
+
+	mcfg_err_t err = mcfg_serialize_to_fd(fd, file, options);
+
+	/* appended output leaves the offset at the end of the file */
+	if(err == MCFG_OK &&
+	   lseek(fd, 0, SEEK_CUR) != (off_t)serialized->length + 1) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "output was not appended\n");
+		exit(current_step);
+	}
+
+	if(err == MCFG_OK && write(fd, "#", 1) != 1) {
+		err = errno | MCFG_OS_ERROR_MASK;
+	}
+
+	char *read_back = calloc(serialized->length + 3, 1);
+	lseek(fd, 0, SEEK_SET);
+	const ssize_t read_length = read(fd, read_back, serialized->length + 2);
+	if(err != MCFG_OK || read_length != (ssize_t)serialized->length + 2 ||
+	   strncmp(read_back + 1, serialized->data, serialized->length) != 0 ||
+	   read_back[0] != '#' || read_back[read_length - 1] != '#') {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "fd output differs (%d): %s\n", err,
+				read_back);
+		exit(current_step);
+	}
+
+	fclose(tmp);
+	free(read_back);
+
+	STEP_SUCCESS;
+}
+
+/* serializes the file bypassing its serialize cache and compares the result
+ * to the output of the cache
+ */
+bool
+cached_output_matches(mcfg_file_t *file, mcfg_string_t *cached)
+{
+	mcfg_file_t plain = *file;
+	plain.serialize_cache = NULL;
+
+	mcfg_serialize_result_t expected =
+		mcfg_serialize(plain, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+	const bool matches = expected.err == MCFG_OK &&
+						 expected.value->length == cached->length &&
+						 strcmp(expected.value->data, cached->data) == 0;
+
+	free(expected.value);
+	return matches;
+}
+
+void
+test_serialize_cached(mcfg_file_t *file)
+{
+	BEGIN_STEP("serializing with the serialize cache");
+
+	if(mcfg_enable_serialize_cache(file) != MCFG_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "failed to enable serialize cache\n");
+		exit(current_step);
+	}
+
+	mcfg_serialize_result_t first =
+		mcfg_serialize(*file, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+	if(first.err != MCFG_OK || !cached_output_matches(file, first.value)) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "cached output differs: %s\n",
+				first.value != NULL ? first.value->data : NULL);
+		exit(current_step);
+	}
+
+	/* a change which is not marked dirty is not picked up, which shows that
+	 * the text of the sector came from the cache
+	 */
+	mcfg_section_t *section =
+		mcfg_get_section(mcfg_get_sector(file, "test"), "sectneg1");
+	*(int16_t *)mcfg_get_field(section, "test")->data = 5;
+
+	mcfg_serialize_result_t unmarked =
+		mcfg_serialize(*file, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+	if(unmarked.err != MCFG_OK ||
+	   strcmp(unmarked.value->data, first.value->data) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "clean sector was serialized again\n");
+		exit(current_step);
+	}
+
+	section->dirty = true;
+	mcfg_add_sector(file, strdup("added"));
+
+	mcfg_serialize_result_t marked =
+		mcfg_serialize(*file, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+	if(marked.err != MCFG_OK || !cached_output_matches(file, marked.value) ||
+	   strcmp(marked.value->data, first.value->data) == 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "dirty sectors were not updated: %s\n",
+				marked.value != NULL ? marked.value->data : NULL);
+		exit(current_step);
+	}
+
+	/* appending to a list has to mark it dirty */
+	mcfg_list_t *list = mcfg_data_as_list(
+		*mcfg_get_field_by_path_str(file, "/list_src/sect1/somelist"));
+	mcfg_add_list_field(list, 2, strdup("c"));
+
+	mcfg_serialize_result_t appended =
+		mcfg_serialize(*file, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+	if(appended.err != MCFG_OK ||
+	   !cached_output_matches(file, appended.value) ||
+	   strstr(appended.value->data, "'c'") == NULL) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "list append was not picked up: %s\n",
+				appended.value != NULL ? appended.value->data : NULL);
+		exit(current_step);
+	}
+
+	/* a replaced sector has to be serialized again, even if its name string
+	 * is the same
+	 */
+	mcfg_sector_t original = file->sectors[0];
+	file->sectors[0] = (mcfg_sector_t){.name = original.name};
+
+	mcfg_serialize_result_t replaced =
+		mcfg_serialize(*file, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+	file->sectors[0] = original;
+
+	mcfg_serialize_result_t restored =
+		mcfg_serialize(*file, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+	if(replaced.err != MCFG_OK || restored.err != MCFG_OK ||
+	   strcmp(replaced.value->data, appended.value->data) == 0 ||
+	   strcmp(restored.value->data, appended.value->data) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "replaced sector was not noticed\n");
+		exit(current_step);
+	}
+
+	free(first.value);
+	free(unmarked.value);
+	free(marked.value);
+	free(appended.value);
+	free(replaced.value);
+	free(restored.value);
+
+	STEP_SUCCESS;
+}
+
+char *
+read_file(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL) {
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	const long size = ftell(f);
+	rewind(f);
+
+	char *data = calloc(size + 1, 1);
+	fread(data, 1, size, f);
+	fclose(f);
+	return data;
+}
+
+void
+test_serialize_to_file(mcfg_file_t file, mcfg_string_t *serialized)
+{
+	BEGIN_STEP("serializing to a file");
+
+	char dir[] = "/tmp/mcfg_serialize_XXXXXX";
+	if(mkdtemp(dir) == NULL) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "failed to create directory\n");
+		exit(current_step);
+	}
+
+	char path[sizeof(dir) + 16];
+	sprintf(path, "%s/out.mcfg", dir);
+
+	mcfg_err_t err =
+		mcfg_serialize_to_file(path, file, MCFG_DEFAULT_SERIALIZE_OPTIONS, 0);
+	char *written = read_file(path);
+	if(err != MCFG_OK || written == NULL ||
+	   strcmp(written, serialized->data) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "file content differs (%d): %s\n", err,
+				written);
+		exit(current_step);
+	}
+
+	free(written);
+
+	/* an old modification time shows whether the file was rewritten */
+	const struct timespec old_times[2] = {{.tv_sec = 1000}, {.tv_sec = 1000}};
+	chmod(path, 0600);
+	utimensat(AT_FDCWD, path, old_times, 0);
+
+	err = mcfg_serialize_to_file(path, file, MCFG_DEFAULT_SERIALIZE_OPTIONS,
+								 MCFG_SERIALIZE_SKIP_UNCHANGED);
+	struct stat st;
+	stat(path, &st);
+	if(err != MCFG_OK || st.st_mtime != 1000) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unchanged file was rewritten (%d)\n",
+				err);
+		exit(current_step);
+	}
+
+	mcfg_serialize_options_t spaces = {
+		.tab_indentation = false, .space_count = 2, .worker_count = 1};
+	mcfg_serialize_result_t expected = mcfg_serialize(file, spaces);
+
+	err = mcfg_serialize_to_file(path, file, spaces,
+								 MCFG_SERIALIZE_SKIP_UNCHANGED);
+	stat(path, &st);
+	written = read_file(path);
+	if(err != MCFG_OK || st.st_mtime == 1000 || (st.st_mode & 0777) != 0600 ||
+	   strcmp(written, expected.value->data) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "changed file was not replaced (%d)\n",
+				err);
+		exit(current_step);
+	}
+
+	free(written);
+	free(expected.value);
+	unlink(path);
+	rmdir(dir);
+
+	STEP_SUCCESS;
+}
+
 int
 main(void)
 {
@@ -268,6 +675,12 @@ main(void)
 	mcfg_string_t *serialized = test_serialize(parsed);
 	mcfg_file_t new_parsed = test_parse_serialized(serialized);
 	test_compare_structs(parsed, new_parsed);
+	test_reserialize(parsed, serialized);
+	test_serialize_parallel(parsed, serialized);
+	test_serialize_parallel_append(parsed, serialized);
+	test_serialize_to_file(parsed, serialized);
+	test_serialize_streamed(&parsed);
+	test_serialize_cached(&parsed);
 
 	return 0;
 }
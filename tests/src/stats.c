@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mcfg.h"
+#include "mcfg_format.h"
+#include "mcfg_util.h"
+
+#include "testing_shared.c"
+
+/* This test is built directly from the library sources with MCFG_STATS
+ * defined, see scripts/run-tests.bash.
+ */
+
+char *input =
+	"sector config\n"
+	"  section files\n"
+	"    str obj 'obj/'\n"
+	"    str src '$(obj)src/'\n"
+	"    u8 level 2\n"
+	"  end\n"
+	"end\n";
+
+/* the sector and section keywords and names, 3 tokens per field, two quotes
+ * per string and 2 ends
+ */
+#define INPUT_TOKENS 19
+
+#define TEST_STEPS 3
+
+void
+test_parse_stats(void)
+{
+	BEGIN_STEP("counting parser phases");
+
+	mcfg_reset_stats();
+
+	mcfg_parse_result_t ret = mcfg_parse(input);
+	if(ret.err != MCFG_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "parsing failed\n");
+		exit(current_step);
+	}
+
+	const mcfg_stats_t stats = mcfg_get_stats();
+	if(stats.lex_ns == 0 || stats.parse_ns == 0 || stats.free_tree_ns == 0 ||
+	   stats.read_ns != 0 || stats.format_ns != 0 || stats.serialize_ns != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong phases timed\n");
+		exit(current_step);
+	}
+
+	if(stats.tokens != INPUT_TOKENS || stats.largest_section != 3 ||
+	   stats.allocations == 0 || stats.allocated_bytes == 0) {
+		STEP_FAIL;
+
+		fprintf(stderr,
+				STEP_LOG_PRIMER "%lu tokens, largest section %lu, %lu "
+								"allocations\n",
+				stats.tokens, stats.largest_section, stats.allocations);
+		exit(current_step);
+	}
+
+	mcfg_free_file(ret.value);
+
+	mcfg_reset_stats();
+	const mcfg_stats_t reset = mcfg_get_stats();
+	if(reset.lex_ns != 0 || reset.parse_ns != 0 || reset.tokens != 0 ||
+	   reset.largest_section != 0 || reset.allocations != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "stats were not reset\n");
+		exit(current_step);
+	}
+
+	STEP_SUCCESS;
+}
+
+void
+test_serialize_stats(void)
+{
+	BEGIN_STEP("counting serializer phases");
+
+	mcfg_parse_result_t ret = mcfg_parse(input);
+	mcfg_reset_stats();
+
+	mcfg_serialize_result_t serialized =
+		mcfg_serialize(ret.value, MCFG_DEFAULT_SERIALIZE_OPTIONS);
+
+	const mcfg_stats_t stats = mcfg_get_stats();
+	if(serialized.err != MCFG_OK || stats.serialize_ns == 0 ||
+	   stats.lex_ns != 0 || stats.tokens != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "serializing was not timed\n");
+		exit(current_step);
+	}
+
+	free(serialized.value);
+	mcfg_free_file(ret.value);
+
+	STEP_SUCCESS;
+}
+
+uint64_t
+now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void
+test_format_stats(void)
+{
+	BEGIN_STEP("timing threaded formatting once");
+
+	/* enough embeds that rendering takes far longer than the gap between the
+	 * outer timing and the timing of the call
+	 */
+	mcfg_string_t *large = mcfg_string_new("sector config\n");
+	for(size_t section = 0; section < 64; section++) {
+		mcfg_string_append_fmt(&large, "  section s%zu\n    str a 'a'\n",
+							   section);
+		for(size_t field = 0; field < 64; field++) {
+			mcfg_string_append_fmt(&large, "    str f%zu '$(a)$(a)$(a)'\n",
+								   field);
+		}
+
+		mcfg_string_append_cstr(&large, "  end\n");
+	}
+
+	mcfg_string_append_cstr(&large, "end\n");
+
+	mcfg_parse_result_t ret = mcfg_parse(large->data);
+	if(ret.err != MCFG_OK) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "parsing failed\n");
+		exit(current_step);
+	}
+
+	/* rendering on the worker threads must not be counted in addition to the
+	 * whole call
+	 */
+	mcfg_reset_stats();
+	const uint64_t start = now_ns();
+	mcfg_file_fmt_res_t formatted = mcfg_format_file(&ret.value, 8);
+	const uint64_t elapsed = now_ns() - start;
+
+	const mcfg_stats_t stats = mcfg_get_stats();
+	if(formatted.err != MCFG_FMT_OK || stats.format_ns == 0 ||
+	   stats.format_ns > elapsed) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "format_ns %lu for a %lu ns call\n",
+				stats.format_ns, elapsed);
+		exit(current_step);
+	}
+
+	mcfg_free_file_fmt_res(formatted);
+	mcfg_free_file(ret.value);
+	free(large);
+
+	STEP_SUCCESS;
+}
+
+int
+main(void)
+{
+	TEST_INFO;
+
+	test_parse_stats();
+	test_serialize_stats();
+	test_format_stats();
+
+	return 0;
+}
@@ -0,0 +1,311 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcfg.h"
+#include "mcfg_util.h"
+
+#include "testing_shared.c"
+
+#define TEST_STEPS 5
+
+void
+test_data_to_buffer(void)
+{
+	BEGIN_STEP("converting data into caller buffers");
+
+	const struct {
+		mcfg_field_t field;
+		const char *expected;
+	} cases[] = {
+		{{.type = TYPE_I32, .data = &(int32_t){INT32_MIN}, .size = 4},
+		 "-2147483648"},
+		{{.type = TYPE_U32, .data = &(uint32_t){UINT32_MAX}, .size = 4},
+		 "4294967295"},
+		{{.type = TYPE_U8, .data = &(uint8_t){0}, .size = 1}, "0"},
+		{{.type = TYPE_I8, .data = &(int8_t){-7}, .size = 1}, "-7"},
+		{{.type = TYPE_BOOL, .data = &(bool){true}, .size = 1}, "true"},
+		{{.type = TYPE_BOOL, .data = &(bool){false}, .size = 1}, "false"},
+	};
+
+	char buf[MCFG_NUMBER_BUFFER_SIZE];
+	for(size_t ix = 0; ix < sizeof(cases) / sizeof(cases[0]); ix++) {
+		const size_t length = mcfg_data_to_buffer(cases[ix].field, buf,
+												  MCFG_NUMBER_BUFFER_SIZE);
+		if(length != strlen(cases[ix].expected) ||
+		   strcmp(buf, cases[ix].expected) != 0) {
+			STEP_FAIL;
+
+			fprintf(stderr, STEP_LOG_PRIMER "expected \"%s\", got \"%s\"\n",
+					cases[ix].expected, buf);
+			exit(current_step);
+		}
+	}
+
+	/* truncated output is still terminated, the full length is returned */
+	const mcfg_field_t min = cases[0].field;
+	if(mcfg_data_to_buffer(min, buf, 5) != 11 || strcmp(buf, "-214") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong truncation: \"%s\"\n", buf);
+		exit(current_step);
+	}
+
+	if(mcfg_data_to_buffer(min, NULL, 0) != 11) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "length not measured without buffer\n");
+		exit(current_step);
+	}
+
+	STEP_SUCCESS;
+}
+
+mcfg_field_t list_fields[] = {
+	{.name = "1", .type = TYPE_U8, .data = &(uint8_t){1}, .size = 1},
+	{.name = "2", .type = TYPE_U8, .data = &(uint8_t){2}, .size = 1},
+	{.name = "3", .type = TYPE_U8, .data = &(uint8_t){3}, .size = 1},
+};
+
+mcfg_list_t list = {.type = TYPE_U8, .field_count = 3, .fields = list_fields};
+
+void
+test_list_to_buffer(void)
+{
+	BEGIN_STEP("converting lists into caller buffers");
+
+	char buf[32];
+	if(mcfg_list_to_buffer(list, buf, sizeof(buf)) != 7 ||
+	   strcmp(buf, "1, 2, 3") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong list string \"%s\"\n", buf);
+		exit(current_step);
+	}
+
+	if(mcfg_format_list_to_buffer(list, "<", ">", buf, sizeof(buf)) != 11 ||
+	   strcmp(buf, "<1> <2> <3>") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong formatted list \"%s\"\n",
+				buf);
+		exit(current_step);
+	}
+
+	/* mcfg_format_list returned NULL for every non-empty list before it was
+	 * built on mcfg_format_list_to_buffer
+	 */
+	char *formatted = mcfg_format_list(list, "<", ">");
+	if(formatted == NULL || strcmp(formatted, "<1> <2> <3>") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong heap formatted list\n");
+		exit(current_step);
+	}
+
+	free(formatted);
+
+	/* truncation can cut elements, prefixes and postfixes alike */
+	if(mcfg_list_to_buffer(list, buf, 5) != 7 || strcmp(buf, "1, 2") != 0 ||
+	   mcfg_format_list_to_buffer(list, "<", ">", buf, 6) != 11 ||
+	   strcmp(buf, "<1> <") != 0 ||
+	   mcfg_format_list_to_buffer(list, "<", ">", NULL, 0) != 11) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong truncation \"%s\"\n", buf);
+		exit(current_step);
+	}
+
+	STEP_SUCCESS;
+}
+
+void
+test_list_copy(void)
+{
+	BEGIN_STEP("copying numeric lists");
+
+	mcfg_field_t signed_fields[] = {
+		{.type = TYPE_I8, .data = &(int8_t){-1}, .size = 1},
+		{.type = TYPE_I8, .data = &(int8_t){INT8_MIN}, .size = 1},
+		{.type = TYPE_I8, .data = &(int8_t){INT8_MAX}, .size = 1},
+	};
+	mcfg_list_t signed_list = {
+		.type = TYPE_I8, .field_count = 3, .fields = signed_fields};
+
+	int64_t i64[4] = {0, 0, 0, 42};
+	if(mcfg_list_copy_as_i64(signed_list, i64, 4) != 3 || i64[0] != -1 ||
+	   i64[1] != INT8_MIN || i64[2] != INT8_MAX || i64[3] != 42) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "signed list was not sign-extended\n");
+		exit(current_step);
+	}
+
+	mcfg_field_t unsigned_fields[] = {
+		{.type = TYPE_U32, .data = &(uint32_t){UINT32_MAX}, .size = 4},
+		{.type = TYPE_U32, .data = &(uint32_t){7}, .size = 4},
+	};
+	mcfg_list_t unsigned_list = {
+		.type = TYPE_U32, .field_count = 2, .fields = unsigned_fields};
+
+	/* unsigned values are zero-extended and copies are clamped to n */
+	uint32_t u32[2] = {0, 42};
+	if(mcfg_list_copy_as_i64(unsigned_list, i64, 4) != 2 ||
+	   i64[0] != UINT32_MAX || i64[1] != 7 ||
+	   mcfg_list_copy_as_u32(unsigned_list, u32, 1) != 1 ||
+	   u32[0] != UINT32_MAX || u32[1] != 42) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unsigned list copied incorrectly\n");
+		exit(current_step);
+	}
+
+	mcfg_field_t string_field = {.type = TYPE_STRING, .data = "a", .size = 2};
+	mcfg_list_t string_list = {
+		.type = TYPE_STRING, .field_count = 1, .fields = &string_field};
+
+	if(mcfg_list_copy_as_u32(signed_list, u32, 2) != -1 ||
+	   mcfg_list_copy_as_u32(string_list, u32, 2) != -1 ||
+	   mcfg_list_copy_as_i64(string_list, i64, 4) != -1) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "unsupported list type was copied\n");
+		exit(current_step);
+	}
+
+	STEP_SUCCESS;
+}
+
+void
+test_string_append_fmt(void)
+{
+	BEGIN_STEP("growing strings geometrically on formatted appends");
+
+	mcfg_string_t *str = mcfg_string_new("");
+
+	/* every reallocation changes the capacity, doubling it keeps the amount
+	 * of reallocations logarithmic
+	 */
+	size_t reallocations = 0;
+	size_t expected_length = 0;
+	for(int ix = 0; ix < 100000; ix++) {
+		const uint64_t capacity = str->capacity;
+		if(mcfg_string_append_fmt(&str, "%d,", ix) != MCFG_OK) {
+			STEP_FAIL;
+
+			fprintf(stderr, STEP_LOG_PRIMER "append %d failed\n", ix);
+			exit(current_step);
+		}
+
+		expected_length += snprintf(NULL, 0, "%d,", ix);
+		reallocations += str->capacity != capacity;
+	}
+
+	if(reallocations > 32 || str->length != expected_length ||
+	   strlen(str->data) != expected_length ||
+	   strncmp(str->data, "0,1,2,", 6) != 0 ||
+	   strcmp(str->data + expected_length - 6, "99999,") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "%zu reallocations, length %lu\n",
+				reallocations, (unsigned long)str->length);
+		exit(current_step);
+	}
+
+	free(str);
+
+	STEP_SUCCESS;
+}
+
+void
+test_string_reserve(void)
+{
+	BEGIN_STEP("reserving, clearing and appending to strings");
+
+	/* the capacity includes the NULL terminator */
+	mcfg_string_t *str = mcfg_string_new_sized(4);
+	if(str == NULL || str->capacity != 5 || str->length != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "wrong initial capacity\n");
+		exit(current_step);
+	}
+
+	if(mcfg_string_reserve(&str, 100) != MCFG_OK || str->capacity < 101) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "capacity was not reserved\n");
+		exit(current_step);
+	}
+
+	/* appends within the reserved capacity must not reallocate */
+	const uint64_t capacity = str->capacity;
+	for(size_t ix = 0; ix < 20; ix++) {
+		mcfg_string_append_n(&str, "abcdefgh", 5);
+	}
+
+	if(str->capacity != capacity || str->length != 100 ||
+	   strlen(str->data) != 100 || strncmp(str->data, "abcdeabcde", 10) != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "appending within capacity failed\n");
+		exit(current_step);
+	}
+
+	/* reserving less than the current capacity does nothing */
+	if(mcfg_string_reserve(&str, 10) != MCFG_OK || str->capacity != capacity) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "reserve shrunk the string\n");
+		exit(current_step);
+	}
+
+	mcfg_string_clear(str);
+	if(str->length != 0 || str->data[0] != 0 || str->capacity != capacity) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "clearing changed the capacity\n");
+		exit(current_step);
+	}
+
+	mcfg_string_append_n(&str, "xyz", 2);
+	if(str->length != 2 || strcmp(str->data, "xy") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "append after clear failed\n");
+		exit(current_step);
+	}
+
+	free(str);
+
+	/* a string created to exactly fit must not reallocate until it is full */
+	str = mcfg_string_new("abc");
+	const uint64_t exact_capacity = str->capacity;
+	mcfg_string_append_fmt(&str, "%s", "");
+	if(exact_capacity != 4 || str->capacity != exact_capacity ||
+	   strcmp(str->data, "abc") != 0) {
+		STEP_FAIL;
+
+		fprintf(stderr, STEP_LOG_PRIMER "capacity of exact string wrong\n");
+		exit(current_step);
+	}
+
+	free(str);
+
+	STEP_SUCCESS;
+}
+
+int
+main(void)
+{
+	TEST_INFO;
+
+	test_data_to_buffer();
+	test_list_to_buffer();
+	test_list_copy();
+	test_string_append_fmt();
+	test_string_reserve();
+
+	return 0;
+}